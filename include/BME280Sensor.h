@@ -0,0 +1,26 @@
+#ifndef BME280_SENSOR_H
+#define BME280_SENSOR_H
+
+#include <Adafruit_BME280.h>
+
+#include "Sensor.h"
+
+/**
+ * BME280 temperature and humidity sensor on I2C. Wire has to be started before begin() is called.
+ * The pressure is measured by the sensor as well, but not reported.
+ */
+class BME280Sensor : public Sensor {
+
+  private:
+    Adafruit_BME280 bme;
+    uint8_t address;
+
+  public:
+    BME280Sensor(uint8_t address);
+
+    bool begin() override;
+    bool read(Sample &sample) override;
+    const char *getName() override;
+};
+
+#endif
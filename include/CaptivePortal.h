@@ -0,0 +1,36 @@
+#ifndef CAPTIVE_PORTAL_H
+#define CAPTIVE_PORTAL_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+typedef enum {
+    PROBE_ANDROID,
+    PROBE_APPLE,
+    PROBE_WINDOWS,
+    PROBE_FIREFOX,
+    PROBE_OTHER, // Any other unknown url
+    PROBE_TYPE_COUNT
+} ProbeType;
+
+/**
+ * Answers the connectivity checks of the different operating systems.
+ * Every check gets a redirect to the config page without a body, so the OS opens the portal
+ * without the page being sent for every background check.
+ */
+class CaptivePortal {
+
+  private:
+    char portalUrl[24]; // http://<ap ip>/
+    uint32_t requests[PROBE_TYPE_COUNT] = {0};
+
+    void onProbe(AsyncWebServerRequest *request, ProbeType type);
+
+  public:
+    void begin(AsyncWebServer &server, IPAddress portalIP);
+
+    uint32_t getRequests(ProbeType type);
+    void printMetrics(Print &out);
+};
+
+#endif
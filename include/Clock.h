@@ -0,0 +1,29 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+/**
+ * Turns the millis() timestamps of the samples into wall clock time.
+ * Keeps the epoch time of one millis() reference, taken whenever the time is synced.
+ * Samples taken before the first sync get their epoch time as well once it is known,
+ * until then only their uptime is available.
+ * Timestamps up to 24 days away from the reference are converted, millis() may wrap around in between.
+ */
+class Clock {
+
+  private:
+    bool synced = false;
+    uint32_t epoch = 0;       // Epoch seconds at the reference
+    uint16_t epochMillis = 0; // Milliseconds of the second at the reference
+    uint32_t reference = 0;   // millis() of the reference
+
+  public:
+    void sync(uint32_t epoch, uint16_t epochMillis, uint32_t now);
+    void clear();
+
+    bool isSynced();
+    bool toEpoch(uint32_t timestamp, uint32_t &seconds, uint16_t &millis);
+};
+
+#endif
@@ -3,33 +3,126 @@
 
 #include <Arduino.h>
 
-#define MAGIC_NUMBER 0xC0FFEE
+#include "JournalStorage.h"
+
+// Identifies a config slot header in flash
+#define CONFIG_MAGIC 0x43464721
+// The version of the config layout, increase it on every change of cfg_struct and add a migration
+#define CONFIG_VERSION 8
+// The size of one config slot in flash including the header, there are two slots, each in a storage of its own
+#define CONFIG_SLOT_SIZE 1024
+
+// Default values of a new config
+#define DEFAULT_MQTT_PORT 1883
+#define DEFAULT_MESSAGE_DELAY 10
+#define DEFAULT_TEMP_GAIN 1000
+#define DEFAULT_REPORT_HEARTBEAT 600
+#define DEFAULT_WIFI_ROAM_RSSI -75
+
+// The number of stored WiFi networks, the first one is the network of wifi_ssid
+#define WIFI_PROFILE_COUNT 3
+
+// Where the samples are published, see topic_layout
+#define TOPIC_LAYOUT_CUSTOM 0 // Below the configured topic
+#define TOPIC_LAYOUT_DEVICE 1 // Below "thermometer/<host>", one topic per sensor
 
 class Config {
 
+    typedef struct wifi_profile_struct {
+        char ssid[32];   // SSID of the network, empty if unused
+        char passwd[32]; // Password of the network
+    } wifi_profile;
+
     typedef struct cfg_struct {
-        int magicNumber;        // Useed to determine if flash is initialized
         char wifi_ssid[32];     // SSID of WiFi
         char wifi_passwd[32];   // Password of WiFi
         char wifi_hostname[32]; // Password of WiFi
 
-        char mqtt_ip[16];                // Ip address or hostname of MQTT broker
-        unsigned short mqtt_port = 1833; // Port of MQTT broker
-        char mqtt_user[32];              // Username for MQTT broker
-        char mqtt_passwd[32];            // Password for MQTT broker
-        char mqtt_topic[255];            // MQTT publish topic
+        char mqtt_ip[16];           // Ip address or hostname of MQTT broker
+        unsigned short mqtt_port;   // Port of MQTT broker
+        char mqtt_user[32];         // Username for MQTT broker
+        char mqtt_passwd[32];       // Password for MQTT broker
+        char mqtt_topic[255];       // MQTT publish topic
+
+        int8 temp_correct;   // Replaced by temp_offset in version 4, only kept for the layout
+        uint16 messageDelay; // The time to wait between to mqtt publishes
+
+        uint8 payload_format; // Encoding of the published samples, see PayloadFormat
 
-        int8 temp_correct;        // Value for temperature correction
-        uint16 messageDelay = 10; // The time to wait between to mqtt publishes
+        int16 temp_offset;            // Added to the temperature in 1/100 degrees
+        uint16 temp_gain;             // Factor for the temperature in 1/1000
+        uint8 filter_oversample;      // Number of readings averaged into one sample
+        uint8 filter_median;          // Size of the median window over the readings
+        uint8 filter_smoothing;       // Weight of a new sample in the moving average in percent, 100 disables it
+        uint16 filter_spike_temp;     // Temperature readings further off the median are rejected, in 1/100 degrees
+        uint16 filter_spike_humidity; // Humidity readings further off the median are rejected, in 1/100 percent
+
+        uint16 report_deadband_temp;     // Smallest published temperature change in 1/100 degrees, 0 publishes every sample
+        uint16 report_deadband_humidity; // Smallest published humidity change in 1/100 percent, 0 publishes every sample
+        uint16 report_heartbeat;         // Longest time without a publish in seconds, 0 disables it
+
+        char static_ip[16];      // Static IPv4 of the station, empty to use DHCP
+        char static_gateway[16]; // Gateway for the static IPv4
+        char static_subnet[16];  // Subnet mask for the static IPv4
+        char static_dns[16];     // DNS server for the static IPv4, the gateway is used if empty
+
+        uint8 topic_layout; // Structure of the published topics, see TOPIC_LAYOUT_*
+        uint8 discovery;    // 1 to announce the sensors to Home Assistant
+
+        wifi_profile wifi_profiles[WIFI_PROFILE_COUNT - 1]; // More networks, used if they are received better than the first one
+        int8 wifi_priority[WIFI_PROFILE_COUNT];             // Preference of every network in dB, added to the RSSI when ranking them
+        int8 wifi_roam_rssi;                                // Below this RSSI in dBm a better access point is searched, 0 disables roaming
     } cfg;
 
+    typedef struct cfg_header_struct {
+        uint32 magic;    // Always CONFIG_MAGIC
+        uint16 version;  // Layout version of the config following the header
+        uint16 length;   // Length of the config following the header
+        uint32 sequence; // Increased on every save, the slot with the higher sequence is the current one
+        uint32 crc;      // CRC32 over the header fields above and the config
+    } cfg_header;
+
+    // Converts a stored config of one version to the next version
+    typedef void (*cfg_migration)(const uint8 *data, uint16 length, cfg &config);
+
   private:
     cfg config_struct;
+    bool initialized = false;
+
+    static const cfg_migration migrations[CONFIG_VERSION];
+    static JournalStorage *slots[2];
+    static JournalStorage *legacy;
+
+    static uint32 headerCRC(const cfg_header &header, const uint8 *data);
+    static bool readSlot(JournalStorage &storage, size_t offset, cfg_header &header);
+    static int8 findCurrentSlot(JournalStorage *const storage[2], const size_t offset[2], cfg_header &header);
+    static bool openSlots();
+    static void closeSlots();
+    static bool erase(JournalStorage &storage, size_t size);
+    static const char *redact(const char *secret);
+
+    static void migrateV1(const uint8 *data, uint16 length, cfg &config);
+    static void migrateV2(const uint8 *data, uint16 length, cfg &config);
+    static void migrateV3(const uint8 *data, uint16 length, cfg &config);
+    static void migrateV4(const uint8 *data, uint16 length, cfg &config);
+    static void migrateV5(const uint8 *data, uint16 length, cfg &config);
+    static void migrateV6(const uint8 *data, uint16 length, cfg &config);
+    static void migrateV7(const uint8 *data, uint16 length, cfg &config);
+
+    void migrate(const uint8 *data, uint16 length, uint16 version);
+    bool loadSlot(JournalStorage &storage, size_t offset, const cfg_header &header);
+    bool importLegacy();
 
   public:
+    Config();
+
+    static void setStorage(JournalStorage &slotA, JournalStorage &slotB, JournalStorage &legacy);
+
+    void setDefaults();
+
     void eraseConfigFlash();
-    void loadConfig();
-    void saveConfig();
+    bool loadConfig();
+    bool saveConfig();
 
     void printConfig();
 
@@ -47,10 +140,34 @@ class Config {
     char *getMqttPassword();
     char *getMqttTopic();
 
-    int8 getTempCorrection();
     uint16 getMessageDelay();
 
-    int getMagicNumber();
+    uint8 getPayloadFormat();
+
+    int16 getTempOffset();
+    uint16 getTempGain();
+    uint8 getFilterOversample();
+    uint8 getFilterMedian();
+    uint8 getFilterSmoothing();
+    uint16 getFilterSpikeTemp();
+    uint16 getFilterSpikeHumidity();
+
+    uint16 getReportDeadbandTemp();
+    uint16 getReportDeadbandHumidity();
+    uint16 getReportHeartbeat();
+
+    char *getStaticIP();
+    char *getStaticGateway();
+    char *getStaticSubnet();
+    char *getStaticDNS();
+
+    uint8 getTopicLayout();
+    bool getDiscovery();
+
+    char *getProfileSSID(uint8 index);
+    char *getProfilePassword(uint8 index);
+    int8 getProfilePriority(uint8 index);
+    int8 getRoamRSSI();
 
     //Setter
     bool setSSID(char ssid[]);
@@ -63,10 +180,34 @@ class Config {
     bool setMqttPassword(char passwd[]);
     bool setMqttTopic(char topic[]);
 
-    bool setTempCorrection(int8 value);
     bool setMessageDelay(uint16 delay);
 
-    bool setMagicNumber(int val);
+    bool setPayloadFormat(uint8 format);
+
+    bool setTempOffset(int16 offset);
+    bool setTempGain(uint16 gain);
+    bool setFilterOversample(uint8 oversample);
+    bool setFilterMedian(uint8 median);
+    bool setFilterSmoothing(uint8 smoothing);
+    bool setFilterSpikeTemp(uint16 spike);
+    bool setFilterSpikeHumidity(uint16 spike);
+
+    bool setReportDeadbandTemp(uint16 deadband);
+    bool setReportDeadbandHumidity(uint16 deadband);
+    bool setReportHeartbeat(uint16 heartbeat);
+
+    bool setStaticIP(char ip[]);
+    bool setStaticGateway(char gateway[]);
+    bool setStaticSubnet(char subnet[]);
+    bool setStaticDNS(char dns[]);
+
+    bool setTopicLayout(uint8 layout);
+    bool setDiscovery(bool discovery);
+
+    bool setProfileSSID(uint8 index, char ssid[]);
+    bool setProfilePassword(uint8 index, char passwd[]);
+    bool setProfilePriority(uint8 index, int8 priority);
+    bool setRoamRSSI(int8 rssi);
 };
 
-#endif
\ No newline at end of file
+#endif
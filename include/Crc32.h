@@ -0,0 +1,9 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t calculateCRC32(const void *data, size_t length, uint32_t crc = 0);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef DHT_SENSOR_H
+#define DHT_SENSOR_H
+
+#include <Adafruit_Sensor.h>
+#include <DHT.h>
+
+#include "Sensor.h"
+
+/**
+ * DHT11 or DHT22 temperature and humidity sensor.
+ * The sensor is read bit banged with interrupts disabled, which takes about 5 ms.
+ */
+class DHTSensor : public Sensor {
+
+  private:
+    DHT dht;
+
+  public:
+    DHTSensor(uint8_t pin, uint8_t type);
+
+    bool begin() override;
+    bool read(Sample &sample) override;
+    uint32_t getMinInterval() override;
+    const char *getName() override;
+};
+
+#endif
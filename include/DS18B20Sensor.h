@@ -0,0 +1,33 @@
+#ifndef DS18B20_SENSOR_H
+#define DS18B20_SENSOR_H
+
+#include <DallasTemperature.h>
+#include <OneWire.h>
+
+#include "Sensor.h"
+
+/**
+ * DS18B20 temperature sensor on a OneWire bus. Several sensors can share one bus, they are told apart by their index.
+ * The index is turned into the ROM address of the sensor when it is started, so the sensor keeps its readings
+ * even if another sensor on the bus fails later.
+ * The conversion takes up to 750 ms, it runs in the background between request() and read().
+ */
+class DS18B20Sensor : public Sensor {
+
+  private:
+    DallasTemperature &bus;
+    uint8_t index;
+    DeviceAddress address;
+    bool found = false;
+
+  public:
+    DS18B20Sensor(DallasTemperature &bus, uint8_t index);
+
+    bool begin() override;
+    uint32_t request() override;
+    bool read(Sample &sample) override;
+    bool hasHumidity() override;
+    const char *getName() override;
+};
+
+#endif
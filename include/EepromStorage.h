@@ -0,0 +1,19 @@
+#ifndef EEPROM_STORAGE_H
+#define EEPROM_STORAGE_H
+
+#include "JournalStorage.h"
+
+/**
+ * Storage backed by the emulated EEPROM, which is a single flash sector.
+ * Every write rewrites the whole sector, so it is only used to read and clear the config of older firmware.
+ */
+class EepromStorage : public JournalStorage {
+
+  public:
+    bool begin(size_t size) override;
+    bool read(size_t offset, void *data, size_t length) override;
+    bool write(size_t offset, const void *data, size_t length) override;
+    void end() override;
+};
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef ESP_WIFI_SCANNER_H
+#define ESP_WIFI_SCANNER_H
+
+#include "WiFiScanner.h"
+
+/**
+ * Scans with the WiFi stack of the ESP8266. The results are kept by the stack until they are cleared.
+ */
+class EspWiFiScanner : public WiFiScanner {
+
+  public:
+    bool start() override;
+    int16_t getResultCount() override;
+    bool getResult(uint8_t index, WiFiNetwork &network) override;
+    void clear() override;
+};
+
+#endif
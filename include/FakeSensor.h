@@ -0,0 +1,42 @@
+#ifndef FAKE_SENSOR_H
+#define FAKE_SENSOR_H
+
+#include "Sensor.h"
+
+/**
+ * Sensor without hardware, for the host tests and for running the firmware on a module without sensors.
+ * Every read returns the set values. With a ramp the temperature moves by the step on every read,
+ * back and forth between the set value and the set value plus the span, so the readings change like in a real room.
+ */
+class FakeSensor : public Sensor {
+
+  private:
+    const char *name;
+    int16_t temperature;
+    uint16_t humidity;
+    int16_t step = 0;
+    uint16_t span = 0;
+    int32_t position = 0; // Offset of the ramp in 1/100 degrees
+    bool rising = true;
+    bool failing = false;
+    uint32_t conversionTime = 0;
+    uint32_t reads = 0;
+
+  public:
+    FakeSensor(const char *name, int16_t temperature, uint16_t humidity = SAMPLE_NO_HUMIDITY);
+
+    void set(int16_t temperature, uint16_t humidity);
+    void setRamp(int16_t step, uint16_t span);
+    void setFailing(bool failing);
+    void setConversionTime(uint32_t conversionTime);
+
+    bool begin() override;
+    uint32_t request() override;
+    bool read(Sample &sample) override;
+    bool hasHumidity() override;
+    const char *getName() override;
+
+    uint32_t getReads();
+};
+
+#endif
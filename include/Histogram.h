@@ -0,0 +1,30 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <Arduino.h>
+
+// The number of buckets without the +Inf bucket
+#define HISTOGRAM_BUCKETS 8
+
+/**
+ * Histogram of durations in milliseconds with fixed buckets from 50 ms to 10 s.
+ * Printed in the prometheus text format with the values in seconds.
+ */
+class Histogram {
+
+  private:
+    static const uint32_t bounds[HISTOGRAM_BUCKETS];
+
+    uint32_t counts[HISTOGRAM_BUCKETS + 1] = {0}; // Not cumulative, the last one is +Inf
+    uint32_t count = 0;
+    uint64_t sum = 0;
+
+  public:
+    void observe(uint32_t duration);
+
+    uint32_t getCount();
+
+    void print(Print &out, const char *name, const char *labels);
+};
+
+#endif
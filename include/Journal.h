@@ -0,0 +1,57 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+
+#include "JournalStorage.h"
+#include "SampleBuffer.h"
+
+// The number of records the journal holds, the oldest ones are overwritten
+#define JOURNAL_SLOTS 256
+
+/**
+ * Append only log of samples which are not published yet, so they survive a reboot or power loss.
+ * Every record has a sequence number and a CRC. A record is written to slot (sequence % JOURNAL_SLOTS),
+ * so the writes rotate over the whole storage. A torn write only breaks the CRC of the record being written.
+ * The sequence of the last published sample is kept in two alternating markers.
+ * A sample knows the sequence of its record, so it can be marked as published without counting.
+ */
+class Journal {
+
+    typedef struct journal_record_struct {
+        uint32_t sequence; // Number of the record, 0 marks an empty slot
+        Sample sample;     // The sample itself
+        uint32_t crc;      // CRC32 over sequence and sample
+    } record;
+
+    typedef struct journal_marker_struct {
+        uint32_t sequence; // Sequence of the last published record
+        uint32_t reserved[2];
+        uint32_t crc; // CRC32 over sequence and reserved
+    } marker;
+
+  private:
+    JournalStorage &storage;
+    bool ready = false;
+    uint32_t head = 0; // Sequence of the newest record
+    uint32_t sent = 0; // Sequence of the last published record
+
+    static uint32_t recordCRC(const record &rec);
+    static uint32_t markerCRC(const marker &mark);
+
+    bool readRecord(uint32_t slot, record &rec);
+
+  public:
+    Journal(JournalStorage &storage);
+
+    bool begin();
+    uint32_t append(const Sample &sample);
+    void markSent(uint32_t sequence);
+    void sync();
+    uint16_t replay(SampleBuffer &buffer, uint32_t now);
+
+    uint32_t getHead();
+    uint32_t getPending();
+};
+
+#endif
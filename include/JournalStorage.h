@@ -0,0 +1,25 @@
+#ifndef JOURNAL_STORAGE_H
+#define JOURNAL_STORAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A block of persistent memory with a fixed size, used by the journal and the config slots.
+ * Keeps them independent of where their data is actually stored.
+ */
+class JournalStorage {
+
+  public:
+    virtual ~JournalStorage() {}
+
+    virtual bool begin(size_t size) = 0;
+    virtual bool read(size_t offset, void *data, size_t length) = 0;
+    virtual bool write(size_t offset, const void *data, size_t length) = 0;
+    // Puts the writes which are still buffered onto the persistent memory
+    virtual void sync() {}
+    // Releases the resources taken by begin(), a storage which is only used now and then does not keep them
+    virtual void end() {}
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef LITTLEFS_STORAGE_H
+#define LITTLEFS_STORAGE_H
+
+#include <FS.h>
+
+#include "JournalStorage.h"
+
+// The number of writes kept in the file buffer before they are synced to the flash
+#define LITTLEFS_SYNC_WRITES 8
+
+/**
+ * Storage backed by a file of fixed size on LittleFS.
+ * LittleFS is copy on write, so a synced write is either completely done or not at all
+ * and the flash wear is spread over the whole file system.
+ * Every sync rewrites a block of the file, so the writes are only synced every LITTLEFS_SYNC_WRITES writes
+ * or by sync(). A power loss drops the writes since the last sync.
+ */
+class LittleFSStorage : public JournalStorage {
+
+  private:
+    const char *path;
+    File file;
+    uint8_t unsynced = 0; // Writes since the last sync
+
+  public:
+    LittleFSStorage(const char *path);
+
+    bool begin(size_t size) override;
+    bool read(size_t offset, void *data, size_t length) override;
+    bool write(size_t offset, const void *data, size_t length) override;
+    void sync() override;
+    void end() override;
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef LOG_SINK_H
+#define LOG_SINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Receives complete log lines besides the serial port, for example to send them over the network.
+ * Called while logging, so an implementation must not block and must not log itself.
+ */
+class LogSink {
+
+  public:
+    virtual ~LogSink() {}
+
+    /**
+     * @param level The level of the line, see LOG_LEVEL_*
+     * @param line The line without the line break, not null terminated
+     * @param length The length of the line
+     */
+    virtual void write(uint8_t level, const char *line, size_t length) = 0;
+};
+
+#endif
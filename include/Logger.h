@@ -0,0 +1,74 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+
+#include "LogSink.h"
+
+// The log levels, a message is kept if its level is at most the configured one
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Messages above this level are removed by the compiler, set it with -D LOG_LEVEL=...
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// The size of the ring buffer holding the lines not written to the serial port yet
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE 1024
+#endif
+// The maximum length of one line, longer lines are cut
+#define LOG_LINE_SIZE 128
+
+// Tag and format are kept in flash. The arguments of a removed message are not evaluated.
+#define LOG_AT(level, tag, format, ...)                                    \
+    do {                                                                   \
+        if (LOG_LEVEL >= level) {                                          \
+            logger.write(level, PSTR(tag), PSTR(format), ##__VA_ARGS__);   \
+        }                                                                  \
+    } while (0)
+
+#define LOG_ERROR(tag, format, ...) LOG_AT(LOG_LEVEL_ERROR, tag, format, ##__VA_ARGS__)
+#define LOG_WARN(tag, format, ...) LOG_AT(LOG_LEVEL_WARN, tag, format, ##__VA_ARGS__)
+#define LOG_INFO(tag, format, ...) LOG_AT(LOG_LEVEL_INFO, tag, format, ##__VA_ARGS__)
+#define LOG_DEBUG(tag, format, ...) LOG_AT(LOG_LEVEL_DEBUG, tag, format, ##__VA_ARGS__)
+
+/**
+ * Formats log lines into a ring buffer, which is written to the serial port without blocking.
+ * A line which does not fit into the buffer is dropped and counted, the caller never waits for the UART.
+ * Optionally every line up to a level is handed to a sink, like mqtt or syslog.
+ * Not safe to use from interrupts.
+ */
+class Logger {
+
+  private:
+    char buffer[LOG_BUFFER_SIZE];
+    uint16_t head = 0;  // Next byte to write
+    uint16_t count = 0; // Bytes waiting for the serial port
+    uint32_t dropped = 0;
+    uint32_t reportedDropped = 0;
+
+    LogSink *sink = nullptr;
+    uint8_t sinkLevel = LOG_LEVEL_NONE;
+    bool inSink = false;
+
+    void push(const char *line, uint16_t length);
+
+  public:
+    void write(uint8_t level, PGM_P tag, PGM_P format, ...);
+
+    void setSink(LogSink *sink, uint8_t level);
+
+    void drain(Print &out);
+    void flush(Print &out);
+
+    uint32_t getDropped();
+};
+
+extern Logger logger;
+
+#endif
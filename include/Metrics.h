@@ -0,0 +1,52 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+
+#include "Histogram.h"
+
+/**
+ * Runtime counters of the device: loop time, heap, WiFi and mqtt connections.
+ * Everything has a fixed size, recording a value only updates a few counters.
+ * The loop time is kept for the whole uptime and for a window, which is restarted by every health message.
+ */
+class Metrics {
+
+  private:
+    uint32_t loopCount = 0;
+    uint64_t loopSum = 0; // In microseconds
+    uint32_t loopMax = 0;
+
+    uint32_t windowCount = 0;
+    uint64_t windowSum = 0;
+    uint32_t windowMin = UINT32_MAX;
+    uint32_t windowMax = 0;
+
+    uint32_t minFreeHeap = UINT32_MAX;
+
+    uint32_t wifiConnects = 0;
+    uint32_t wifiRoams = 0;
+    uint32_t mqttConnects = 0;
+    uint32_t mqttDisconnects = 0;
+
+    // Indexed by full (0) and fast (1) join
+    Histogram wifiAssociateTime[2];
+    Histogram wifiDhcpTime[2];
+    Histogram wifiConnectTime[2];
+    Histogram mqttConnectTime;
+
+  public:
+    void recordLoop(uint32_t duration);
+    void sampleHeap();
+
+    void observeWiFiAssociate(bool fast, uint32_t duration);
+    void observeWiFiConnect(bool fast, uint32_t dhcp, uint32_t total);
+    void countWiFiRoam();
+    void observeMqttConnect(uint32_t duration);
+    void countMqttDisconnect();
+
+    size_t writeHealth(char *buffer, size_t size, uint32_t sensorFailures, uint16_t backlog);
+    void printMetrics(Print &out);
+};
+
+#endif
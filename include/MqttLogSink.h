@@ -0,0 +1,23 @@
+#ifndef MQTT_LOG_SINK_H
+#define MQTT_LOG_SINK_H
+
+#include <AsyncMqttClient.h>
+
+#include "LogSink.h"
+
+/**
+ * Publishes log lines to a topic with QoS 0 while the broker is connected. Lines logged offline are only on the serial port.
+ */
+class MqttLogSink : public LogSink {
+
+  private:
+    AsyncMqttClient &client;
+    const char *topic;
+
+  public:
+    MqttLogSink(AsyncMqttClient &client, const char *topic);
+
+    void write(uint8_t level, const char *line, size_t length) override;
+};
+
+#endif
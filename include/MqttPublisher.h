@@ -0,0 +1,78 @@
+#ifndef MQTT_PUBLISHER_H
+#define MQTT_PUBLISHER_H
+
+#include <AsyncMqttClient.h>
+
+#include "Histogram.h"
+#include "PayloadEncoder.h"
+#include "SampleBuffer.h"
+#include "Timer.h"
+
+// The number of samples waiting for their PUBACK at the same time
+#define MQTT_INFLIGHT_WINDOW 4
+// The time to wait for a PUBACK before a message is sent again in milliseconds
+#define MQTT_ACK_TIMEOUT 5000
+// After this many retransmissions of a message the connection is considered dead and closed
+#define MQTT_MAX_RETRIES 3
+// The largest payload of a backlog batch
+#define MQTT_BATCH_SIZE 512
+// The largest payload of a single sample
+#define MQTT_SAMPLE_SIZE 96
+
+/**
+ * Publishes samples and backlog batches with QoS 1 over the async mqtt client.
+ * Publishing only queues the packet on the TCP connection and never waits for the network.
+ * At most MQTT_INFLIGHT_WINDOW samples and one backlog batch wait for their PUBACK at a time,
+ * a message without PUBACK is sent again with the dup flag after MQTT_ACK_TIMEOUT.
+ * A backlog batch is only removed from the backlog when its PUBACK arrived.
+ */
+class MqttPublisher {
+
+    typedef struct inflight_struct {
+        uint16_t packetId; // 0 marks a free slot
+        const char *topic; // Has to live until the PUBACK arrived
+        Sample sample;     // The published sample, unused for the batch
+        uint32_t sentAt;   // Time (millis) the message was sent first
+        Deadline timeout;  // Expires when the message has to be sent again
+        uint8_t retries;   // Number of retransmissions
+        bool acked;        // Set by the PUBACK
+    } inflight;
+
+  private:
+    AsyncMqttClient &client;
+    PayloadEncoder &encoder;
+
+    inflight samples[MQTT_INFLIGHT_WINDOW];
+
+    inflight batch;
+    uint8_t batchPayload[MQTT_BATCH_SIZE];
+    size_t batchLength = 0;
+    uint16_t batchCount = 0;
+    uint32_t batchDropped = 0; // Dropped samples of the backlog when the batch was sent
+    uint32_t journaled = 0;    // Journal sequence of the newest sample removed from the backlog
+
+    uint32_t retransmissions = 0;
+    Histogram ackTime;
+
+    bool resend(inflight &message, const uint8_t *payload, size_t length, bool retain, uint32_t now);
+
+  public:
+    MqttPublisher(AsyncMqttClient &client, PayloadEncoder &encoder);
+
+    void begin();
+    void onAck(uint16_t packetId);
+
+    bool publish(const char *topic, const Sample &sample, uint32_t now);
+    bool publishBatch(const char *topic, SampleBuffer &backlog, uint32_t now);
+    uint16_t update(SampleBuffer &backlog, uint32_t now);
+    uint8_t abort(Sample *unacked, uint8_t size);
+
+    bool isIdle();
+    bool isBatchInFlight();
+    uint8_t getInflight();
+    uint32_t getJournaled();
+
+    void printMetrics(Print &out);
+};
+
+#endif
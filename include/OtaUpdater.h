@@ -0,0 +1,71 @@
+#ifndef OTA_UPDATER_H
+#define OTA_UPDATER_H
+
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+
+// The maximum length of the host and of the path of a firmware url
+#define OTA_HOST_SIZE 64
+#define OTA_PATH_SIZE 192
+// The maximum length of one line of the http response header
+#define OTA_LINE_SIZE 128
+// Seconds without data after which a download is aborted
+#define OTA_RX_TIMEOUT 20
+
+typedef void (*OtaCallback)(bool success);
+
+/**
+ * Writes a new firmware into the update area of the flash while it is received, so the image is never held in RAM.
+ * The image is either pushed through the webserver or pulled from a http server without blocking the loop.
+ * Every update needs the MD5 digest of the image, it is checked before the update is accepted.
+ * The new firmware is started by the next restart.
+ */
+class OtaUpdater {
+
+    typedef enum { OTA_IDLE, OTA_CONNECTING, OTA_HEADER, OTA_BODY, OTA_DONE, OTA_FAILED } OtaState;
+
+  private:
+    OtaState state = OTA_IDLE;
+    OtaCallback callback = nullptr;
+    bool uploading = false; // Pushed through the webserver, not downloaded
+
+    AsyncClient client;
+    char host[OTA_HOST_SIZE];
+    char path[OTA_PATH_SIZE];
+    uint16_t port = 80;
+    char md5[33];
+
+    char line[OTA_LINE_SIZE];
+    uint8_t lineLength = 0;
+    uint16_t status = 0;
+    size_t contentLength = 0;
+    size_t written = 0;
+
+    bool parseUrl(const char *url);
+    bool start(size_t size, const char *md5);
+    void finish(bool success);
+    void parseHeader(uint8_t *data, size_t length);
+    void writeBody(uint8_t *data, size_t length);
+
+    void onConnect();
+    void onData(uint8_t *data, size_t length);
+    void onDisconnect();
+
+  public:
+    OtaUpdater();
+
+    void onFinished(OtaCallback callback);
+
+    bool beginUpload(const char *md5);
+    bool writeUpload(uint8_t *data, size_t length);
+    bool endUpload();
+
+    bool fetch(const char *url, const char *md5);
+    void abort();
+
+    bool isRunning();
+    bool hasFailed();
+    size_t getWritten();
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef PAYLOAD_ENCODER_H
+#define PAYLOAD_ENCODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Clock.h"
+#include "SampleBuffer.h"
+
+typedef enum {
+    PAYLOAD_JSON_STRING = 0, // {"temperature":"21.30","humidity":"45.00","time":"1700000000.250"}, the original format with the time
+    PAYLOAD_JSON_NUMBER = 1, // {"temperature":21.30,"humidity":45.00,"time":1700000000.250}
+    PAYLOAD_CBOR = 2,        // CBOR map {"t":2130,"h":4500,"e":1700000000}, values in 1/100, epoch in seconds
+    PAYLOAD_FORMAT_COUNT
+} PayloadFormat;
+
+// The first line of the CSV export
+#define PAYLOAD_CSV_HEADER "time,uptime_ms,sensor,temperature,humidity\n"
+
+/**
+ * Encodes samples for publishing into a buffer given by the caller. Nothing is allocated.
+ * Batches of buffered samples are JSON arrays of numeric objects, or CBOR arrays of maps,
+ * where every sample carries its age in seconds and the id of its sensor, unless it is the first sensor.
+ * The humidity is left out for sensors which do not measure it.
+ * Every sample carries the epoch time it was taken ("time", "e" in CBOR) if it was stored with the sample or the clock is synced,
+ * otherwise its uptime in milliseconds ("uptime_ms", "u" in CBOR).
+ * The lines of the history export are CSV rows or NDJSON objects with both times and the sensor id.
+ */
+class PayloadEncoder {
+
+  private:
+    PayloadFormat format;
+    Clock *clock = nullptr;
+
+    bool toEpoch(const Sample &sample, uint32_t &seconds, uint16_t &millis);
+    size_t writeTime(const Sample &sample, const char *quote, char *buffer, size_t size);
+
+    size_t writeJson(const Sample &sample, bool quoted, bool batched, long age, uint8_t *buffer, size_t size);
+    size_t writeCbor(const Sample &sample, bool batched, long age, uint8_t *buffer, size_t size);
+
+  public:
+    PayloadEncoder(PayloadFormat format = PAYLOAD_JSON_STRING);
+
+    void setClock(Clock *clock);
+    void setFormat(PayloadFormat format);
+    PayloadFormat getFormat();
+    bool isBinary();
+
+    size_t encode(const Sample &sample, uint8_t *buffer, size_t size);
+    size_t encodeBatch(SampleBuffer &samples, uint32_t now, uint8_t *buffer, size_t size, uint16_t &count);
+    size_t encodeLine(const Sample &sample, bool csv, char *buffer, size_t size);
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef REPORT_FILTER_H
+#define REPORT_FILTER_H
+
+#include <stdint.h>
+
+#include "SampleBuffer.h"
+
+/**
+ * Decides which samples of a sensor are reported, to publish only when something changed.
+ * A sample is reported if temperature or humidity moved by at least the deadband since the last reported sample,
+ * or if nothing was reported for the heartbeat, so it is still visible that the node is alive.
+ * Comparing against the last reported sample keeps a slow drift from going unnoticed.
+ */
+class ReportFilter {
+
+  private:
+    uint16_t deadbandTemperature = 0; // In 1/100 degrees, 0 reports every sample
+    uint16_t deadbandHumidity = 0;    // In 1/100 percent, 0 reports every sample
+    uint32_t heartbeat = 0;           // Longest time without a report in milliseconds, 0 disables it
+
+    Sample last;
+    bool hasLast = false;
+
+    uint32_t reported = 0;
+    uint32_t suppressed = 0;
+
+    bool changed(const Sample &sample);
+
+  public:
+    void configure(uint16_t deadbandTemperature, uint16_t deadbandHumidity, uint32_t heartbeat);
+
+    bool check(const Sample &sample);
+
+    uint32_t getReported();
+    uint32_t getSuppressed();
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef RTC_STATE_H
+#define RTC_STATE_H
+
+#include <Arduino.h>
+
+/**
+ * State kept in the RTC memory. It survives deep sleep and restarts, but not a power loss.
+ * Caches everything needed to skip the WiFi scan, DHCP and the broker lookup after waking up.
+ */
+class RtcState {
+
+    typedef struct rtc_state_struct {
+        uint32_t crc; // CRC32 over the rest of the struct
+
+        uint8_t bssid[6];  // BSSID of the last access point
+        uint8_t channel;   // WiFi channel of the last access point
+        uint8_t flags;     // Which of the cached values are valid
+        uint32_t ip;       // Last leased IPv4
+        uint32_t gateway;  // Last gateway
+        uint32_t subnet;   // Last subnet mask
+        uint32_t dns;      // Last DNS server
+        uint32_t brokerIp; // Resolved address of the mqtt broker
+
+        uint32_t wakeCount;          // Number of wakeups since power on
+        uint16_t failedWakes;        // Number of wakeups in a row without WiFi
+        uint16_t otaBoots;           // Restarts of a new firmware which did not reach the broker yet
+        uint32_t publishCount;       // Number of wakeups with a publish
+        uint32_t lastWakeToPublish;  // Time from wakeup to publish of the last cycle in milliseconds
+        uint32_t totalWakeToPublish; // Sum of all wakeup to publish times in milliseconds
+        uint8_t profile;             // Index of the WiFi network of the last access point
+        uint32_t wakeEpoch;          // Estimated epoch seconds of the next wakeup, 0 if the time is unknown
+    } rtc;
+
+  private:
+    rtc state;
+
+  public:
+    bool load();
+    void save();
+
+    bool hasNetwork();
+    void setNetwork(uint8_t profile, const uint8_t *bssid, uint8_t channel, IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns);
+    void clearNetwork();
+
+    uint8_t getProfile();
+    const uint8_t *getBSSID();
+    uint8_t getChannel();
+    IPAddress getIP();
+    IPAddress getGateway();
+    IPAddress getSubnet();
+    IPAddress getDNS();
+
+    bool hasBrokerIP();
+    void setBrokerIP(IPAddress ip);
+    void clearBrokerIP();
+    IPAddress getBrokerIP();
+
+    void countWake(bool wifiConnected);
+    void countPublish(uint32_t wakeToPublish);
+
+    uint32_t getWakeCount();
+    uint16_t getFailedWakes();
+    uint32_t getPublishCount();
+    uint32_t getLastWakeToPublish();
+    uint32_t getAverageWakeToPublish();
+
+    void startOtaTrial();
+    bool isOtaTrial();
+    uint16_t countOtaBoot();
+    void endOtaTrial();
+
+    bool isDiscoverySent();
+    void setDiscoverySent(bool sent);
+
+    uint32_t getWakeEpoch();
+    void setWakeEpoch(uint32_t epoch);
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef SAMPLE_BUFFER_H
+#define SAMPLE_BUFFER_H
+
+#include <stdint.h>
+
+// The number of samples kept while the broker is unreachable
+#define SAMPLE_BUFFER_SIZE 128
+// The humidity of samples from sensors which do not measure it
+#define SAMPLE_NO_HUMIDITY 0xFFFF
+
+/**
+ * A single sensor reading in fixed point, 20 bytes per sample.
+ */
+typedef struct sample_struct {
+    uint32_t timestamp;   // Time the sample was taken (millis)
+    int16_t temperature;  // Temperature in 1/100 degrees celsius
+    uint16_t humidity;    // Humidity in 1/100 percent, SAMPLE_NO_HUMIDITY if not measured
+    uint8_t sensor;       // Id of the sensor in the SensorRegistry
+    uint8_t reserved;
+    uint16_t epochMillis; // Milliseconds of the second of the epoch time
+    uint32_t epoch;       // Epoch seconds the sample was taken, 0 if not known. Kept over a restart, unlike the timestamp
+    uint32_t journal;     // Sequence of the journal record holding the sample, 0 if it is not in the journal
+} Sample;
+
+/**
+ * Fixed size ring buffer of samples. When the buffer is full, the oldest sample is overwritten.
+ * All the memory is part of the object, nothing is allocated on the heap.
+ */
+class SampleBuffer {
+
+  private:
+    Sample samples[SAMPLE_BUFFER_SIZE];
+    uint16_t head = 0;  // Index of the oldest sample
+    uint16_t count = 0; // Number of samples stored
+    uint32_t dropped = 0;
+
+  public:
+    void push(const Sample &sample);
+    const Sample &peek(uint16_t index);
+    void pop(uint16_t n);
+    void clear();
+
+    uint16_t size();
+    bool isEmpty();
+    bool isFull();
+    uint32_t getDropped();
+};
+
+#endif
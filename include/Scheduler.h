@@ -0,0 +1,36 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+// The maximum number of tasks the scheduler can hold
+#define SCHEDULER_MAX_TASKS 10
+
+typedef void (*TaskCallback)();
+
+/**
+ * A small cooperative scheduler driven by millis() deadlines.
+ * Every task runs to completion and must not block. All deadline
+ * comparisons are done on the difference of two timestamps, so the
+ * scheduler keeps working when millis() wraps around after 49.7 days.
+ */
+class Scheduler {
+
+    typedef struct task_struct {
+        TaskCallback callback; // The function to run
+        uint32_t period;       // Time between two runs in milliseconds
+        uint32_t deadline;     // Time (millis) the task is due next
+    } task;
+
+  private:
+    task tasks[SCHEDULER_MAX_TASKS];
+    uint8_t taskCount = 0;
+
+  public:
+    int addTask(TaskCallback callback, uint32_t period, uint32_t now, uint32_t offset = 0);
+
+    void run(uint32_t now);
+    uint32_t timeUntilNext(uint32_t now);
+};
+
+#endif
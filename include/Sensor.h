@@ -0,0 +1,48 @@
+#ifndef SENSOR_H
+#define SENSOR_H
+
+#include <stdint.h>
+
+#include "SampleBuffer.h"
+
+/**
+ * A temperature sensor, optionally measuring humidity as well.
+ * A measurement is started with request() and picked up with read() once the sensor is done,
+ * so sensors with a long conversion time do not block in the meantime.
+ */
+class Sensor {
+
+  public:
+    virtual ~Sensor() {}
+
+    virtual bool begin() = 0;
+
+    /**
+     * Starts a measurement.
+     *
+     * @return The milliseconds until the result can be read, 0 if it can be read immediately
+     */
+    virtual uint32_t request() { return 0; }
+
+    /**
+     * @return The shortest time between two measurements in milliseconds
+     */
+    virtual uint32_t getMinInterval() { return 0; }
+
+    /**
+     * Reads the result of the last measurement into temperature and humidity of the sample.
+     * Sensors without humidity set it to SAMPLE_NO_HUMIDITY.
+     *
+     * @return True if the reading is valid
+     */
+    virtual bool read(Sample &sample) = 0;
+
+    /**
+     * @return False if the sensor only measures the temperature
+     */
+    virtual bool hasHumidity() { return true; }
+
+    virtual const char *getName() = 0;
+};
+
+#endif
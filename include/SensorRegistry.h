@@ -0,0 +1,67 @@
+#ifndef SENSOR_REGISTRY_H
+#define SENSOR_REGISTRY_H
+
+#include <stdint.h>
+
+#include "SampleBuffer.h"
+#include "Sensor.h"
+#include "SignalFilter.h"
+#include "Timer.h"
+
+// The maximum number of sensors of one node
+#define SENSOR_MAX_COUNT 4
+// The time between the first readings of two sensors in milliseconds, so they do not run in the same update
+#define SENSOR_STAGGER 500
+
+/**
+ * Holds the sensors of the node and reads each of them with its own period.
+ * Every update does at most one blocking sensor access, the slow reads of several sensors never line up.
+ * The readings are conditioned by a filter for temperature and humidity of every sensor.
+ * With oversampling the sensor is read several times per period, the filters turn that into one sample.
+ * The latest sample of every sensor is kept until it is taken for publishing.
+ */
+class SensorRegistry {
+
+    typedef struct sensor_entry_struct {
+        Sensor *sensor;      // The driver
+        const char *suffix;  // Appended to the topic, empty for the main topic
+        uint32_t period;     // Time between two samples in milliseconds
+        uint32_t interval;   // Time between two readings in milliseconds, shorter than the period with oversampling
+        uint32_t deadline;   // Time (millis) the next measurement is due
+        Deadline conversion; // Armed while a measurement is running
+        SignalFilter temperature;
+        SignalFilter humidity;
+        Sample latest;       // The last sample
+        bool ready;          // True if the last sample was not taken yet
+        uint32_t failures;   // Number of failed readings
+    } entry;
+
+  private:
+    entry entries[SENSOR_MAX_COUNT];
+    uint8_t count = 0;
+    FilterSettings temperatureSettings;
+    FilterSettings humiditySettings;
+
+    void configure(entry &e);
+    void updateInterval(entry &e);
+    void collect(uint8_t id, uint32_t now);
+
+  public:
+    int add(Sensor *sensor, const char *suffix, uint32_t period, uint32_t now);
+    void begin();
+    void setFilters(const FilterSettings &temperature, const FilterSettings &humidity);
+    void setPeriod(uint8_t id, uint32_t period, uint32_t now);
+
+    bool update(uint32_t now);
+    void triggerAll(uint32_t now);
+    bool isBusy(uint32_t now);
+
+    bool take(uint8_t id, Sample &sample);
+
+    uint8_t size();
+    const char *getSuffix(uint8_t id);
+    Sensor *getSensor(uint8_t id);
+    uint32_t getFailures(uint8_t id);
+};
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef SETTINGS_JSON_H
+#define SETTINGS_JSON_H
+
+#include <Arduino.h>
+
+#include "Config.h"
+
+void printSettingsJson(Config &config, Print &out);
+
+#endif
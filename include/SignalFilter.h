@@ -0,0 +1,58 @@
+#ifndef SIGNAL_FILTER_H
+#define SIGNAL_FILTER_H
+
+#include <stdint.h>
+
+// The largest median window, has to be odd
+#define FILTER_MAX_MEDIAN 7
+// The largest number of readings averaged into one value
+#define FILTER_MAX_OVERSAMPLE 16
+// After this many spikes in a row the value is taken as a real step and accepted
+#define FILTER_MAX_REJECTS 3
+
+/**
+ * The settings of one filter. The defaults pass the readings through unchanged.
+ */
+typedef struct filter_settings_struct {
+    uint8_t oversample = 1;   // Number of readings averaged into one value
+    uint8_t median = 1;       // Size of the median window over the readings, odd
+    uint8_t smoothing = 100;  // Weight of a new value in the moving average in percent, 100 disables it
+    uint16_t spike = 0;       // Readings further than this from the median are rejected, 0 disables it
+    int16_t offset = 0;       // Added after the gain was applied
+    uint16_t gain = 1000;     // Factor in 1/1000, at most 10000
+} FilterSettings;
+
+/**
+ * Conditions the readings of one measured value, all in fixed point without floats.
+ * Every reading is checked against the median of the last ones and replaced by it if it is a spike,
+ * then oversample median values are averaged, smoothed by an exponential moving average and calibrated.
+ * All the state is part of the object.
+ */
+class SignalFilter {
+
+  private:
+    FilterSettings settings;
+
+    int16_t window[FILTER_MAX_MEDIAN];
+    uint8_t windowIndex = 0;
+    uint8_t windowCount = 0;
+    uint8_t rejects = 0;
+
+    int32_t sum = 0;
+    uint8_t sumCount = 0;
+
+    int32_t average = 0; // Moving average in 1/256 of the value
+    bool averageValid = false;
+
+    int16_t median();
+
+  public:
+    void configure(const FilterSettings &settings);
+    void reset();
+
+    bool add(int16_t reading, int16_t &value);
+
+    uint8_t getOversample();
+};
+
+#endif
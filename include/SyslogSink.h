@@ -0,0 +1,34 @@
+#ifndef SYSLOG_SINK_H
+#define SYSLOG_SINK_H
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+
+#include "LogSink.h"
+
+// The default port of a syslog server
+#define SYSLOG_PORT 514
+// The facility of the messages, local0
+#define SYSLOG_FACILITY 16
+// The maximum size of one syslog packet
+#define SYSLOG_PACKET_SIZE 192
+
+/**
+ * Sends log lines as BSD syslog (RFC 3164) UDP packets while the station is connected.
+ * UDP sends do not wait for anything, lost packets are not repeated.
+ */
+class SyslogSink : public LogSink {
+
+  private:
+    WiFiUDP udp;
+    IPAddress server;
+    uint16_t port;
+    const char *hostname;
+
+  public:
+    SyslogSink(const char *server, const char *hostname, uint16_t port = SYSLOG_PORT);
+
+    void write(uint8_t level, const char *line, size_t length) override;
+};
+
+#endif
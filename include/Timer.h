@@ -0,0 +1,56 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+/**
+ * A point in time (millis) after which something should happen.
+ * All comparisons use the signed difference of two timestamps,
+ * so they keep working when millis() wraps around after 49.7 days.
+ */
+class Deadline {
+
+  private:
+    uint32_t deadline = 0;
+    bool armed = false;
+
+  public:
+    static bool reached(uint32_t now, uint32_t deadline);
+
+    void set(uint32_t now, uint32_t timeout);
+    void clear();
+
+    bool isArmed();
+    bool expired(uint32_t now);
+};
+
+/**
+ * Retry timer with exponential backoff and random jitter.
+ * Every failed attempt doubles the delay until the maximum is reached.
+ * The jitter keeps a fleet of devices from retrying all at the same time after an outage.
+ */
+class Backoff {
+
+  private:
+    uint32_t baseDelay;
+    uint32_t maxDelay;
+    uint8_t jitterPercent;
+    uint8_t failures = 0;
+    uint32_t randomState;
+    Deadline next;
+
+    uint32_t nextRandom();
+
+  public:
+    Backoff(uint32_t baseDelay, uint32_t maxDelay, uint8_t jitterPercent = 20);
+
+    void seed(uint32_t seed);
+
+    bool ready(uint32_t now);
+    void failed(uint32_t now);
+    void reset();
+
+    uint32_t getCurrentDelay();
+};
+
+#endif
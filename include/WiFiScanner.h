@@ -0,0 +1,49 @@
+#ifndef WIFI_SCANNER_H
+#define WIFI_SCANNER_H
+
+#include <stdint.h>
+
+// Results of getResultCount() while there is no result
+#define WIFI_SCANNER_RUNNING -1
+#define WIFI_SCANNER_FAILED -2
+
+/**
+ * An access point found by a scan.
+ */
+typedef struct wifi_network_struct {
+    char ssid[33];    // Null terminated SSID
+    uint8_t bssid[6]; // MAC address of the access point
+    uint8_t channel;  // WiFi channel
+    int8_t rssi;      // Received signal strength in dBm
+} WiFiNetwork;
+
+/**
+ * A scan for access points, which runs in the background.
+ * Keeps the selection of the network independent of the WiFi stack, so it can be driven by scripted results.
+ */
+class WiFiScanner {
+
+  public:
+    virtual ~WiFiScanner() {}
+
+    /**
+     * Starts a scan, does not wait for it.
+     *
+     * @return False if the scan could not be started
+     */
+    virtual bool start() = 0;
+
+    /**
+     * @return The number of found access points, WIFI_SCANNER_RUNNING or WIFI_SCANNER_FAILED
+     */
+    virtual int16_t getResultCount() = 0;
+
+    virtual bool getResult(uint8_t index, WiFiNetwork &network) = 0;
+
+    /**
+     * Frees the results of the last scan.
+     */
+    virtual void clear() = 0;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef WIFI_SELECTOR_H
+#define WIFI_SELECTOR_H
+
+#include <stdint.h>
+
+#include "Timer.h"
+#include "WiFiScanner.h"
+
+// The maximum number of known networks
+#define WIFI_SELECTOR_MAX_PROFILES 4
+// Access points received worse than this in dBm are not joined
+#define WIFI_MIN_RSSI -90
+// The time in milliseconds the RSSI has to stay below the roaming threshold before a better access point is searched
+#define WIFI_ROAM_HOLD 30000
+// The shortest time in milliseconds between two roaming scans
+#define WIFI_ROAM_INTERVAL 300000
+// Another access point has to be received this much better in dB to roam to it
+#define WIFI_ROAM_HYSTERESIS 8
+
+/**
+ * The access point chosen by a scan.
+ */
+typedef struct wifi_candidate_struct {
+    uint8_t profile;  // The index of the known network
+    uint8_t bssid[6]; // MAC address of the access point
+    uint8_t channel;  // WiFi channel
+    int8_t rssi;      // Received signal strength in dBm
+} WiFiCandidate;
+
+/**
+ * Chooses the access point to join from a scan. Every access point of a known network is ranked
+ * by its RSSI plus the priority of the network, so a preferred network wins unless it is received much worse.
+ * While connected it watches the RSSI and asks for a roaming scan when it stays below a threshold.
+ * Only roams if another access point is received clearly better, so the device does not switch back and forth.
+ * Nothing here touches the WiFi stack, the time is passed in.
+ */
+class WiFiSelector {
+
+    typedef struct profile_struct {
+        const char *ssid; // Has to live as long as the selector uses it
+        int8_t priority;  // Added to the RSSI in dB
+    } profile;
+
+  private:
+    profile profiles[WIFI_SELECTOR_MAX_PROFILES] = {};
+    uint8_t count = 0;
+
+    int8_t roamRssi = 0;
+    bool weak = false;
+    uint32_t weakSince = 0;
+    Deadline roamBlocked;
+
+    int16_t score(const WiFiCandidate &candidate);
+
+  public:
+    void clearProfiles();
+    bool addProfile(uint8_t index, const char *ssid, int8_t priority);
+    uint8_t getProfileCount();
+
+    bool select(WiFiScanner &scanner, WiFiCandidate &best);
+
+    void setRoamThreshold(int8_t rssi);
+    bool checkRoam(int8_t rssi, uint32_t now);
+    bool shouldRoam(const WiFiCandidate &candidate, const uint8_t *bssid, int8_t rssi);
+    void resetRoam(uint32_t now);
+};
+
+#endif
@@ -0,0 +1,102 @@
+"""
+Minifies and gzips the pages in HTML/ and embeds them as PROGMEM arrays into
+include/generated/<name>_html.h. Runs as PlatformIO pre script before every build,
+or standalone with: python scripts/embed_html.py
+"""
+
+import gzip
+import os
+import re
+
+HTML_DIR = "HTML"
+OUTPUT_DIR = os.path.join("include", "generated")
+
+
+def minify_css(css):
+    css = re.sub(r"/\*.*?\*/", "", css, flags=re.S)
+    css = re.sub(r"\s+", " ", css)
+    css = re.sub(r"\s*([{};:,>])\s*", r"\1", css)
+    return css.replace(";}", "}").strip()
+
+
+def minify_js(js):
+    # Only strips indentation and line breaks, the scripts are written with explicit semicolons
+    js = re.sub(r"^\s*//.*$", "", js, flags=re.M)
+    js = re.sub(r"\s*\n\s*", "", js)
+    return js.strip()
+
+
+def minify_html(html):
+    html = re.sub(r"<!--.*?-->", "", html, flags=re.S)
+
+    parts = re.split(r"(<style>.*?</style>|<script>.*?</script>)", html, flags=re.S)
+    result = []
+    for part in parts:
+        if part.startswith("<style>"):
+            result.append("<style>" + minify_css(part[7:-8]) + "</style>")
+        elif part.startswith("<script>"):
+            result.append("<script>" + minify_js(part[8:-9]) + "</script>")
+        else:
+            part = re.sub(r"\s+", " ", part)
+            part = re.sub(r">\s+<", "><", part)
+            # Whitespace next to the style and script blocks
+            part = re.sub(r"^\s+(?=<)|(?<=>)\s+$", "", part)
+            result.append(part)
+    return "".join(result).strip()
+
+
+def to_header(name, source, data):
+    symbol = name + "_html_gz"
+    lines = [
+        "// Generated by scripts/embed_html.py from %s, do not edit." % source.replace(os.sep, "/"),
+        "#ifndef %s_HTML_H" % name.upper(),
+        "#define %s_HTML_H" % name.upper(),
+        "",
+        "#include <Arduino.h>",
+        "",
+        "static const size_t %s_len = %d;" % (symbol, len(data)),
+        "static const uint8_t %s[] PROGMEM = {" % symbol,
+    ]
+    for i in range(0, len(data), 16):
+        lines.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    lines += ["};", "", "#endif", ""]
+    return "\n".join(lines)
+
+
+def embed_all(project_dir):
+    output_dir = os.path.join(project_dir, OUTPUT_DIR)
+    if not os.path.isdir(output_dir):
+        os.makedirs(output_dir)
+
+    html_dir = os.path.join(project_dir, HTML_DIR)
+    for filename in sorted(os.listdir(html_dir)):
+        if not filename.endswith(".html"):
+            continue
+
+        name = os.path.splitext(filename)[0].replace("-", "_")
+        source = os.path.join(HTML_DIR, filename)
+        with open(os.path.join(project_dir, source), encoding="utf-8") as f:
+            html = f.read()
+
+        minified = minify_html(html).encode("utf-8")
+        # mtime=0 keeps the output reproducible, so the header only changes with the page
+        data = gzip.compress(minified, compresslevel=9, mtime=0)
+        header = to_header(name, source, data)
+
+        target = os.path.join(output_dir, name + "_html.h")
+        if os.path.exists(target):
+            with open(target, encoding="utf-8") as f:
+                if f.read() == header:
+                    continue
+
+        with open(target, "w", encoding="utf-8") as f:
+            f.write(header)
+        print("Embedded %s: %d bytes, %d minified, %d gzipped" % (source, len(html.encode("utf-8")), len(minified), len(data)))
+
+
+try:
+    Import("env")  # noqa: F821
+    embed_all(env.subst("$PROJECT_DIR"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        embed_all(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
@@ -0,0 +1,112 @@
+"""
+Records the flash and RAM footprint of the firmware after every build and compares it to
+scripts/size_baseline.json. The build fails if a value grew by more than the allowed
+threshold. Runs as PlatformIO post script, or standalone with:
+    python scripts/size_report.py <firmware.elf> <env name> [--update-baseline]
+
+The report is written to <build dir>/size_report.json. The threshold in percent is set with
+custom_size_threshold in platformio.ini or the SIZE_THRESHOLD environment variable.
+Set SIZE_UPDATE_BASELINE=1 to store the current sizes as new baseline.
+"""
+
+import json
+import os
+import re
+import subprocess
+import sys
+
+BASELINE_FILE = os.path.join("scripts", "size_baseline.json")
+REPORT_FILE = "size_report.json"
+DEFAULT_THRESHOLD = 2.0
+
+# Sections of the ESP8266 linker scripts and where they end up
+FLASH_SECTIONS = (".irom0.text", ".text", ".text1", ".data", ".rodata")
+IRAM_SECTIONS = (".text", ".text1")
+RAM_SECTIONS = (".data", ".rodata", ".bss")
+
+
+def read_sections(size_tool, elf):
+    output = subprocess.check_output([size_tool, "-A", "-d", elf], universal_newlines=True)
+    sections = {}
+    for line in output.splitlines():
+        match = re.match(r"^(\.\S+)\s+(\d+)\s+\d+", line)
+        if match:
+            sections[match.group(1)] = int(match.group(2))
+    return sections
+
+
+def summarize(sections):
+    return {
+        "flash": sum(sections.get(name, 0) for name in FLASH_SECTIONS),
+        "iram": sum(sections.get(name, 0) for name in IRAM_SECTIONS),
+        "ram": sum(sections.get(name, 0) for name in RAM_SECTIONS),
+    }
+
+
+def load_baseline(project_dir):
+    path = os.path.join(project_dir, BASELINE_FILE)
+    if not os.path.exists(path):
+        return {}
+    with open(path, encoding="utf-8") as f:
+        return json.load(f)
+
+
+def save_baseline(project_dir, baseline):
+    with open(os.path.join(project_dir, BASELINE_FILE), "w", encoding="utf-8") as f:
+        json.dump(baseline, f, indent=4, sort_keys=True)
+        f.write("\n")
+
+
+def check(project_dir, build_dir, env_name, size_tool, elf, threshold, update):
+    sections = read_sections(size_tool, elf)
+    totals = summarize(sections)
+
+    report = {"env": env_name, "totals": totals, "sections": sections}
+    with open(os.path.join(build_dir, REPORT_FILE), "w", encoding="utf-8") as f:
+        json.dump(report, f, indent=4, sort_keys=True)
+        f.write("\n")
+
+    baseline = load_baseline(project_dir)
+    if update:
+        baseline[env_name] = totals
+        save_baseline(project_dir, baseline)
+        print("Size baseline of %s updated: %s" % (env_name, totals))
+        return True
+
+    if env_name not in baseline:
+        print("Size of %s: %s, no baseline stored" % (env_name, totals))
+        return True
+
+    ok = True
+    for key, value in sorted(totals.items()):
+        reference = baseline[env_name].get(key, 0)
+        change = (value - reference) * 100.0 / reference if reference > 0 else 0.0
+        print("Size of %s %s: %d bytes (%+d, %+.2f%%)" % (env_name, key, value, value - reference, change))
+        if change > threshold:
+            print("Size of %s %s grew by more than %.2f%%" % (env_name, key, threshold))
+            ok = False
+    return ok
+
+
+def post_build(source, target, env):
+    threshold = float(os.environ.get("SIZE_THRESHOLD", env.GetProjectOption("custom_size_threshold", DEFAULT_THRESHOLD)))
+    update = os.environ.get("SIZE_UPDATE_BASELINE") == "1"
+
+    ok = check(env.subst("$PROJECT_DIR"), env.subst("$BUILD_DIR"), env.subst("$PIOENV"), env.subst("$SIZETOOL"),
+               str(target[0]), threshold, update)
+    if not ok:
+        env.Exit(1)
+
+
+try:
+    Import("env")  # noqa: F821
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", post_build)  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        if len(sys.argv) < 3:
+            print(__doc__)
+            sys.exit(2)
+        elf_path = sys.argv[1]
+        sys.exit(0 if check(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), os.path.dirname(os.path.abspath(elf_path)),
+                            sys.argv[2], os.environ.get("SIZETOOL", "xtensa-lx106-elf-size"), elf_path,
+                            float(os.environ.get("SIZE_THRESHOLD", DEFAULT_THRESHOLD)), "--update-baseline" in sys.argv) else 1)
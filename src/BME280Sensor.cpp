@@ -0,0 +1,31 @@
+#include "BME280Sensor.h"
+
+#include "Logger.h"
+
+BME280Sensor::BME280Sensor(uint8_t address) : address(address) {}
+
+bool BME280Sensor::begin() {
+    if (!bme.begin(address, &Wire)) {
+        LOG_ERROR("BME280", "No sensor found at address 0x%02X!", address);
+        return false;
+    }
+    return true;
+}
+
+bool BME280Sensor::read(Sample &sample) {
+    float temp = bme.readTemperature();
+    float humidity = bme.readHumidity();
+
+    if (isnan(humidity) || isnan(temp)) {
+        LOG_WARN("BME280", "Failed to read from BME280 sensor!");
+        return false;
+    }
+
+    sample.temperature = (int16_t)lroundf(temp * 100);
+    sample.humidity = (uint16_t)lroundf(humidity * 100);
+    return true;
+}
+
+const char *BME280Sensor::getName() {
+    return "bme280";
+}
@@ -0,0 +1,62 @@
+#include "CaptivePortal.h"
+
+typedef struct probe_struct {
+    const char *path;
+    ProbeType type;
+} probe;
+
+// The urls requested by the operating systems to check for a captive portal
+static const probe probes[] = {
+    {"/generate_204", PROBE_ANDROID},
+    {"/gen_204", PROBE_ANDROID},
+    {"/hotspot-detect.html", PROBE_APPLE},
+    {"/library/test/success.html", PROBE_APPLE},
+    {"/connecttest.txt", PROBE_WINDOWS},
+    {"/ncsi.txt", PROBE_WINDOWS},
+    {"/redirect", PROBE_WINDOWS},
+    {"/fwlink", PROBE_WINDOWS},
+    {"/success.txt", PROBE_FIREFOX},
+    {"/canonical.html", PROBE_FIREFOX},
+};
+
+static const char *const probeNames[PROBE_TYPE_COUNT] = {"android", "apple", "windows", "firefox", "other"};
+
+/**
+ * Registers the handlers for all known connectivity checks and for unknown urls.
+ *
+ * @param server The webserver to register the handlers at
+ * @param portalIP The ip the config page is reachable at in access point mode
+ */
+void CaptivePortal::begin(AsyncWebServer &server, IPAddress portalIP) {
+    snprintf(portalUrl, sizeof(portalUrl), "http://%u.%u.%u.%u/", portalIP[0], portalIP[1], portalIP[2], portalIP[3]);
+
+    for (const probe &p : probes) {
+        ProbeType type = p.type;
+        server.on(p.path, HTTP_ANY, [this, type](AsyncWebServerRequest *request) { onProbe(request, type); });
+    }
+
+    server.onNotFound([this](AsyncWebServerRequest *request) { onProbe(request, PROBE_OTHER); });
+}
+
+/**
+ * Redirects a connectivity check to the config page.
+ * Unknown urls are redirected relative, so they also work when the device is reached through its hostname.
+ */
+void CaptivePortal::onProbe(AsyncWebServerRequest *request, ProbeType type) {
+    requests[type]++;
+    request->redirect(type == PROBE_OTHER ? "/" : portalUrl);
+}
+
+uint32_t CaptivePortal::getRequests(ProbeType type) {
+    return type < PROBE_TYPE_COUNT ? requests[type] : 0;
+}
+
+/**
+ * Prints the request counters in the prometheus text format.
+ */
+void CaptivePortal::printMetrics(Print &out) {
+    out.print("# TYPE portal_probe_requests_total counter\n");
+    for (uint8_t i = 0; i < PROBE_TYPE_COUNT; i++) {
+        out.printf("portal_probe_requests_total{probe=\"%s\"} %lu\n", probeNames[i], (unsigned long)requests[i]);
+    }
+}
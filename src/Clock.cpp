@@ -0,0 +1,41 @@
+#include "Clock.h"
+
+/**
+ * Sets the epoch time of now.
+ *
+ * @param epoch The seconds since 1970
+ * @param epochMillis The milliseconds of the current second
+ * @param now The current time (millis)
+ */
+void Clock::sync(uint32_t epoch, uint16_t epochMillis, uint32_t now) {
+    this->epoch = epoch;
+    this->epochMillis = epochMillis;
+    reference = now;
+    synced = true;
+}
+
+void Clock::clear() {
+    synced = false;
+}
+
+bool Clock::isSynced() { return synced; }
+
+/**
+ * Converts a millis() timestamp to epoch time.
+ *
+ * @param seconds Set to the seconds since 1970
+ * @param millis Set to the milliseconds of the second
+ * @return False if the time was never synced
+ */
+bool Clock::toEpoch(uint32_t timestamp, uint32_t &seconds, uint16_t &millis) {
+    if (!synced) {
+        return false;
+    }
+
+    // The signed difference keeps timestamps on both sides of a wraparound right
+    int64_t offset = (int64_t)epochMillis + (int32_t)(timestamp - reference);
+    int64_t total = (int64_t)epoch * 1000 + offset;
+    seconds = total / 1000;
+    millis = total % 1000;
+    return true;
+}
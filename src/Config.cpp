@@ -1,70 +1,415 @@
 #include "Config.h"
 
-#include <EEPROM.h>
+#include "Crc32.h"
+#include "Logger.h"
+#include "PayloadEncoder.h"
+#include "SignalFilter.h"
+
+// The size of the emulated EEPROM, which held both config slots before they moved into storages of their own
+#define LEGACY_EEPROM_SIZE (2 * CONFIG_SLOT_SIZE)
+
+// Marks a config of version 1, which was stored without header at the start of the EEPROM
+#define LEGACY_MAGIC_NUMBER 0xC0FFEE
+
+// Layout of version 1
+typedef struct cfg_v1_struct {
+    int magicNumber;
+    char wifi_ssid[32];
+    char wifi_passwd[32];
+    char wifi_hostname[32];
+    char mqtt_ip[16];
+    unsigned short mqtt_port;
+    char mqtt_user[32];
+    char mqtt_passwd[32];
+    char mqtt_topic[255];
+    int8 temp_correct;
+    uint16 messageDelay;
+} cfg_v1;
+
+// The migrations by the version they convert from, every one converts to the next version
+const Config::cfg_migration Config::migrations[CONFIG_VERSION] = {
+    nullptr,
+    migrateV1,
+    migrateV2,
+    migrateV3,
+    migrateV4,
+    migrateV5,
+    migrateV6,
+    migrateV7,
+};
+
+// The config slots start at the beginning of their storages, in the EEPROM they were behind each other
+static const size_t SLOT_OFFSETS[2] = {0, 0};
+static const size_t LEGACY_OFFSETS[2] = {0, CONFIG_SLOT_SIZE};
+
+JournalStorage *Config::slots[2] = {nullptr, nullptr};
+JournalStorage *Config::legacy = nullptr;
+
+Config::Config() {
+    setDefaults();
+}
+
+/**
+ * Sets where the config is stored, for all instances. Has to be called before a config is loaded or saved.
+ * Every slot needs a storage of its own, so a write interrupted by a power loss can not damage the other slot.
+ *
+ * @param legacy The EEPROM of older firmware, a config found there is moved into the slots
+ */
+void Config::setStorage(JournalStorage &slotA, JournalStorage &slotB, JournalStorage &legacy) {
+    slots[0] = &slotA;
+    slots[1] = &slotB;
+    Config::legacy = &legacy;
+}
+
+/**
+ * Resets the config in RAM to the default values.
+ */
+void Config::setDefaults() {
+    memset(&config_struct, 0, sizeof(config_struct));
+    config_struct.mqtt_port = DEFAULT_MQTT_PORT;
+    config_struct.temp_correct = 0;
+    config_struct.messageDelay = DEFAULT_MESSAGE_DELAY;
+    config_struct.payload_format = PAYLOAD_JSON_STRING;
+    config_struct.temp_gain = DEFAULT_TEMP_GAIN;
+    config_struct.filter_oversample = 1;
+    config_struct.filter_median = 1;
+    config_struct.filter_smoothing = 100;
+    config_struct.report_heartbeat = DEFAULT_REPORT_HEARTBEAT;
+    config_struct.wifi_roam_rssi = DEFAULT_WIFI_ROAM_RSSI;
+}
+
+/**
+ * Overwrites a storage with zeros.
+ */
+bool Config::erase(JournalStorage &storage, size_t size) {
+    uint8 zeros[128] = {0};
+    bool success = storage.begin(size);
+
+    for (size_t offset = 0; success && offset < size; offset += sizeof(zeros)) {
+        success = storage.write(offset, zeros, min(sizeof(zeros), size - offset));
+    }
+
+    storage.end();
+    return success;
+}
 
 void Config::eraseConfigFlash() {
-    // Reset EEPROM bytes to '0' for the length of the data structure
-    EEPROM.begin(sizeof(config_struct));
-    Serial.println(sizeof(config_struct));
-    Serial.println(EEPROM.length());
-    for (size_t i = 0; i < sizeof(config_struct); i++) {
-        EEPROM.write(i, 0);
+    // Reset both slots and the EEPROM of older firmware to '0'
+    if (slots[0] == nullptr) {
+        return;
     }
-    EEPROM.end();
+    erase(*slots[0], CONFIG_SLOT_SIZE);
+    erase(*slots[1], CONFIG_SLOT_SIZE);
+    erase(*legacy, LEGACY_EEPROM_SIZE);
 }
 
-void Config::saveConfig() {
-    // Save configuration from RAM into EEPROM
-    config_struct.magicNumber = MAGIC_NUMBER;
-    EEPROM.begin(sizeof(cfg));
-    EEPROM.put(0, config_struct);
-    EEPROM.end(); // Free RAM copy of structure
-    config_struct.magicNumber = 0;
+/**
+ * Calculates the CRC of a slot over the header fields and the config following the header.
+ */
+uint32 Config::headerCRC(const cfg_header &header, const uint8 *data) {
+    uint32 crc = calculateCRC32(&header, offsetof(cfg_header, crc));
+    return calculateCRC32(data, header.length, crc);
 }
 
-void Config::loadConfig() {
-    // Loads configuration from EEPROM into RAM
-    EEPROM.begin(sizeof(config_struct));
-    EEPROM.get(0, config_struct);
-    EEPROM.end();
+/**
+ * Checks the slot at the given position of a storage. The config is read in parts for the CRC,
+ * so it never has to be in RAM as a whole.
+ *
+ * @param offset The start of the slot
+ * @param header Filled with the header of the slot
+ * @return True if the slot holds a complete config
+ */
+bool Config::readSlot(JournalStorage &storage, size_t offset, cfg_header &header) {
+    if (!storage.read(offset, &header, sizeof(header)) || header.magic != CONFIG_MAGIC || header.length > CONFIG_SLOT_SIZE - sizeof(header)) {
+        return false;
+    }
+
+    uint32 crc = calculateCRC32(&header, offsetof(cfg_header, crc));
+    uint8 part[64];
+    for (uint16 done = 0; done < header.length; done += sizeof(part)) {
+        uint16 length = min(sizeof(part), (size_t)(header.length - done));
+        if (!storage.read(offset + sizeof(header) + done, part, length)) {
+            return false;
+        }
+        crc = calculateCRC32(part, length, crc);
+    }
+    return crc == header.crc;
 }
 
-void Config::printConfig() {
-    Serial.println("\nConfig is set to:");
+/**
+ * Finds the slot with the newest valid config.
+ *
+ * @param storage The storages of both slots
+ * @param offset The positions of both slots in their storages
+ * @return The number of the slot or -1 if both are invalid
+ */
+int8 Config::findCurrentSlot(JournalStorage *const storage[2], const size_t offset[2], cfg_header &header) {
+    int8 current = -1;
+
+    for (uint8 slot = 0; slot < 2; slot++) {
+        cfg_header slotHeader;
+        if (readSlot(*storage[slot], offset[slot], slotHeader) && (current < 0 || (int32)(slotHeader.sequence - header.sequence) > 0)) {
+            current = slot;
+            header = slotHeader;
+        }
+    }
+
+    return current;
+}
+
+/**
+ * Opens the storages of both slots.
+ *
+ * @return False if no storage is set
+ */
+bool Config::openSlots() {
+    if (slots[0] == nullptr) {
+        return false;
+    }
+    // A slot which can not be opened is not readable, the other one is still used
+    slots[0]->begin(CONFIG_SLOT_SIZE);
+    slots[1]->begin(CONFIG_SLOT_SIZE);
+    return true;
+}
+
+void Config::closeSlots() {
+    slots[0]->end();
+    slots[1]->end();
+}
+
+/**
+ * Converts an old config to the current version, one version after another.
+ *
+ * @param data The config as stored in flash
+ * @param length The length of the stored config
+ * @param version The version of the stored config
+ */
+void Config::migrate(const uint8 *data, uint16 length, uint16 version) {
+    for (; version < CONFIG_VERSION; version++) {
+        if (migrations[version] != nullptr) {
+            migrations[version](data, length, config_struct);
+        }
+    }
+}
+
+/**
+ * Version 1 had a magic number instead of a header and kept it at the start of the config.
+ */
+void Config::migrateV1(const uint8 *data, uint16 length, cfg &config) {
+    cfg_v1 old;
+    memcpy(&old, data, sizeof(old));
+
+    memcpy(config.wifi_ssid, old.wifi_ssid, sizeof(config.wifi_ssid));
+    memcpy(config.wifi_passwd, old.wifi_passwd, sizeof(config.wifi_passwd));
+    memcpy(config.wifi_hostname, old.wifi_hostname, sizeof(config.wifi_hostname));
+    memcpy(config.mqtt_ip, old.mqtt_ip, sizeof(config.mqtt_ip));
+    config.mqtt_port = old.mqtt_port;
+    memcpy(config.mqtt_user, old.mqtt_user, sizeof(config.mqtt_user));
+    memcpy(config.mqtt_passwd, old.mqtt_passwd, sizeof(config.mqtt_passwd));
+    memcpy(config.mqtt_topic, old.mqtt_topic, sizeof(config.mqtt_topic));
+    config.temp_correct = old.temp_correct;
+    config.messageDelay = old.messageDelay;
+}
+
+/**
+ * Version 3 added the payload format, older versions published the original JSON format.
+ */
+void Config::migrateV2(const uint8 *data, uint16 length, cfg &config) {
+    config.payload_format = PAYLOAD_JSON_STRING;
+}
+
+/**
+ * Version 4 replaced the temperature correction in whole degrees with offset and gain and added the filter.
+ * The filter is disabled, so the readings do not change.
+ */
+void Config::migrateV3(const uint8 *data, uint16 length, cfg &config) {
+    config.temp_offset = config.temp_correct * 100;
+    config.temp_gain = DEFAULT_TEMP_GAIN;
+    config.filter_oversample = 1;
+    config.filter_median = 1;
+    config.filter_smoothing = 100;
+    config.filter_spike_temp = 0;
+    config.filter_spike_humidity = 0;
+}
+
+/**
+ * Version 5 added report by exception, it is disabled by the deadbands of 0.
+ */
+void Config::migrateV4(const uint8 *data, uint16 length, cfg &config) {
+    config.report_deadband_temp = 0;
+    config.report_deadband_humidity = 0;
+    config.report_heartbeat = DEFAULT_REPORT_HEARTBEAT;
+}
+
+/**
+ * Version 6 added the static IP, older versions always used DHCP.
+ */
+void Config::migrateV5(const uint8 *data, uint16 length, cfg &config) {
+    memset(config.static_ip, 0, sizeof(config.static_ip));
+    memset(config.static_gateway, 0, sizeof(config.static_gateway));
+    memset(config.static_subnet, 0, sizeof(config.static_subnet));
+    memset(config.static_dns, 0, sizeof(config.static_dns));
+}
+
+/**
+ * Version 7 added the topic layout and the Home Assistant discovery, older versions used the configured topic.
+ */
+void Config::migrateV6(const uint8 *data, uint16 length, cfg &config) {
+    config.topic_layout = TOPIC_LAYOUT_CUSTOM;
+    config.discovery = 0;
+}
+
+/**
+ * Version 8 added more WiFi networks and roaming. Roaming only switches between access points of the known networks,
+ * so it is enabled for the migrated config as well.
+ */
+void Config::migrateV7(const uint8 *data, uint16 length, cfg &config) {
+    memset(config.wifi_profiles, 0, sizeof(config.wifi_profiles));
+    memset(config.wifi_priority, 0, sizeof(config.wifi_priority));
+    config.wifi_roam_rssi = DEFAULT_WIFI_ROAM_RSSI;
+}
+
+bool Config::saveConfig() {
+    // Save configuration from RAM into the slot not holding the current config,
+    // so the current one stays intact if the write is interrupted
+    if (!openSlots()) {
+        return false;
+    }
 
-    Serial.print("WIFI-SSID: ");
-    Serial.println(getSSID());
+    cfg_header header;
+    int8 current = findCurrentSlot(slots, SLOT_OFFSETS, header);
+    uint8 target = current == 0 ? 1 : 0;
 
-    Serial.print("WIFI-PSK: ");
-    Serial.println(getWifiPassword());
+    header.magic = CONFIG_MAGIC;
+    header.version = CONFIG_VERSION;
+    header.length = sizeof(config_struct);
+    header.sequence = current >= 0 ? header.sequence + 1 : 1;
+    header.crc = headerCRC(header, (const uint8 *)&config_struct);
 
-    Serial.print("WIFI-HOSTNAME: ");
-    Serial.println(getHostname());
+    initialized = slots[target]->write(SLOT_OFFSETS[target], &header, sizeof(header)) &&
+                  slots[target]->write(SLOT_OFFSETS[target] + sizeof(header), &config_struct, sizeof(config_struct));
 
-    Serial.print("MQTT-BROKER-IP: ");
-    Serial.println(getMqttIP());
+    closeSlots();
+    return initialized;
+}
+
+/**
+ * Reads the config of a slot and migrates it to the current version.
+ *
+ * @return True if the config was migrated
+ */
+bool Config::loadSlot(JournalStorage &storage, size_t offset, const cfg_header &header) {
+    // Later versions only append fields, so the stored part is copied as it is
+    if (!storage.read(offset + sizeof(header), &config_struct, min((size_t)header.length, sizeof(config_struct)))) {
+        setDefaults();
+        return false;
+    }
 
-    Serial.print("MQTT-BROKER-PORT: ");
-    Serial.println(getMqttPort());
+    // Only version 1 needs the stored data, it was never kept in a slot
+    migrate((const uint8 *)&config_struct, header.length, header.version);
+    initialized = true;
+    return header.version < CONFIG_VERSION;
+}
 
-    Serial.print("MQTT-USER: ");
-    Serial.println(getMqttUsername());
+/**
+ * Loads the config of older firmware, which kept the slots or a config of version 1 in the EEPROM.
+ *
+ * @return True if a config was found
+ */
+bool Config::importLegacy() {
+    if (!legacy->begin(LEGACY_EEPROM_SIZE)) {
+        legacy->end();
+        return false;
+    }
 
-    Serial.print("MQTT-PASSWORD: ");
-    Serial.println(getMqttPassword());
+    JournalStorage *const eeprom[2] = {legacy, legacy};
+    cfg_header header;
+    int8 current = findCurrentSlot(eeprom, LEGACY_OFFSETS, header);
+
+    if (current >= 0) {
+        loadSlot(*legacy, LEGACY_OFFSETS[current], header);
+    } else {
+        cfg_v1 old;
+        if (legacy->read(0, &old, sizeof(old)) && old.magicNumber == LEGACY_MAGIC_NUMBER) {
+            migrate((const uint8 *)&old, sizeof(old), 1);
+            initialized = true;
+        }
+    }
 
-    Serial.print("MQTT-TOPIC: ");
-    Serial.println(getMqttTopic());
+    legacy->end();
+    return initialized;
+}
+
+/**
+ * Loads the newest valid config from the slots into RAM.
+ * Configs of older versions are migrated and saved in the current version.
+ * A config of older firmware in the EEPROM is moved into the slots, the EEPROM is cleared afterwards.
+ *
+ * @return True if a config was loaded, else the config holds the defaults
+ */
+bool Config::loadConfig() {
+    setDefaults();
+    initialized = false;
+    bool migrated = false;
+
+    if (!openSlots()) {
+        return false;
+    }
+
+    cfg_header header;
+    int8 current = findCurrentSlot(slots, SLOT_OFFSETS, header);
+    if (current >= 0) {
+        migrated = loadSlot(*slots[current], SLOT_OFFSETS[current], header);
+    }
 
-    Serial.print("TEMP-CORRECTION: ");
-    Serial.println(getTempCorrection());
+    closeSlots();
 
-    Serial.print("MESSAGE-DELAY: ");
-    Serial.println(getMessageDelay());
+    if (current < 0 && importLegacy()) {
+        if (saveConfig()) {
+            erase(*legacy, LEGACY_EEPROM_SIZE);
+        }
+    } else if (migrated) {
+        saveConfig();
+    }
+    return initialized;
+}
+
+void Config::printConfig() {
+    LOG_INFO("CONFIG", "Config is set to:");
+    LOG_INFO("CONFIG", "WIFI-SSID: %s", getSSID());
+    LOG_INFO("CONFIG", "WIFI-PSK: %s", redact(getWifiPassword()));
+    LOG_INFO("CONFIG", "WIFI-HOSTNAME: %s", getHostname());
+    LOG_INFO("CONFIG", "MQTT-BROKER-IP: %s", getMqttIP());
+    LOG_INFO("CONFIG", "MQTT-BROKER-PORT: %u", getMqttPort());
+    LOG_INFO("CONFIG", "MQTT-USER: %s", getMqttUsername());
+    LOG_INFO("CONFIG", "MQTT-PASSWORD: %s", redact(getMqttPassword()));
+    LOG_INFO("CONFIG", "MQTT-TOPIC: %s", getMqttTopic());
+    LOG_INFO("CONFIG", "MESSAGE-DELAY: %u", getMessageDelay());
+    LOG_INFO("CONFIG", "PAYLOAD-FORMAT: %u", getPayloadFormat());
+    LOG_INFO("CONFIG", "TEMP-OFFSET: %d", getTempOffset());
+    LOG_INFO("CONFIG", "TEMP-GAIN: %u", getTempGain());
+    LOG_INFO("CONFIG", "FILTER: oversample %u, median %u, smoothing %u, spikes %u/%u", getFilterOversample(), getFilterMedian(), getFilterSmoothing(),
+             getFilterSpikeTemp(), getFilterSpikeHumidity());
+    LOG_INFO("CONFIG", "REPORT: deadbands %u/%u, heartbeat %u", getReportDeadbandTemp(), getReportDeadbandHumidity(), getReportHeartbeat());
+    LOG_INFO("CONFIG", "STATIC-IP: %s", strlen(getStaticIP()) > 0 ? getStaticIP() : "DHCP");
+    LOG_INFO("CONFIG", "TOPIC-LAYOUT: %u, DISCOVERY: %u", getTopicLayout(), getDiscovery());
+    for (uint8 i = 1; i < WIFI_PROFILE_COUNT; i++) {
+        if (strlen(getProfileSSID(i)) > 0) {
+            LOG_INFO("CONFIG", "WIFI-SSID-%u: %s, priority %d", i + 1, getProfileSSID(i), getProfilePriority(i));
+        }
+    }
+    LOG_INFO("CONFIG", "WIFI-ROAM-RSSI: %d", getRoamRSSI());
+}
+
+/**
+ * Hides a secret in the log output, only shows if it is set.
+ */
+const char *Config::redact(const char *secret) {
+    return strlen(secret) > 0 ? "********" : "<not set>";
 }
 
 bool Config::flashInitialized() {
-    return config_struct.magicNumber == MAGIC_NUMBER;
+    return initialized;
 }
 
 bool Config::isValid() {
@@ -75,8 +420,7 @@ bool Config::isValid() {
            (config_struct.mqtt_user != NULL && strlen(config_struct.mqtt_user) > 0) &&
            (config_struct.mqtt_passwd != NULL && strlen(config_struct.mqtt_passwd) > 0) &&
            (config_struct.mqtt_topic != NULL && strlen(config_struct.mqtt_topic) > 0) &&
-           config_struct.temp_correct != NAN && config_struct.messageDelay != NAN &&
-           flashInitialized();
+           config_struct.temp_correct != NAN && config_struct.messageDelay != NAN;
 }
 
 // Getter
@@ -96,29 +440,92 @@ char *Config::getMqttPassword() { return config_struct.mqtt_passwd; }
 
 char *Config::getMqttTopic() { return config_struct.mqtt_topic; }
 
-int8 Config::getTempCorrection() { return config_struct.temp_correct; }
-
 uint16 Config::getMessageDelay() { return config_struct.messageDelay; };
 
-int Config::getMagicNumber() { return config_struct.magicNumber; }
+uint8 Config::getPayloadFormat() { return config_struct.payload_format; }
+
+int16 Config::getTempOffset() { return config_struct.temp_offset; }
+
+uint16 Config::getTempGain() { return config_struct.temp_gain; }
+
+uint8 Config::getFilterOversample() { return config_struct.filter_oversample; }
+
+uint8 Config::getFilterMedian() { return config_struct.filter_median; }
+
+uint8 Config::getFilterSmoothing() { return config_struct.filter_smoothing; }
+
+uint16 Config::getFilterSpikeTemp() { return config_struct.filter_spike_temp; }
+
+uint16 Config::getFilterSpikeHumidity() { return config_struct.filter_spike_humidity; }
+
+uint16 Config::getReportDeadbandTemp() { return config_struct.report_deadband_temp; }
+
+uint16 Config::getReportDeadbandHumidity() { return config_struct.report_deadband_humidity; }
+
+uint16 Config::getReportHeartbeat() { return config_struct.report_heartbeat; }
+
+char *Config::getStaticIP() { return config_struct.static_ip; }
+
+char *Config::getStaticGateway() { return config_struct.static_gateway; }
+
+char *Config::getStaticSubnet() { return config_struct.static_subnet; }
+
+char *Config::getStaticDNS() { return config_struct.static_dns; }
+
+uint8 Config::getTopicLayout() { return config_struct.topic_layout; }
+
+bool Config::getDiscovery() { return config_struct.discovery != 0; }
+
+/**
+ * @param index The number of the network, 0 is the network of getSSID()
+ */
+char *Config::getProfileSSID(uint8 index) {
+    if (index >= WIFI_PROFILE_COUNT) {
+        return nullptr;
+    }
+    return index == 0 ? config_struct.wifi_ssid : config_struct.wifi_profiles[index - 1].ssid;
+}
+
+char *Config::getProfilePassword(uint8 index) {
+    if (index >= WIFI_PROFILE_COUNT) {
+        return nullptr;
+    }
+    return index == 0 ? config_struct.wifi_passwd : config_struct.wifi_profiles[index - 1].passwd;
+}
+
+int8 Config::getProfilePriority(uint8 index) { return index < WIFI_PROFILE_COUNT ? config_struct.wifi_priority[index] : 0; }
+
+int8 Config::getRoamRSSI() { return config_struct.wifi_roam_rssi; }
 
 // Setter
 bool Config::setSSID(char ssid[]) {
+    if (strlen(ssid) >= sizeof(config_struct.wifi_ssid)) {
+        return false;
+    }
     strcpy(config_struct.wifi_ssid, ssid);
     return true;
 }
 
 bool Config::setWifiPassword(char passwd[]) {
+    if (strlen(passwd) >= sizeof(config_struct.wifi_passwd)) {
+        return false;
+    }
     strcpy(config_struct.wifi_passwd, passwd);
     return true;
 }
 
 bool Config::setHostname(char hostname[]) {
+    if (strlen(hostname) >= sizeof(config_struct.wifi_hostname)) {
+        return false;
+    }
     strcpy(config_struct.wifi_hostname, hostname);
     return true;
 }
 
 bool Config::setMqttIP(char ip[]) {
+    if (strlen(ip) >= sizeof(config_struct.mqtt_ip)) {
+        return false;
+    }
     strcpy(config_struct.mqtt_ip, ip);
     return true;
 }
@@ -129,31 +536,186 @@ bool Config::setMqttPort(unsigned short port) {
 }
 
 bool Config::setMqttUsername(char user[]) {
+    if (strlen(user) >= sizeof(config_struct.mqtt_user)) {
+        return false;
+    }
     strcpy(config_struct.mqtt_user, user);
     return true;
 }
 
 bool Config::setMqttPassword(char passwd[]) {
+    if (strlen(passwd) >= sizeof(config_struct.mqtt_passwd)) {
+        return false;
+    }
     strcpy(config_struct.mqtt_passwd, passwd);
     return true;
 }
 
 bool Config::setMqttTopic(char topic[]) {
+    if (strlen(topic) >= sizeof(config_struct.mqtt_topic)) {
+        return false;
+    }
     strcpy(config_struct.mqtt_topic, topic);
     return true;
 }
 
-bool Config::setTempCorrection(int8 value) {
-    config_struct.temp_correct = value;
+bool Config::setMessageDelay(uint16 delay) {
+    config_struct.messageDelay = delay;
     return true;
 }
 
-bool Config::setMessageDelay(uint16 delay) {
-    config_struct.messageDelay = delay;
+bool Config::setPayloadFormat(uint8 format) {
+    if (format >= PAYLOAD_FORMAT_COUNT) {
+        return false;
+    }
+    config_struct.payload_format = format;
+    return true;
+}
+
+bool Config::setTempOffset(int16 offset) {
+    config_struct.temp_offset = offset;
+    return true;
+}
+
+/**
+ * @param gain The factor in 1/1000, between 0.5 and 2
+ */
+bool Config::setTempGain(uint16 gain) {
+    if (gain < 500 || gain > 2000) {
+        return false;
+    }
+    config_struct.temp_gain = gain;
+    return true;
+}
+
+bool Config::setFilterOversample(uint8 oversample) {
+    if (oversample < 1 || oversample > FILTER_MAX_OVERSAMPLE) {
+        return false;
+    }
+    config_struct.filter_oversample = oversample;
+    return true;
+}
+
+/**
+ * @param median The size of the median window, has to be odd
+ */
+bool Config::setFilterMedian(uint8 median) {
+    if (median < 1 || median > FILTER_MAX_MEDIAN || median % 2 == 0) {
+        return false;
+    }
+    config_struct.filter_median = median;
+    return true;
+}
+
+bool Config::setFilterSmoothing(uint8 smoothing) {
+    if (smoothing < 1 || smoothing > 100) {
+        return false;
+    }
+    config_struct.filter_smoothing = smoothing;
+    return true;
+}
+
+bool Config::setFilterSpikeTemp(uint16 spike) {
+    config_struct.filter_spike_temp = spike;
+    return true;
+}
+
+bool Config::setFilterSpikeHumidity(uint16 spike) {
+    config_struct.filter_spike_humidity = spike;
+    return true;
+}
+
+bool Config::setReportDeadbandTemp(uint16 deadband) {
+    config_struct.report_deadband_temp = deadband;
+    return true;
+}
+
+bool Config::setReportDeadbandHumidity(uint16 deadband) {
+    config_struct.report_deadband_humidity = deadband;
+    return true;
+}
+
+bool Config::setReportHeartbeat(uint16 heartbeat) {
+    config_struct.report_heartbeat = heartbeat;
+    return true;
+}
+
+bool Config::setStaticIP(char ip[]) {
+    if (strlen(ip) >= sizeof(config_struct.static_ip)) {
+        return false;
+    }
+    strcpy(config_struct.static_ip, ip);
+    return true;
+}
+
+bool Config::setStaticGateway(char gateway[]) {
+    if (strlen(gateway) >= sizeof(config_struct.static_gateway)) {
+        return false;
+    }
+    strcpy(config_struct.static_gateway, gateway);
+    return true;
+}
+
+bool Config::setStaticSubnet(char subnet[]) {
+    if (strlen(subnet) >= sizeof(config_struct.static_subnet)) {
+        return false;
+    }
+    strcpy(config_struct.static_subnet, subnet);
+    return true;
+}
+
+bool Config::setStaticDNS(char dns[]) {
+    if (strlen(dns) >= sizeof(config_struct.static_dns)) {
+        return false;
+    }
+    strcpy(config_struct.static_dns, dns);
     return true;
 }
 
-bool Config::setMagicNumber(int value) {
-    config_struct.magicNumber = value;
+bool Config::setTopicLayout(uint8 layout) {
+    if (layout > TOPIC_LAYOUT_DEVICE) {
+        return false;
+    }
+    config_struct.topic_layout = layout;
+    return true;
+}
+
+bool Config::setDiscovery(bool discovery) {
+    config_struct.discovery = discovery ? 1 : 0;
     return true;
-}
\ No newline at end of file
+}
+
+/**
+ * Sets the SSID of a network, an empty SSID removes it. The first network can not be removed.
+ */
+bool Config::setProfileSSID(uint8 index, char ssid[]) {
+    if (index >= WIFI_PROFILE_COUNT || (index == 0 && strlen(ssid) == 0) || strlen(ssid) >= sizeof(config_struct.wifi_ssid)) {
+        return false;
+    }
+    strcpy(getProfileSSID(index), ssid);
+    return true;
+}
+
+bool Config::setProfilePassword(uint8 index, char passwd[]) {
+    if (index >= WIFI_PROFILE_COUNT || strlen(passwd) >= sizeof(config_struct.wifi_passwd)) {
+        return false;
+    }
+    strcpy(getProfilePassword(index), passwd);
+    return true;
+}
+
+bool Config::setProfilePriority(uint8 index, int8 priority) {
+    if (index >= WIFI_PROFILE_COUNT) {
+        return false;
+    }
+    config_struct.wifi_priority[index] = priority;
+    return true;
+}
+
+bool Config::setRoamRSSI(int8 rssi) {
+    if (rssi > 0) {
+        return false;
+    }
+    config_struct.wifi_roam_rssi = rssi;
+    return true;
+}
@@ -0,0 +1,23 @@
+#include "Crc32.h"
+
+/**
+ * Calculates the CRC32 (IEEE 802.3) of a block of data.
+ * Works bitwise without a lookup table to save flash and RAM.
+ *
+ * @param data The data to calculate the checksum of
+ * @param length The length of the data in bytes
+ * @param crc The result of a previous call, to continue the checksum over several blocks
+ * @return The checksum
+ */
+uint32_t calculateCRC32(const void *data, size_t length, uint32_t crc) {
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    crc = ~crc;
+    while (length--) {
+        crc ^= *bytes++;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
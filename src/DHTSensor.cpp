@@ -0,0 +1,36 @@
+#include "DHTSensor.h"
+
+#include "Logger.h"
+
+DHTSensor::DHTSensor(uint8_t pin, uint8_t type) : dht(pin, type) {}
+
+bool DHTSensor::begin() {
+    dht.begin();
+    return true;
+}
+
+bool DHTSensor::read(Sample &sample) {
+    // The library caches the reading, so the humidity does not read the sensor a second time
+    float temp = dht.readTemperature();
+    float humidity = dht.readHumidity();
+
+    if (isnan(humidity) || isnan(temp)) {
+        LOG_WARN("DHT", "Failed to read from DHT sensor!");
+        return false;
+    }
+
+    sample.temperature = (int16_t)lroundf(temp * 100);
+    sample.humidity = (uint16_t)lroundf(humidity * 100);
+    return true;
+}
+
+/**
+ * The library returns the cached reading within two seconds of the last one.
+ */
+uint32_t DHTSensor::getMinInterval() {
+    return 2000;
+}
+
+const char *DHTSensor::getName() {
+    return "dht";
+}
@@ -0,0 +1,51 @@
+#include "DS18B20Sensor.h"
+
+#include "Logger.h"
+
+DS18B20Sensor::DS18B20Sensor(DallasTemperature &bus, uint8_t index) : bus(bus), index(index) {}
+
+/**
+ * Starts the bus, it is fine to do this once for every sensor on it.
+ *
+ * @return True if the sensor was found on the bus
+ */
+bool DS18B20Sensor::begin() {
+    bus.begin();
+    bus.setWaitForConversion(false);
+
+    found = bus.getAddress(address, index);
+    if (!found) {
+        LOG_ERROR("DS18B20", "No sensor with index %u on the bus!", index);
+        return false;
+    }
+    return true;
+}
+
+uint32_t DS18B20Sensor::request() {
+    if (!found) {
+        return 0;
+    }
+    bus.requestTemperaturesByAddress(address);
+    return bus.millisToWaitForConversion(bus.getResolution(address));
+}
+
+bool DS18B20Sensor::read(Sample &sample) {
+    float temp = found ? bus.getTempC(address) : DEVICE_DISCONNECTED_C;
+
+    if (temp == DEVICE_DISCONNECTED_C) {
+        LOG_WARN("DS18B20", "Failed to read from sensor %u!", index);
+        return false;
+    }
+
+    sample.temperature = (int16_t)lroundf(temp * 100);
+    sample.humidity = SAMPLE_NO_HUMIDITY;
+    return true;
+}
+
+bool DS18B20Sensor::hasHumidity() {
+    return false;
+}
+
+const char *DS18B20Sensor::getName() {
+    return "ds18b20";
+}
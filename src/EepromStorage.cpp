@@ -0,0 +1,37 @@
+#include "EepromStorage.h"
+
+#include <EEPROM.h>
+
+/**
+ * Copies the EEPROM into RAM, it stays there until end() is called.
+ */
+bool EepromStorage::begin(size_t size) {
+    EEPROM.begin(size);
+    return EEPROM.length() == size;
+}
+
+bool EepromStorage::read(size_t offset, void *data, size_t length) {
+    if (offset + length > EEPROM.length()) {
+        return false;
+    }
+    memcpy(data, EEPROM.getConstDataPtr() + offset, length);
+    return true;
+}
+
+/**
+ * Writes and commits the data, so it is on the flash when this returns.
+ */
+bool EepromStorage::write(size_t offset, const void *data, size_t length) {
+    if (offset + length > EEPROM.length()) {
+        return false;
+    }
+    memcpy(EEPROM.getDataPtr() + offset, data, length);
+    return EEPROM.commit();
+}
+
+/**
+ * Frees the RAM copy of the EEPROM.
+ */
+void EepromStorage::end() {
+    EEPROM.end();
+}
@@ -0,0 +1,42 @@
+#include "EspWiFiScanner.h"
+
+#include <ESP8266WiFi.h>
+
+/**
+ * Starts an asynchronous scan including hidden networks, the station stays connected meanwhile.
+ */
+bool EspWiFiScanner::start() {
+    return WiFi.scanNetworks(true, true) == WIFI_SCAN_RUNNING;
+}
+
+int16_t EspWiFiScanner::getResultCount() {
+    int8_t count = WiFi.scanComplete();
+    if (count == WIFI_SCAN_RUNNING) {
+        return WIFI_SCANNER_RUNNING;
+    }
+    return count >= 0 ? count : WIFI_SCANNER_FAILED;
+}
+
+bool EspWiFiScanner::getResult(uint8_t index, WiFiNetwork &network) {
+    String ssid;
+    uint8_t encryption;
+    int32_t rssi;
+    uint8_t *bssid;
+    int32_t channel;
+    bool hidden;
+
+    if (!WiFi.getNetworkInfo(index, ssid, encryption, rssi, bssid, channel, hidden)) {
+        return false;
+    }
+
+    strncpy(network.ssid, ssid.c_str(), sizeof(network.ssid) - 1);
+    network.ssid[sizeof(network.ssid) - 1] = '\0';
+    memcpy(network.bssid, bssid, sizeof(network.bssid));
+    network.channel = channel;
+    network.rssi = rssi;
+    return true;
+}
+
+void EspWiFiScanner::clear() {
+    WiFi.scanDelete();
+}
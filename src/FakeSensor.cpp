@@ -0,0 +1,88 @@
+#include "FakeSensor.h"
+
+/**
+ * @param name The name reported by getName(), has to live as long as the sensor
+ * @param temperature The temperature in 1/100 degrees
+ * @param humidity The humidity in 1/100 percent, SAMPLE_NO_HUMIDITY for a sensor without humidity
+ */
+FakeSensor::FakeSensor(const char *name, int16_t temperature, uint16_t humidity) : name(name), temperature(temperature), humidity(humidity) {}
+
+/**
+ * Sets the values of the next readings, the ramp starts over.
+ */
+void FakeSensor::set(int16_t temperature, uint16_t humidity) {
+    this->temperature = temperature;
+    this->humidity = humidity;
+    position = 0;
+    rising = true;
+}
+
+/**
+ * @param step The change of the temperature per read in 1/100 degrees, 0 disables the ramp
+ * @param span The height of the ramp in 1/100 degrees
+ */
+void FakeSensor::setRamp(int16_t step, uint16_t span) {
+    this->step = step < 0 ? -step : step;
+    this->span = span;
+    position = 0;
+    rising = true;
+}
+
+/**
+ * Lets the reads fail like a disconnected sensor.
+ */
+void FakeSensor::setFailing(bool failing) {
+    this->failing = failing;
+}
+
+/**
+ * @param conversionTime The milliseconds returned by request(), like a sensor converting in the background
+ */
+void FakeSensor::setConversionTime(uint32_t conversionTime) {
+    this->conversionTime = conversionTime;
+}
+
+bool FakeSensor::begin() {
+    return true;
+}
+
+uint32_t FakeSensor::request() {
+    return conversionTime;
+}
+
+bool FakeSensor::read(Sample &sample) {
+    reads++;
+    if (failing) {
+        return false;
+    }
+
+    sample.temperature = (int16_t)(temperature + position);
+    sample.humidity = humidity;
+
+    if (step > 0 && span > 0) {
+        position += rising ? step : -step;
+        if (position >= span) {
+            position = span;
+            rising = false;
+        } else if (position <= 0) {
+            position = 0;
+            rising = true;
+        }
+    }
+    return true;
+}
+
+bool FakeSensor::hasHumidity() {
+    return humidity != SAMPLE_NO_HUMIDITY;
+}
+
+const char *FakeSensor::getName() {
+    return name;
+}
+
+/**
+ * @return The number of reads, failed ones included
+ */
+uint32_t FakeSensor::getReads() {
+    return reads;
+}
@@ -0,0 +1,44 @@
+#include "Histogram.h"
+
+// Upper bounds of the buckets in milliseconds
+const uint32_t Histogram::bounds[HISTOGRAM_BUCKETS] = {50, 100, 250, 500, 1000, 2500, 5000, 10000};
+
+/**
+ * Counts a duration in the first bucket it fits into.
+ *
+ * @param duration The duration in milliseconds
+ */
+void Histogram::observe(uint32_t duration) {
+    uint8_t bucket = 0;
+    while (bucket < HISTOGRAM_BUCKETS && duration > bounds[bucket]) {
+        bucket++;
+    }
+
+    counts[bucket]++;
+    count++;
+    sum += duration;
+}
+
+uint32_t Histogram::getCount() {
+    return count;
+}
+
+/**
+ * Prints the buckets, the sum and the count. The TYPE line has to be printed once before all histograms of a name.
+ *
+ * @param name The name of the metric without the suffixes
+ * @param labels The labels of the histogram, like phase="dhcp", without braces. Empty for none.
+ */
+void Histogram::print(Print &out, const char *name, const char *labels) {
+    const char *separator = labels[0] != '\0' ? "," : "";
+    uint32_t cumulative = 0;
+
+    for (uint8_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        cumulative += counts[i];
+        out.printf("%s_bucket{%s%sle=\"%lu.%03lu\"} %lu\n", name, labels, separator, (unsigned long)(bounds[i] / 1000),
+                   (unsigned long)(bounds[i] % 1000), (unsigned long)cumulative);
+    }
+    out.printf("%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, separator, (unsigned long)count);
+    out.printf("%s_sum{%s} %lu.%03lu\n", name, labels, (unsigned long)(sum / 1000), (unsigned long)(sum % 1000));
+    out.printf("%s_count{%s} %lu\n", name, labels, (unsigned long)count);
+}
@@ -0,0 +1,171 @@
+#include "Journal.h"
+
+#include "Crc32.h"
+
+// Two markers at the start of the storage, followed by the record slots
+#define MARKER_SIZE sizeof(marker)
+#define RECORDS_OFFSET (2 * MARKER_SIZE)
+
+Journal::Journal(JournalStorage &storage) : storage(storage) {}
+
+uint32_t Journal::recordCRC(const record &rec) {
+    return calculateCRC32(&rec, sizeof(rec) - sizeof(rec.crc));
+}
+
+uint32_t Journal::markerCRC(const marker &mark) {
+    return calculateCRC32(&mark, sizeof(mark) - sizeof(mark.crc));
+}
+
+/**
+ * Reads a record from a slot.
+ *
+ * @return True if the slot holds a complete record
+ */
+bool Journal::readRecord(uint32_t slot, record &rec) {
+    if (!storage.read(RECORDS_OFFSET + slot * sizeof(record), &rec, sizeof(rec))) {
+        return false;
+    }
+    return rec.sequence != 0 && rec.crc == recordCRC(rec);
+}
+
+/**
+ * Opens the storage and recovers the state of the journal.
+ * Records and markers with a wrong CRC, left behind by a power loss during a write, are ignored.
+ *
+ * @return True if the journal can be used
+ */
+bool Journal::begin() {
+    ready = storage.begin(RECORDS_OFFSET + JOURNAL_SLOTS * sizeof(record));
+    if (!ready) {
+        return false;
+    }
+
+    head = 0;
+    for (uint32_t slot = 0; slot < JOURNAL_SLOTS; slot++) {
+        record rec;
+        if (readRecord(slot, rec) && (int32_t)(rec.sequence - head) > 0) {
+            head = rec.sequence;
+        }
+    }
+
+    sent = 0;
+    for (uint8_t i = 0; i < 2; i++) {
+        marker mark;
+        if (storage.read(i * MARKER_SIZE, &mark, sizeof(mark)) && mark.crc == markerCRC(mark) && (int32_t)(mark.sequence - sent) > 0) {
+            sent = mark.sequence;
+        }
+    }
+
+    // A marker ahead of the records can only be left from an old journal
+    if ((int32_t)(sent - head) > 0) {
+        sent = head;
+    }
+
+    return true;
+}
+
+/**
+ * Appends a sample to the journal.
+ *
+ * @return The sequence of the new record, to be stored in the sample. 0 if the sample was not written
+ */
+uint32_t Journal::append(const Sample &sample) {
+    if (!ready) {
+        return 0;
+    }
+
+    record rec;
+    rec.sequence = head + 1 != 0 ? head + 1 : 1;
+    rec.sample = sample;
+    rec.sample.journal = rec.sequence;
+    rec.crc = recordCRC(rec);
+
+    if (!storage.write(RECORDS_OFFSET + (rec.sequence % JOURNAL_SLOTS) * sizeof(record), &rec, sizeof(rec))) {
+        return 0;
+    }
+
+    head = rec.sequence;
+    return rec.sequence;
+}
+
+/**
+ * Marks all records up to and including a sequence as published.
+ * The markers are written alternately, so one of them is always intact.
+ */
+void Journal::markSent(uint32_t sequence) {
+    if (!ready || (int32_t)(sequence - sent) <= 0 || (int32_t)(sequence - head) > 0) {
+        return;
+    }
+
+    marker mark = {};
+    mark.sequence = sequence;
+    mark.crc = markerCRC(mark);
+
+    if (storage.write((sequence % 2) * MARKER_SIZE, &mark, sizeof(mark))) {
+        sent = sequence;
+    }
+}
+
+/**
+ * Puts the records and markers which the storage still buffers onto the flash.
+ * Has to be called before a restart or deep sleep, the storage only syncs every few writes by itself.
+ */
+void Journal::sync() {
+    if (ready) {
+        storage.sync();
+    }
+}
+
+/**
+ * Pushes all records which were not published into a buffer, oldest first.
+ * The timestamps of the records are relative to the boot they were taken in.
+ * They are moved, so the newest record looks like it was taken just now and the spacing is kept.
+ * Records stored with their epoch time keep it and are published with it, only the others are left with the moved time.
+ *
+ * @param buffer The buffer to fill
+ * @param now The current time in milliseconds
+ * @return The number of replayed samples
+ */
+uint16_t Journal::replay(SampleBuffer &buffer, uint32_t now) {
+    uint32_t pending = getPending();
+    if (pending == 0) {
+        return 0;
+    }
+
+    record newest;
+    if (!readRecord(head % JOURNAL_SLOTS, newest)) {
+        return 0;
+    }
+
+    uint16_t count = 0;
+    for (uint32_t sequence = head - pending + 1; sequence != head + 1; sequence++) {
+        record rec;
+        if (!readRecord(sequence % JOURNAL_SLOTS, rec) || rec.sequence != sequence) {
+            continue;
+        }
+
+        // Records of an older boot can have a later timestamp, they are moved to now as well
+        int32_t age = (int32_t)(newest.sample.timestamp - rec.sample.timestamp);
+        rec.sample.timestamp = now - (age > 0 ? age : 0);
+        rec.sample.journal = rec.sequence;
+        buffer.push(rec.sample);
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * @return The sequence of the newest record
+ */
+uint32_t Journal::getHead() {
+    return head;
+}
+
+/**
+ * @return The number of records which are not published yet
+ */
+uint32_t Journal::getPending() {
+    uint32_t pending = head - sent;
+    return pending < JOURNAL_SLOTS ? pending : JOURNAL_SLOTS;
+}
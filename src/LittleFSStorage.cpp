@@ -0,0 +1,80 @@
+#include "LittleFSStorage.h"
+
+#include <LittleFS.h>
+
+LittleFSStorage::LittleFSStorage(const char *path) : path(path) {}
+
+/**
+ * Opens the file, creates it zero filled if it does not exist or has the wrong size.
+ * LittleFS has to be mounted before.
+ *
+ * @param size The size of the storage in bytes
+ * @return True if the storage can be used
+ */
+bool LittleFSStorage::begin(size_t size) {
+    if (LittleFS.exists(path)) {
+        file = LittleFS.open(path, "r+");
+        if (file && file.size() == size) {
+            return true;
+        }
+        file.close();
+    }
+
+    file = LittleFS.open(path, "w+");
+    if (!file) {
+        return false;
+    }
+
+    uint8_t zeros[64] = {0};
+    for (size_t written = 0; written < size; written += sizeof(zeros)) {
+        size_t length = size - written < sizeof(zeros) ? size - written : sizeof(zeros);
+        if (file.write(zeros, length) != length) {
+            file.close();
+            return false;
+        }
+    }
+    file.flush();
+    unsynced = 0;
+
+    return true;
+}
+
+bool LittleFSStorage::read(size_t offset, void *data, size_t length) {
+    if (!file || !file.seek(offset, SeekSet)) {
+        return false;
+    }
+    return file.read((uint8_t *)data, length) == length;
+}
+
+/**
+ * Writes the data into the file buffer, every LITTLEFS_SYNC_WRITES writes it is synced to the flash.
+ */
+bool LittleFSStorage::write(size_t offset, const void *data, size_t length) {
+    if (!file || !file.seek(offset, SeekSet)) {
+        return false;
+    }
+
+    bool success = file.write((const uint8_t *)data, length) == length;
+    if (++unsynced >= LITTLEFS_SYNC_WRITES) {
+        sync();
+    }
+    return success;
+}
+
+/**
+ * Syncs the buffered writes, so they are on the flash when this returns.
+ */
+void LittleFSStorage::sync() {
+    if (file && unsynced > 0) {
+        file.flush();
+    }
+    unsynced = 0;
+}
+
+/**
+ * Syncs and closes the file, begin() opens it again.
+ */
+void LittleFSStorage::end() {
+    file.close();
+    unsynced = 0;
+}
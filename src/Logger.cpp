@@ -0,0 +1,126 @@
+#include "Logger.h"
+
+#include <stdarg.h>
+
+Logger logger;
+
+/**
+ * Formats a line and appends it to the buffer, like "12345 I [MQTT] Connected to MQTT broker".
+ * Use the LOG_* macros instead, they remove disabled levels at compile time.
+ *
+ * @param level The level of the line, see LOG_LEVEL_*
+ * @param tag The subsystem writing the line, in flash
+ * @param format The printf format of the message, in flash
+ */
+void Logger::write(uint8_t level, PGM_P tag, PGM_P format, ...) {
+    static const char levels[] = {'-', 'E', 'W', 'I', 'D'};
+
+    char tagBuffer[16];
+    strncpy_P(tagBuffer, tag, sizeof(tagBuffer) - 1);
+    tagBuffer[sizeof(tagBuffer) - 1] = '\0';
+
+    char line[LOG_LINE_SIZE];
+    int prefix = snprintf(line, sizeof(line), "%lu %c ", millis(), levels[level <= LOG_LEVEL_DEBUG ? level : 0]);
+    int length = prefix + snprintf(line + prefix, sizeof(line) - prefix, "[%s] ", tagBuffer);
+
+    va_list args;
+    va_start(args, format);
+    length += vsnprintf_P(line + length, sizeof(line) - length, format, args);
+    va_end(args);
+
+    // Cut lines which are too long, keeping space for the line break
+    if (length > (int)sizeof(line) - 2) {
+        length = sizeof(line) - 2;
+    }
+
+    if (sink != nullptr && level <= sinkLevel && !inSink) {
+        inSink = true;
+        sink->write(level, line + prefix, length - prefix);
+        inSink = false;
+    }
+
+    line[length++] = '\n';
+    push(line, length);
+}
+
+/**
+ * Appends a line to the ring buffer, or drops it if there is not enough space.
+ */
+void Logger::push(const char *line, uint16_t length) {
+    if (length > LOG_BUFFER_SIZE - count) {
+        dropped++;
+        return;
+    }
+
+    for (uint16_t i = 0; i < length; i++) {
+        buffer[head] = line[i];
+        head = (head + 1) % LOG_BUFFER_SIZE;
+    }
+    count += length;
+}
+
+/**
+ * Hands every line up to a level to a sink, besides the serial port.
+ *
+ * @param sink The sink, nullptr to remove it
+ * @param level The highest level handed to the sink
+ */
+void Logger::setSink(LogSink *sink, uint8_t level) {
+    this->sink = sink;
+    sinkLevel = level;
+}
+
+/**
+ * Writes as much of the buffer as the serial port takes without blocking. Call it from the loop.
+ */
+void Logger::drain(Print &out) {
+    if (dropped != reportedDropped && count == 0) {
+        char line[48];
+        int length = snprintf(line, sizeof(line), "%lu W [LOG] Dropped %lu lines\n", millis(), (unsigned long)(dropped - reportedDropped));
+        reportedDropped = dropped;
+        push(line, length);
+    }
+
+    while (count > 0) {
+        int space = out.availableForWrite();
+        if (space <= 0) {
+            return;
+        }
+
+        uint16_t tail = (head + LOG_BUFFER_SIZE - count) % LOG_BUFFER_SIZE;
+        uint16_t chunk = count;
+        if (chunk > LOG_BUFFER_SIZE - tail) {
+            chunk = LOG_BUFFER_SIZE - tail;
+        }
+        if (chunk > space) {
+            chunk = space;
+        }
+
+        out.write((const uint8_t *)buffer + tail, chunk);
+        count -= chunk;
+    }
+}
+
+/**
+ * Writes the whole buffer and waits until it is sent. Used before a restart or deep sleep.
+ */
+void Logger::flush(Print &out) {
+    while (count > 0) {
+        uint16_t tail = (head + LOG_BUFFER_SIZE - count) % LOG_BUFFER_SIZE;
+        uint16_t chunk = count;
+        if (chunk > LOG_BUFFER_SIZE - tail) {
+            chunk = LOG_BUFFER_SIZE - tail;
+        }
+
+        out.write((const uint8_t *)buffer + tail, chunk);
+        count -= chunk;
+    }
+    out.flush();
+}
+
+/**
+ * @return The number of lines dropped because the buffer was full
+ */
+uint32_t Logger::getDropped() {
+    return dropped;
+}
@@ -0,0 +1,150 @@
+#include "Metrics.h"
+
+#include <ESP8266WiFi.h>
+
+/**
+ * Records the time of one loop iteration, without the time the loop slept.
+ *
+ * @param duration The time in microseconds
+ */
+void Metrics::recordLoop(uint32_t duration) {
+    loopCount++;
+    loopSum += duration;
+    if (duration > loopMax) {
+        loopMax = duration;
+    }
+
+    windowCount++;
+    windowSum += duration;
+    if (duration < windowMin) {
+        windowMin = duration;
+    }
+    if (duration > windowMax) {
+        windowMax = duration;
+    }
+}
+
+/**
+ * Keeps track of the lowest free heap, should be called regularly.
+ */
+void Metrics::sampleHeap() {
+    uint32_t freeHeap = ESP.getFreeHeap();
+    if (freeHeap < minFreeHeap) {
+        minFreeHeap = freeHeap;
+    }
+}
+
+/**
+ * Records the time from the start of a join until the access point accepted the station.
+ */
+void Metrics::observeWiFiAssociate(bool fast, uint32_t duration) {
+    wifiAssociateTime[fast].observe(duration);
+}
+
+/**
+ * Records a finished join.
+ *
+ * @param dhcp The time from the association until the station had an IP, 0 if unknown
+ * @param total The time from the start of the join until the station had an IP
+ */
+void Metrics::observeWiFiConnect(bool fast, uint32_t dhcp, uint32_t total) {
+    wifiConnects++;
+    if (dhcp > 0) {
+        wifiDhcpTime[fast].observe(dhcp);
+    }
+    wifiConnectTime[fast].observe(total);
+}
+
+/**
+ * Records a connection to the broker and the time it took.
+ */
+void Metrics::observeMqttConnect(uint32_t duration) {
+    mqttConnects++;
+    mqttConnectTime.observe(duration);
+}
+
+void Metrics::countWiFiRoam() {
+    wifiRoams++;
+}
+
+void Metrics::countMqttDisconnect() {
+    mqttDisconnects++;
+}
+
+/**
+ * Writes the compact health message and restarts the loop time window.
+ * The loop time is given as minimum, average and maximum of the window in microseconds.
+ *
+ * @param sensorFailures The number of failed sensor readings
+ * @param backlog The number of samples waiting in the backlog
+ * @return The length of the message without the null terminator, 0 if the buffer is too small
+ */
+size_t Metrics::writeHealth(char *buffer, size_t size, uint32_t sensorFailures, uint16_t backlog) {
+    sampleHeap();
+
+    uint32_t average = windowCount > 0 ? windowSum / windowCount : 0;
+    int length = snprintf(buffer, size,
+                          "{\"uptime\":%lu,\"heap\":%lu,\"heap_min\":%lu,\"block\":%lu,\"frag\":%u,"
+                          "\"loop_us\":[%lu,%lu,%lu],\"wifi_connects\":%lu,\"mqtt_connects\":%lu,\"rssi\":%d,\"sensor_failures\":%lu,\"backlog\":%u}",
+                          millis() / 1000, (unsigned long)ESP.getFreeHeap(), (unsigned long)minFreeHeap, (unsigned long)ESP.getMaxFreeBlockSize(),
+                          ESP.getHeapFragmentation(), (unsigned long)(windowCount > 0 ? windowMin : 0), (unsigned long)average,
+                          (unsigned long)windowMax, (unsigned long)wifiConnects, (unsigned long)mqttConnects, (int)WiFi.RSSI(),
+                          (unsigned long)sensorFailures, backlog);
+
+    windowCount = 0;
+    windowSum = 0;
+    windowMin = UINT32_MAX;
+    windowMax = 0;
+
+    return length > 0 && (size_t)length < size ? length : 0;
+}
+
+/**
+ * Prints all the counters in the prometheus text format.
+ */
+void Metrics::printMetrics(Print &out) {
+    sampleHeap();
+
+    out.print("# TYPE uptime_seconds gauge\n");
+    out.printf("uptime_seconds %lu\n", millis() / 1000);
+
+    out.print("# TYPE heap_free_bytes gauge\n");
+    out.printf("heap_free_bytes %lu\n", (unsigned long)ESP.getFreeHeap());
+    out.print("# TYPE heap_free_min_bytes gauge\n");
+    out.printf("heap_free_min_bytes %lu\n", (unsigned long)minFreeHeap);
+    out.print("# TYPE heap_max_block_bytes gauge\n");
+    out.printf("heap_max_block_bytes %lu\n", (unsigned long)ESP.getMaxFreeBlockSize());
+    out.print("# TYPE heap_fragmentation_percent gauge\n");
+    out.printf("heap_fragmentation_percent %u\n", ESP.getHeapFragmentation());
+
+    out.print("# TYPE loop_iterations_total counter\n");
+    out.printf("loop_iterations_total %lu\n", (unsigned long)loopCount);
+    out.print("# TYPE loop_duration_seconds_total counter\n");
+    out.printf("loop_duration_seconds_total %lu.%06lu\n", (unsigned long)(loopSum / 1000000), (unsigned long)(loopSum % 1000000));
+    out.print("# TYPE loop_duration_max_seconds gauge\n");
+    out.printf("loop_duration_max_seconds %lu.%06lu\n", (unsigned long)(loopMax / 1000000), (unsigned long)(loopMax % 1000000));
+
+    out.print("# TYPE wifi_rssi_dbm gauge\n");
+    out.printf("wifi_rssi_dbm %d\n", (int)WiFi.RSSI());
+    out.print("# TYPE wifi_connects_total counter\n");
+    out.printf("wifi_connects_total %lu\n", (unsigned long)wifiConnects);
+    out.print("# TYPE wifi_roams_total counter\n");
+    out.printf("wifi_roams_total %lu\n", (unsigned long)wifiRoams);
+
+    // The SDK reports no event between scan and authentication, so both are part of the association
+    const char *labels[2][3] = {{"phase=\"associate\",join=\"full\"", "phase=\"dhcp\",join=\"full\"", "phase=\"total\",join=\"full\""},
+                                {"phase=\"associate\",join=\"fast\"", "phase=\"dhcp\",join=\"fast\"", "phase=\"total\",join=\"fast\""}};
+    out.print("# TYPE wifi_join_duration_seconds histogram\n");
+    for (uint8_t fast = 0; fast < 2; fast++) {
+        wifiAssociateTime[fast].print(out, "wifi_join_duration_seconds", labels[fast][0]);
+        wifiDhcpTime[fast].print(out, "wifi_join_duration_seconds", labels[fast][1]);
+        wifiConnectTime[fast].print(out, "wifi_join_duration_seconds", labels[fast][2]);
+    }
+
+    out.print("# TYPE mqtt_connects_total counter\n");
+    out.printf("mqtt_connects_total %lu\n", (unsigned long)mqttConnects);
+    out.print("# TYPE mqtt_disconnects_total counter\n");
+    out.printf("mqtt_disconnects_total %lu\n", (unsigned long)mqttDisconnects);
+    out.print("# TYPE mqtt_connect_duration_seconds histogram\n");
+    mqttConnectTime.print(out, "mqtt_connect_duration_seconds", "");
+}
@@ -0,0 +1,13 @@
+#include "MqttLogSink.h"
+
+/**
+ * @param client The mqtt client, publishing does not block
+ * @param topic The topic of the log lines, has to stay valid
+ */
+MqttLogSink::MqttLogSink(AsyncMqttClient &client, const char *topic) : client(client), topic(topic) {}
+
+void MqttLogSink::write(uint8_t level, const char *line, size_t length) {
+    if (client.connected()) {
+        client.publish(topic, 0, false, line, length);
+    }
+}
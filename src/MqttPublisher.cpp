@@ -0,0 +1,232 @@
+#include "MqttPublisher.h"
+
+MqttPublisher::MqttPublisher(AsyncMqttClient &client, PayloadEncoder &encoder) : client(client), encoder(encoder) {
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+        samples[i].packetId = 0;
+    }
+    batch.packetId = 0;
+}
+
+/**
+ * Registers for the PUBACKs of the client.
+ */
+void MqttPublisher::begin() {
+    client.onPublish([this](uint16_t packetId) { onAck(packetId); });
+}
+
+/**
+ * Marks a message as acknowledged. Called from the network stack, so it only sets a flag and records the latency.
+ */
+void MqttPublisher::onAck(uint16_t packetId) {
+    inflight *message = batch.packetId == packetId ? &batch : nullptr;
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW && message == nullptr; i++) {
+        if (samples[i].packetId == packetId) {
+            message = &samples[i];
+        }
+    }
+
+    if (message != nullptr && !message->acked) {
+        message->acked = true;
+        ackTime.observe(millis() - message->sentAt);
+    }
+}
+
+/**
+ * Publishes a sample retained to a topic.
+ *
+ * @param topic The topic, has to live until the PUBACK arrived
+ * @return False if the window is full or the connection can not take the packet right now
+ */
+bool MqttPublisher::publish(const char *topic, const Sample &sample, uint32_t now) {
+    inflight *slot = nullptr;
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW && slot == nullptr; i++) {
+        if (samples[i].packetId == 0) {
+            slot = &samples[i];
+        }
+    }
+    if (slot == nullptr) {
+        return false;
+    }
+
+    uint8_t payload[MQTT_SAMPLE_SIZE];
+    size_t length = encoder.encode(sample, payload, sizeof(payload));
+    uint16_t packetId = client.publish(topic, 1, true, (const char *)payload, length);
+    if (packetId == 0) {
+        return false;
+    }
+
+    slot->packetId = packetId;
+    slot->topic = topic;
+    slot->sample = sample;
+    slot->sentAt = now;
+    slot->timeout.set(now, MQTT_ACK_TIMEOUT);
+    slot->retries = 0;
+    slot->acked = false;
+    return true;
+}
+
+/**
+ * Publishes the oldest samples of the backlog as one batch, if no batch is in flight.
+ * The samples stay in the backlog until the PUBACK arrived.
+ *
+ * @param topic The topic, has to live until the PUBACK arrived
+ * @return True if a batch was sent
+ */
+bool MqttPublisher::publishBatch(const char *topic, SampleBuffer &backlog, uint32_t now) {
+    if (batch.packetId != 0 || backlog.isEmpty()) {
+        return false;
+    }
+
+    uint16_t count;
+    size_t length = encoder.encodeBatch(backlog, now, batchPayload, sizeof(batchPayload), count);
+    if (length == 0) {
+        return false;
+    }
+
+    uint16_t packetId = client.publish(topic, 1, false, (const char *)batchPayload, length);
+    if (packetId == 0) {
+        return false;
+    }
+
+    batch.packetId = packetId;
+    batch.topic = topic;
+    batch.sentAt = now;
+    batch.timeout.set(now, MQTT_ACK_TIMEOUT);
+    batch.retries = 0;
+    batch.acked = false;
+    batchLength = length;
+    batchCount = count;
+    batchDropped = backlog.getDropped();
+    return true;
+}
+
+/**
+ * Sends a message again with the dup flag and the same packet id.
+ * Closes the connection if the message was sent too often, the broker seems to be gone.
+ *
+ * @return False if the connection was closed
+ */
+bool MqttPublisher::resend(inflight &message, const uint8_t *payload, size_t length, bool retain, uint32_t now) {
+    if (message.retries >= MQTT_MAX_RETRIES) {
+        client.disconnect(true);
+        return false;
+    }
+
+    // If the connection can not take it right now, it is tried again after the next timeout
+    client.publish(message.topic, 1, retain, (const char *)payload, length, true, message.packetId);
+    message.retries++;
+    message.timeout.set(now, MQTT_ACK_TIMEOUT);
+    retransmissions++;
+    return true;
+}
+
+/**
+ * Frees the slots of acknowledged messages and sends the timed out ones again.
+ * Has to be called regularly while connected.
+ *
+ * @param backlog The backlog the batch was taken from, the acknowledged samples are removed from it
+ * @return The number of samples removed from the backlog
+ */
+uint16_t MqttPublisher::update(SampleBuffer &backlog, uint32_t now) {
+    uint16_t removed = 0;
+
+    if (batch.packetId != 0 && batch.acked) {
+        // Samples overwritten in the full backlog while the batch was in flight are already gone
+        uint32_t lost = backlog.getDropped() - batchDropped;
+        removed = batchCount > lost ? batchCount - lost : 0;
+        for (uint16_t i = 0; i < removed; i++) {
+            if (backlog.peek(i).journal != 0) {
+                journaled = backlog.peek(i).journal;
+            }
+        }
+        backlog.pop(removed);
+        batch.packetId = 0;
+    } else if (batch.packetId != 0 && batch.timeout.expired(now) && !resend(batch, batchPayload, batchLength, false, now)) {
+        return removed;
+    }
+
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+        inflight &message = samples[i];
+        if (message.packetId == 0) {
+            continue;
+        }
+
+        if (message.acked) {
+            message.packetId = 0;
+        } else if (message.timeout.expired(now)) {
+            // The encoding of a single sample only depends on the clock, it is the same payload unless the time was synced meanwhile
+            uint8_t payload[MQTT_SAMPLE_SIZE];
+            size_t length = encoder.encode(message.sample, payload, sizeof(payload));
+            if (!resend(message, payload, length, true, now)) {
+                break;
+            }
+        }
+    }
+
+    return removed;
+}
+
+/**
+ * Gives up all messages in flight, has to be called when the connection is lost.
+ * The samples of the batch are still in the backlog, the other samples are handed back.
+ *
+ * @param unacked Filled with the samples which were not acknowledged
+ * @param size The size of unacked, at least MQTT_INFLIGHT_WINDOW
+ * @return The number of samples in unacked
+ */
+uint8_t MqttPublisher::abort(Sample *unacked, uint8_t size) {
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+        if (samples[i].packetId != 0 && !samples[i].acked && count < size) {
+            unacked[count++] = samples[i].sample;
+        }
+        samples[i].packetId = 0;
+    }
+    batch.packetId = 0;
+
+    return count;
+}
+
+/**
+ * @return True if no message waits for its PUBACK
+ */
+bool MqttPublisher::isIdle() {
+    return getInflight() == 0 && batch.packetId == 0;
+}
+
+bool MqttPublisher::isBatchInFlight() {
+    return batch.packetId != 0;
+}
+
+/**
+ * @return The number of samples waiting for their PUBACK, without the batch
+ */
+uint8_t MqttPublisher::getInflight() {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+        if (samples[i].packetId != 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @return The journal sequence of the newest sample which was removed from the backlog, all older records are published too
+ */
+uint32_t MqttPublisher::getJournaled() {
+    return journaled;
+}
+
+/**
+ * Prints the state of the window in the prometheus text format.
+ */
+void MqttPublisher::printMetrics(Print &out) {
+    out.print("# TYPE mqtt_inflight_messages gauge\n");
+    out.printf("mqtt_inflight_messages %u\n", getInflight() + (batch.packetId != 0 ? 1 : 0));
+    out.print("# TYPE mqtt_retransmissions_total counter\n");
+    out.printf("mqtt_retransmissions_total %lu\n", (unsigned long)retransmissions);
+    out.print("# TYPE mqtt_publish_ack_duration_seconds histogram\n");
+    ackTime.print(out, "mqtt_publish_ack_duration_seconds", "");
+}
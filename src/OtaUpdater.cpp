@@ -0,0 +1,318 @@
+#include "OtaUpdater.h"
+
+#include <Updater.h>
+
+#include "Logger.h"
+
+OtaUpdater::OtaUpdater() {
+    md5[0] = '\0';
+
+    client.onConnect([](void *updater, AsyncClient *client) { ((OtaUpdater *)updater)->onConnect(); }, this);
+    client.onData([](void *updater, AsyncClient *client, void *data, size_t length) { ((OtaUpdater *)updater)->onData((uint8_t *)data, length); }, this);
+    client.onDisconnect([](void *updater, AsyncClient *client) { ((OtaUpdater *)updater)->onDisconnect(); }, this);
+    client.onTimeout([](void *updater, AsyncClient *client, uint32_t time) { client->close(true); }, this);
+}
+
+/**
+ * Sets the function called when an update succeeded or failed. On success the device has to be restarted.
+ */
+void OtaUpdater::onFinished(OtaCallback callback) {
+    this->callback = callback;
+}
+
+/**
+ * Prepares the update area of the flash for an image of the given size.
+ *
+ * @param size The size of the image, the free space is used if unknown (0)
+ * @param md5 The expected MD5 digest as hex string, the image is downloaded over plain http so it is required
+ * @return True if the update could be started
+ */
+bool OtaUpdater::start(size_t size, const char *md5) {
+    if (md5 == nullptr || strlen(md5) != 32) {
+        LOG_ERROR("OTA", "Update without a valid MD5 digest refused");
+        return false;
+    }
+    if (size == 0) {
+        size = (ESP.getFreeSketchSpace() - 0x1000) & 0xFFFFF000;
+    }
+
+    // Callbacks of the network stack must not yield, so the updater must not either
+    Update.runAsync(true);
+    if (!Update.begin(size, U_FLASH)) {
+        LOG_ERROR("OTA", "Could not start update of %u bytes, error %u", (unsigned)size, Update.getError());
+        return false;
+    }
+    if (!Update.setMD5(md5)) {
+        LOG_ERROR("OTA", "Invalid MD5 digest '%s'", md5);
+        Update.end(false);
+        return false;
+    }
+
+    written = 0;
+    LOG_INFO("OTA", "Update of %u bytes started", (unsigned)size);
+    return true;
+}
+
+/**
+ * Ends an update and reports the result. An incomplete image is discarded.
+ */
+void OtaUpdater::finish(bool success) {
+    if (Update.isRunning()) {
+        // Checks the digest of a complete image, an uploaded one may be smaller than the reserved space.
+        // Without success the image is incomplete and discarded.
+        success = Update.end(success) && success;
+    }
+
+    state = success ? OTA_DONE : OTA_FAILED;
+    if (success) {
+        LOG_INFO("OTA", "Update of %u bytes finished, restart to apply it", (unsigned)written);
+    } else {
+        LOG_ERROR("OTA", "Update failed after %u bytes, error %u", (unsigned)written, Update.getError());
+    }
+
+    if (callback != nullptr) {
+        callback(success);
+    }
+}
+
+/**
+ * Starts an update pushed through the webserver. The image size is unknown, so the free space is reserved.
+ *
+ * @param md5 The expected MD5 digest as hex string
+ * @return True if the update was started
+ */
+bool OtaUpdater::beginUpload(const char *md5) {
+    if (isRunning()) {
+        LOG_WARN("OTA", "Update already running");
+        return false;
+    }
+
+    uploading = true;
+    contentLength = 0;
+    if (!start(0, md5)) {
+        finish(false);
+        return false;
+    }
+    state = OTA_BODY;
+    return true;
+}
+
+/**
+ * Writes the next part of a pushed image into the flash.
+ *
+ * @return False if the update failed, the remaining parts are ignored
+ */
+bool OtaUpdater::writeUpload(uint8_t *data, size_t length) {
+    if (state != OTA_BODY) {
+        return false;
+    }
+
+    if (Update.write(data, length) != length) {
+        finish(false);
+        return false;
+    }
+    written += length;
+    return true;
+}
+
+/**
+ * Ends a pushed update after the last part, verifies the image and reports the result.
+ *
+ * @return True if the image was accepted
+ */
+bool OtaUpdater::endUpload() {
+    if (state != OTA_BODY) {
+        return false;
+    }
+
+    finish(true);
+    return state == OTA_DONE;
+}
+
+/**
+ * Splits a url like "http://host:port/path". Only plain http is supported.
+ */
+bool OtaUpdater::parseUrl(const char *url) {
+    if (strncmp(url, "http://", 7) != 0) {
+        return false;
+    }
+    url += 7;
+
+    const char *slash = strchr(url, '/');
+    const char *hostEnd = slash != nullptr ? slash : url + strlen(url);
+    const char *colon = (const char *)memchr(url, ':', hostEnd - url);
+
+    size_t hostLength = (colon != nullptr ? colon : hostEnd) - url;
+    if (hostLength == 0 || hostLength >= sizeof(host) || (slash != nullptr && strlen(slash) >= sizeof(path))) {
+        return false;
+    }
+
+    memcpy(host, url, hostLength);
+    host[hostLength] = '\0';
+    port = colon != nullptr ? atoi(colon + 1) : 80;
+    strcpy(path, slash != nullptr ? slash : "/");
+
+    return port > 0;
+}
+
+/**
+ * Downloads an image from a http server and writes it into the flash while it is received.
+ * Returns immediately, the result is reported to the callback.
+ *
+ * @param url The url of the image, only plain http
+ * @param md5 The expected MD5 digest as hex string
+ * @return True if the download was started
+ */
+bool OtaUpdater::fetch(const char *url, const char *md5) {
+    if (isRunning()) {
+        LOG_WARN("OTA", "Update already running");
+        return false;
+    }
+    if (md5 == nullptr || strlen(md5) != 32) {
+        LOG_ERROR("OTA", "Update without a valid MD5 digest refused");
+        return false;
+    }
+    if (!parseUrl(url)) {
+        LOG_ERROR("OTA", "Unsupported url '%s'", url);
+        return false;
+    }
+
+    uploading = false;
+    strcpy(this->md5, md5);
+    lineLength = 0;
+    status = 0;
+    contentLength = 0;
+    written = 0;
+
+    LOG_INFO("OTA", "Downloading firmware from %s:%u%s", host, port, path);
+    state = OTA_CONNECTING;
+    client.setRxTimeout(OTA_RX_TIMEOUT);
+    if (!client.connect(host, port)) {
+        state = OTA_FAILED;
+        LOG_ERROR("OTA", "Could not connect to %s", host);
+        return false;
+    }
+    return true;
+}
+
+void OtaUpdater::onConnect() {
+    char request[OTA_PATH_SIZE + OTA_HOST_SIZE + 64];
+    int length = snprintf(request, sizeof(request), "GET %s HTTP/1.0\r\nHost: %s\r\nConnection: close\r\n\r\n", path, host);
+
+    state = OTA_HEADER;
+    client.write(request, length);
+}
+
+void OtaUpdater::onData(uint8_t *data, size_t length) {
+    if (state == OTA_HEADER) {
+        parseHeader(data, length);
+    } else if (state == OTA_BODY) {
+        writeBody(data, length);
+    }
+}
+
+/**
+ * Reads the status and the content length from the response header, then writes the rest as body.
+ * Lines longer than the line buffer are cut, the needed ones are short.
+ */
+void OtaUpdater::parseHeader(uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        char c = data[i];
+        if (c == '\r') {
+            continue;
+        }
+        if (c != '\n') {
+            if (lineLength < sizeof(line) - 1) {
+                line[lineLength++] = c;
+            }
+            continue;
+        }
+
+        line[lineLength] = '\0';
+        if (lineLength == 0) {
+            // End of the header, the rest is the image
+            if (status != 200 || contentLength == 0) {
+                LOG_ERROR("OTA", "Server answered %u with %u bytes", status, (unsigned)contentLength);
+                finish(false);
+                client.close(true);
+                return;
+            }
+            if (!start(contentLength, md5)) {
+                finish(false);
+                client.close(true);
+                return;
+            }
+            state = OTA_BODY;
+            writeBody(data + i + 1, length - i - 1);
+            return;
+        }
+
+        if (status == 0 && strncmp(line, "HTTP/", 5) == 0) {
+            const char *code = strchr(line, ' ');
+            status = code != nullptr ? atoi(code + 1) : 0;
+        } else if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            contentLength = strtoul(line + 15, nullptr, 10);
+        }
+        lineLength = 0;
+    }
+}
+
+void OtaUpdater::writeBody(uint8_t *data, size_t length) {
+    if (length == 0) {
+        return;
+    }
+
+    if (written + length > contentLength || Update.write(data, length) != length) {
+        client.close(true);
+        return;
+    }
+
+    written += length;
+    if (written == contentLength) {
+        finish(true);
+        client.close(true);
+    }
+}
+
+/**
+ * Called when the download connection is closed. Everything before the complete image is a failure.
+ */
+void OtaUpdater::onDisconnect() {
+    if (state == OTA_CONNECTING || state == OTA_HEADER || state == OTA_BODY) {
+        finish(false);
+    }
+}
+
+/**
+ * Stops a running update, like when the uploading client went away. The partial image is discarded.
+ */
+void OtaUpdater::abort() {
+    if (!isRunning()) {
+        return;
+    }
+
+    if (uploading) {
+        finish(false);
+    } else {
+        // Reported by the disconnect callback
+        client.close(true);
+    }
+}
+
+/**
+ * @return True while an image is downloaded or received
+ */
+bool OtaUpdater::isRunning() {
+    return state == OTA_CONNECTING || state == OTA_HEADER || state == OTA_BODY;
+}
+
+bool OtaUpdater::hasFailed() {
+    return state == OTA_FAILED;
+}
+
+/**
+ * @return The number of bytes written to the flash by the current or last update
+ */
+size_t OtaUpdater::getWritten() {
+    return written;
+}
@@ -0,0 +1,292 @@
+#include "PayloadEncoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CBOR_UNSIGNED 0x00
+#define CBOR_NEGATIVE 0x20
+#define CBOR_TEXT 0x60
+#define CBOR_MAP 0xA0
+#define CBOR_ARRAY_INDEFINITE 0x9F
+#define CBOR_BREAK 0xFF
+
+/**
+ * Writes the head of a CBOR data item.
+ *
+ * @return The number of bytes written, 0 if the buffer is too small
+ */
+static size_t writeCborHead(uint8_t major, uint32_t value, uint8_t *buffer, size_t size) {
+    uint8_t extra = value < 24 ? 0 : value <= 0xFF ? 1 : value <= 0xFFFF ? 2 : 4;
+    if (size < 1u + extra) {
+        return 0;
+    }
+
+    if (extra == 0) {
+        buffer[0] = major | value;
+        return 1;
+    }
+
+    buffer[0] = major | (extra == 1 ? 24 : extra == 2 ? 25 : 26);
+    for (uint8_t i = 0; i < extra; i++) {
+        buffer[extra - i] = value >> (8 * i);
+    }
+    return 1 + extra;
+}
+
+/**
+ * Writes a signed integer as CBOR item.
+ */
+static size_t writeCborInt(long value, uint8_t *buffer, size_t size) {
+    return value >= 0 ? writeCborHead(CBOR_UNSIGNED, value, buffer, size) : writeCborHead(CBOR_NEGATIVE, -1 - value, buffer, size);
+}
+
+/**
+ * Writes a single character text string as CBOR item, used for the keys.
+ */
+static size_t writeCborKey(char key, uint8_t *buffer, size_t size) {
+    if (size < 2) {
+        return 0;
+    }
+    buffer[0] = CBOR_TEXT | 1;
+    buffer[1] = key;
+    return 2;
+}
+
+PayloadEncoder::PayloadEncoder(PayloadFormat format) : format(format) {}
+
+/**
+ * Sets the clock converting the timestamps of the samples to epoch time, nullptr to only use the uptime.
+ */
+void PayloadEncoder::setClock(Clock *clock) {
+    this->clock = clock;
+}
+
+void PayloadEncoder::setFormat(PayloadFormat format) {
+    this->format = format < PAYLOAD_FORMAT_COUNT ? format : PAYLOAD_JSON_STRING;
+}
+
+PayloadFormat PayloadEncoder::getFormat() { return format; }
+
+bool PayloadEncoder::isBinary() { return format == PAYLOAD_CBOR; }
+
+/**
+ * Gets the epoch time of a sample. The time stored with the sample wins, it might be from before a restart.
+ *
+ * @return False if the epoch time is not known
+ */
+bool PayloadEncoder::toEpoch(const Sample &sample, uint32_t &seconds, uint16_t &millis) {
+    if (sample.epoch != 0) {
+        seconds = sample.epoch;
+        millis = sample.epochMillis;
+        return true;
+    }
+    return clock != nullptr && clock->toEpoch(sample.timestamp, seconds, millis);
+}
+
+/**
+ * Writes the time field of a sample for JSON, with a leading comma.
+ *
+ * @return The length of the field
+ */
+size_t PayloadEncoder::writeTime(const Sample &sample, const char *quote, char *buffer, size_t size) {
+    uint32_t seconds;
+    uint16_t millis;
+    int length;
+
+    if (toEpoch(sample, seconds, millis)) {
+        length = snprintf(buffer, size, ",\"time\":%s%lu.%03u%s", quote, (unsigned long)seconds, millis, quote);
+    } else {
+        length = snprintf(buffer, size, ",\"uptime_ms\":%s%lu%s", quote, (unsigned long)sample.timestamp, quote);
+    }
+    return length > 0 && (size_t)length < size ? length : 0;
+}
+
+/**
+ * Writes a sample as JSON object with two decimals, null terminated.
+ *
+ * @param quoted Write the values as strings, like the original format
+ * @param batched Add the age and the sensor id for a batch
+ * @param age The age of the sample in seconds
+ * @return The length without the null terminator, 0 if the buffer is too small
+ */
+size_t PayloadEncoder::writeJson(const Sample &sample, bool quoted, bool batched, long age, uint8_t *buffer, size_t size) {
+    const char *quote = quoted ? "\"" : "";
+    long temp = sample.temperature;
+    char batchFields[32] = "";
+    char humidityField[24] = "";
+    char timeField[32];
+
+    if (batched) {
+        int length = snprintf(batchFields, sizeof(batchFields), "\"age\":%ld,", age);
+        if (sample.sensor != 0) {
+            snprintf(batchFields + length, sizeof(batchFields) - length, "\"sensor\":%u,", sample.sensor);
+        }
+    }
+    if (sample.humidity != SAMPLE_NO_HUMIDITY) {
+        snprintf(humidityField, sizeof(humidityField), ",\"humidity\":%s%u.%02u%s", quote, sample.humidity / 100, sample.humidity % 100, quote);
+    }
+
+    writeTime(sample, quote, timeField, sizeof(timeField));
+
+    int length = snprintf((char *)buffer, size, "{%s\"temperature\":%s%s%ld.%02ld%s%s%s}", batchFields, quote, temp < 0 ? "-" : "", labs(temp) / 100,
+                          labs(temp) % 100, quote, humidityField, timeField);
+
+    return length > 0 && (size_t)length < size ? length : 0;
+}
+
+/**
+ * Writes a sample as CBOR map with the values in 1/100.
+ *
+ * @param batched Add the age and the sensor id for a batch
+ * @param age The age of the sample in seconds
+ * @return The number of bytes written, 0 if the buffer is too small
+ */
+size_t PayloadEncoder::writeCbor(const Sample &sample, bool batched, long age, uint8_t *buffer, size_t size) {
+    bool withSensor = batched && sample.sensor != 0;
+    bool withHumidity = sample.humidity != SAMPLE_NO_HUMIDITY;
+    uint32_t seconds;
+    uint16_t millis;
+    bool withEpoch = toEpoch(sample, seconds, millis);
+
+    // A sample takes at most 29 bytes, so it is encoded into a scratch buffer first and copied if it fits
+    uint8_t item[32];
+    size_t length = writeCborHead(CBOR_MAP, 2 + batched + withSensor + withHumidity, item, sizeof(item));
+
+    if (batched) {
+        length += writeCborKey('a', item + length, sizeof(item) - length);
+        length += writeCborInt(age, item + length, sizeof(item) - length);
+    }
+    if (withSensor) {
+        length += writeCborKey('s', item + length, sizeof(item) - length);
+        length += writeCborInt(sample.sensor, item + length, sizeof(item) - length);
+    }
+    length += writeCborKey('t', item + length, sizeof(item) - length);
+    length += writeCborInt(sample.temperature, item + length, sizeof(item) - length);
+    if (withHumidity) {
+        length += writeCborKey('h', item + length, sizeof(item) - length);
+        length += writeCborInt(sample.humidity, item + length, sizeof(item) - length);
+    }
+    if (withEpoch) {
+        length += writeCborKey('e', item + length, sizeof(item) - length);
+        length += writeCborHead(CBOR_UNSIGNED, seconds, item + length, sizeof(item) - length);
+    } else {
+        length += writeCborKey('u', item + length, sizeof(item) - length);
+        length += writeCborHead(CBOR_UNSIGNED, sample.timestamp, item + length, sizeof(item) - length);
+    }
+
+    if (length > size) {
+        return 0;
+    }
+    memcpy(buffer, item, length);
+    return length;
+}
+
+/**
+ * Encodes a single sample in the selected format.
+ *
+ * @return The length of the payload, 0 if the buffer is too small.
+ *         JSON payloads are null terminated, the terminator is not counted.
+ */
+size_t PayloadEncoder::encode(const Sample &sample, uint8_t *buffer, size_t size) {
+    switch (format) {
+    case PAYLOAD_JSON_NUMBER:
+        return writeJson(sample, false, false, 0, buffer, size);
+    case PAYLOAD_CBOR:
+        return writeCbor(sample, false, 0, buffer, size);
+    default:
+        return writeJson(sample, true, false, 0, buffer, size);
+    }
+}
+
+/**
+ * Encodes as many of the oldest samples as fit into the buffer as one array.
+ *
+ * @param samples The samples to encode, they are not removed
+ * @param now The current time in milliseconds, used for the age of the samples
+ * @param count Set to the number of encoded samples
+ * @return The length of the payload, 0 if not a single sample fits
+ */
+size_t PayloadEncoder::encodeBatch(SampleBuffer &samples, uint32_t now, uint8_t *buffer, size_t size, uint16_t &count) {
+    bool binary = isBinary();
+    // The age of a sample with a stored epoch time is taken from it, its timestamp may be from before a restart
+    uint32_t nowEpoch;
+    uint16_t nowMillis;
+    bool synced = clock != nullptr && clock->toEpoch(now, nowEpoch, nowMillis);
+    // Space for the closing bracket or break and the null terminator of JSON
+    size_t reserved = binary ? 1 : 2;
+    size_t length = 1;
+
+    count = 0;
+    if (size < length + reserved) {
+        return 0;
+    }
+    buffer[0] = binary ? CBOR_ARRAY_INDEFINITE : '[';
+
+    while (count < samples.size()) {
+        const Sample &sample = samples.peek(count);
+        long age = synced && sample.epoch != 0 ? (long)(nowEpoch - sample.epoch) : (long)((now - sample.timestamp) / 1000);
+
+        size_t separator = !binary && count > 0 ? 1 : 0;
+        if (length + separator + reserved >= size) {
+            break;
+        }
+
+        size_t available = size - length - separator - reserved + (binary ? 0 : 1);
+        size_t written = binary ? writeCbor(sample, true, age, buffer + length, available)
+                                : writeJson(sample, false, true, age, buffer + length + separator, available);
+        if (written == 0) {
+            break;
+        }
+
+        if (separator) {
+            buffer[length] = ',';
+        }
+        length += separator + written;
+        count++;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    buffer[length++] = binary ? CBOR_BREAK : ']';
+    if (!binary) {
+        buffer[length] = '\0';
+    }
+    return length;
+}
+
+/**
+ * Encodes a sample as one line of the history export, a CSV row as in PAYLOAD_CSV_HEADER or an NDJSON object.
+ * The epoch time is left empty or out if the clock was never synced.
+ *
+ * @return The length of the null terminated line including the line break, 0 if the buffer is too small
+ */
+size_t PayloadEncoder::encodeLine(const Sample &sample, bool csv, char *buffer, size_t size) {
+    long temp = sample.temperature;
+    uint32_t seconds;
+    uint16_t millis;
+    bool withEpoch = toEpoch(sample, seconds, millis);
+    char time[20] = "";
+    char humidity[8] = "";
+    int length;
+
+    if (withEpoch) {
+        snprintf(time, sizeof(time), "%lu.%03u", (unsigned long)seconds, millis);
+    }
+    if (sample.humidity != SAMPLE_NO_HUMIDITY) {
+        snprintf(humidity, sizeof(humidity), "%u.%02u", sample.humidity / 100, sample.humidity % 100);
+    }
+
+    if (csv) {
+        length = snprintf(buffer, size, "%s,%lu,%u,%s%ld.%02ld,%s\n", time, (unsigned long)sample.timestamp, sample.sensor, temp < 0 ? "-" : "",
+                          labs(temp) / 100, labs(temp) % 100, humidity);
+    } else {
+        length = snprintf(buffer, size, "{%s%s%s\"uptime_ms\":%lu,\"sensor\":%u,\"temperature\":%s%ld.%02ld%s%s}\n", withEpoch ? "\"time\":" : "", time,
+                          withEpoch ? "," : "", (unsigned long)sample.timestamp, sample.sensor, temp < 0 ? "-" : "", labs(temp) / 100, labs(temp) % 100,
+                          humidity[0] != '\0' ? ",\"humidity\":" : "", humidity);
+    }
+
+    return length > 0 && (size_t)length < size ? length : 0;
+}
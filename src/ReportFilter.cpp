@@ -0,0 +1,61 @@
+#include "ReportFilter.h"
+
+#include "Timer.h"
+
+/**
+ * Changes the limits. A deadband of 0 reports every sample of a sensor with that channel.
+ *
+ * @param deadbandTemperature The smallest reported change of the temperature in 1/100 degrees
+ * @param deadbandHumidity The smallest reported change of the humidity in 1/100 percent
+ * @param heartbeat The longest time without a report in milliseconds, 0 to disable it
+ */
+void ReportFilter::configure(uint16_t deadbandTemperature, uint16_t deadbandHumidity, uint32_t heartbeat) {
+    this->deadbandTemperature = deadbandTemperature;
+    this->deadbandHumidity = deadbandHumidity;
+    this->heartbeat = heartbeat;
+}
+
+/**
+ * A deadband of 0 counts every sample as changed, so that channel reports every sample.
+ * The humidity is skipped for sensors without one.
+ *
+ * @return True if the sample differs enough from the last reported one
+ */
+bool ReportFilter::changed(const Sample &sample) {
+    int32_t temperature = (int32_t)sample.temperature - last.temperature;
+    if (deadbandTemperature == 0 || temperature >= deadbandTemperature || -temperature >= deadbandTemperature) {
+        return true;
+    }
+
+    if ((sample.humidity == SAMPLE_NO_HUMIDITY) != (last.humidity == SAMPLE_NO_HUMIDITY)) {
+        return true;
+    }
+    if (sample.humidity == SAMPLE_NO_HUMIDITY) {
+        return false;
+    }
+    int32_t humidity = (int32_t)sample.humidity - last.humidity;
+    return deadbandHumidity == 0 || humidity >= deadbandHumidity || -humidity >= deadbandHumidity;
+}
+
+/**
+ * Decides if a sample is reported. A reported sample becomes the reference for the next ones.
+ *
+ * @return True if the sample has to be reported
+ */
+bool ReportFilter::check(const Sample &sample) {
+    bool report = !hasLast || changed(sample) || (heartbeat > 0 && Deadline::reached(sample.timestamp, last.timestamp + heartbeat));
+
+    if (!report) {
+        suppressed++;
+        return false;
+    }
+
+    last = sample;
+    hasLast = true;
+    reported++;
+    return true;
+}
+
+uint32_t ReportFilter::getReported() { return reported; }
+
+uint32_t ReportFilter::getSuppressed() { return suppressed; }
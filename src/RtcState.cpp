@@ -0,0 +1,150 @@
+#include "RtcState.h"
+
+#include "Crc32.h"
+
+#define FLAG_NETWORK 0x01
+#define FLAG_BROKER 0x02
+#define FLAG_OTA_TRIAL 0x04
+#define FLAG_DISCOVERY 0x08
+
+// The first 128 bytes of the RTC user memory hold the command of the bootloader, Update.end() writes it there
+// to install a new firmware. The state starts behind it, the offset is given in blocks of 4 bytes.
+#define RTC_STATE_BLOCK 32
+// The size of the RTC user memory in bytes
+#define RTC_USER_MEMORY_SIZE 512
+
+/**
+ * Loads the state from RTC memory.
+ * After a power loss the memory contains garbage, then the state is reset.
+ *
+ * @return True if a valid state was loaded
+ */
+bool RtcState::load() {
+    static_assert(sizeof(state) <= RTC_USER_MEMORY_SIZE - RTC_STATE_BLOCK * 4, "RtcState does not fit into the RTC user memory");
+
+    if (ESP.rtcUserMemoryRead(RTC_STATE_BLOCK, (uint32_t *)&state, sizeof(state)) &&
+        state.crc == calculateCRC32((uint8_t *)&state + sizeof(state.crc), sizeof(state) - sizeof(state.crc))) {
+        return true;
+    }
+
+    memset(&state, 0, sizeof(state));
+    return false;
+}
+
+void RtcState::save() {
+    state.crc = calculateCRC32((uint8_t *)&state + sizeof(state.crc), sizeof(state) - sizeof(state.crc));
+    ESP.rtcUserMemoryWrite(RTC_STATE_BLOCK, (uint32_t *)&state, sizeof(state));
+}
+
+bool RtcState::hasNetwork() { return state.flags & FLAG_NETWORK; }
+
+void RtcState::setNetwork(uint8_t profile, const uint8_t *bssid, uint8_t channel, IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns) {
+    state.profile = profile;
+    memcpy(state.bssid, bssid, sizeof(state.bssid));
+    state.channel = channel;
+    state.ip = ip;
+    state.gateway = gateway;
+    state.subnet = subnet;
+    state.dns = dns;
+    state.flags |= FLAG_NETWORK;
+}
+
+void RtcState::clearNetwork() { state.flags &= ~FLAG_NETWORK; }
+
+uint8_t RtcState::getProfile() { return state.profile; }
+
+const uint8_t *RtcState::getBSSID() { return state.bssid; }
+
+uint8_t RtcState::getChannel() { return state.channel; }
+
+IPAddress RtcState::getIP() { return IPAddress(state.ip); }
+
+IPAddress RtcState::getGateway() { return IPAddress(state.gateway); }
+
+IPAddress RtcState::getSubnet() { return IPAddress(state.subnet); }
+
+IPAddress RtcState::getDNS() { return IPAddress(state.dns); }
+
+bool RtcState::hasBrokerIP() { return state.flags & FLAG_BROKER; }
+
+void RtcState::setBrokerIP(IPAddress ip) {
+    state.brokerIp = ip;
+    state.flags |= FLAG_BROKER;
+}
+
+void RtcState::clearBrokerIP() { state.flags &= ~FLAG_BROKER; }
+
+IPAddress RtcState::getBrokerIP() { return IPAddress(state.brokerIp); }
+
+/**
+ * Counts a wakeup and whether WiFi could be connected in it.
+ */
+void RtcState::countWake(bool wifiConnected) {
+    state.wakeCount++;
+    state.failedWakes = wifiConnected ? 0 : state.failedWakes + 1;
+}
+
+/**
+ * Records the time from wakeup to a successful publish.
+ */
+void RtcState::countPublish(uint32_t wakeToPublish) {
+    state.publishCount++;
+    state.lastWakeToPublish = wakeToPublish;
+    state.totalWakeToPublish += wakeToPublish;
+}
+
+uint32_t RtcState::getWakeCount() { return state.wakeCount; }
+
+uint16_t RtcState::getFailedWakes() { return state.failedWakes; }
+
+uint32_t RtcState::getPublishCount() { return state.publishCount; }
+
+uint32_t RtcState::getLastWakeToPublish() { return state.lastWakeToPublish; }
+
+uint32_t RtcState::getAverageWakeToPublish() {
+    return state.publishCount > 0 ? state.totalWakeToPublish / state.publishCount : 0;
+}
+
+/**
+ * Marks the next firmware as on trial, until it reaches the broker.
+ */
+void RtcState::startOtaTrial() {
+    state.flags |= FLAG_OTA_TRIAL;
+    state.otaBoots = 0;
+}
+
+bool RtcState::isOtaTrial() { return state.flags & FLAG_OTA_TRIAL; }
+
+/**
+ * Counts a start of the firmware on trial.
+ *
+ * @return The number of starts without reaching the broker
+ */
+uint16_t RtcState::countOtaBoot() {
+    return ++state.otaBoots;
+}
+
+void RtcState::endOtaTrial() {
+    state.flags &= ~FLAG_OTA_TRIAL;
+    state.otaBoots = 0;
+}
+
+/**
+ * @return True if the Home Assistant discovery was published since the last power on or config change
+ */
+bool RtcState::isDiscoverySent() { return state.flags & FLAG_DISCOVERY; }
+
+void RtcState::setDiscoverySent(bool sent) {
+    if (sent) {
+        state.flags |= FLAG_DISCOVERY;
+    } else {
+        state.flags &= ~FLAG_DISCOVERY;
+    }
+}
+
+/**
+ * @return The epoch time of this wakeup estimated before the deep sleep, 0 if it is unknown
+ */
+uint32_t RtcState::getWakeEpoch() { return state.wakeEpoch; }
+
+void RtcState::setWakeEpoch(uint32_t epoch) { state.wakeEpoch = epoch; }
@@ -0,0 +1,49 @@
+#include "SampleBuffer.h"
+
+/**
+ * Appends a sample. Overwrites the oldest one if the buffer is full.
+ */
+void SampleBuffer::push(const Sample &sample) {
+    if (count == SAMPLE_BUFFER_SIZE) {
+        head = (head + 1) % SAMPLE_BUFFER_SIZE;
+        count--;
+        dropped++;
+    }
+
+    samples[(head + count) % SAMPLE_BUFFER_SIZE] = sample;
+    count++;
+}
+
+/**
+ * Returns a sample without removing it.
+ *
+ * @param index The position of the sample, 0 is the oldest one. Must be smaller than size().
+ */
+const Sample &SampleBuffer::peek(uint16_t index) {
+    return samples[(head + index) % SAMPLE_BUFFER_SIZE];
+}
+
+/**
+ * Removes the n oldest samples.
+ */
+void SampleBuffer::pop(uint16_t n) {
+    if (n > count) {
+        n = count;
+    }
+
+    head = (head + n) % SAMPLE_BUFFER_SIZE;
+    count -= n;
+}
+
+void SampleBuffer::clear() {
+    head = 0;
+    count = 0;
+}
+
+uint16_t SampleBuffer::size() { return count; }
+
+bool SampleBuffer::isEmpty() { return count == 0; }
+
+bool SampleBuffer::isFull() { return count == SAMPLE_BUFFER_SIZE; }
+
+uint32_t SampleBuffer::getDropped() { return dropped; }
@@ -0,0 +1,82 @@
+#include "Scheduler.h"
+
+#include "Timer.h"
+
+/**
+ * Adds a periodic task to the scheduler.
+ *
+ * @param callback The function to run
+ * @param period The time between two runs in milliseconds
+ * @param now The current time in milliseconds
+ * @param offset Delay of the first run, used to keep tasks with the same period apart
+ * @return The id of the task or -1 if there is no space left
+ */
+int Scheduler::addTask(TaskCallback callback, uint32_t period, uint32_t now, uint32_t offset) {
+    if (taskCount >= SCHEDULER_MAX_TASKS || callback == nullptr) {
+        return -1;
+    }
+
+    tasks[taskCount].callback = callback;
+    tasks[taskCount].period = period;
+    tasks[taskCount].deadline = now + offset;
+
+    return taskCount++;
+}
+
+/**
+ * Runs all tasks which are due, the most overdue one first.
+ * Every task runs at most once per call, so a slow task can not starve the others.
+ *
+ * @param now The current time in milliseconds
+ */
+void Scheduler::run(uint32_t now) {
+    bool ran[SCHEDULER_MAX_TASKS] = {false};
+
+    while (true) {
+        int next = -1;
+        for (int i = 0; i < taskCount; i++) {
+            if (ran[i] || !Deadline::reached(now, tasks[i].deadline)) {
+                continue;
+            }
+            if (next < 0 || (int32_t)(tasks[i].deadline - tasks[next].deadline) < 0) {
+                next = i;
+            }
+        }
+
+        if (next < 0) {
+            return;
+        }
+
+        // Advance by whole periods to keep the cadence, but never try to catch up on missed runs
+        ran[next] = true;
+        tasks[next].deadline += tasks[next].period;
+        if (Deadline::reached(now, tasks[next].deadline)) {
+            tasks[next].deadline = now + tasks[next].period;
+        }
+
+        tasks[next].callback();
+    }
+}
+
+/**
+ * Calculates the time until the next task is due.
+ *
+ * @param now The current time in milliseconds
+ * @return The milliseconds to the next deadline, 0 if a task is already due
+ */
+uint32_t Scheduler::timeUntilNext(uint32_t now) {
+    uint32_t next = UINT32_MAX;
+
+    for (int i = 0; i < taskCount; i++) {
+        if (Deadline::reached(now, tasks[i].deadline)) {
+            return 0;
+        }
+
+        uint32_t remaining = tasks[i].deadline - now;
+        if (remaining < next) {
+            next = remaining;
+        }
+    }
+
+    return next;
+}
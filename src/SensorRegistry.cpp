@@ -0,0 +1,205 @@
+#include "SensorRegistry.h"
+
+/**
+ * Adds a sensor. The first reading is delayed by SENSOR_STAGGER for every sensor added before.
+ *
+ * @param sensor The driver, has to live as long as the registry
+ * @param suffix Appended to the topic of the readings, empty for the main topic
+ * @param period The time between two readings in milliseconds
+ * @param now The current time in milliseconds
+ * @return The id of the sensor, which is stored in its samples, or -1 if there is no space left
+ */
+int SensorRegistry::add(Sensor *sensor, const char *suffix, uint32_t period, uint32_t now) {
+    if (count >= SENSOR_MAX_COUNT || sensor == nullptr) {
+        return -1;
+    }
+
+    entry &e = entries[count];
+    e.sensor = sensor;
+    e.suffix = suffix != nullptr ? suffix : "";
+    e.period = period;
+    e.deadline = now + count * SENSOR_STAGGER;
+    e.conversion.clear();
+    e.ready = false;
+    e.failures = 0;
+    configure(e);
+
+    return count++;
+}
+
+/**
+ * Starts all the sensors. Sensors which fail to start stay registered, their readings fail.
+ */
+void SensorRegistry::begin() {
+    for (uint8_t i = 0; i < count; i++) {
+        entries[i].sensor->begin();
+    }
+}
+
+/**
+ * Changes the filters of all sensors. The filters start over, the samples in progress are dropped.
+ */
+void SensorRegistry::setFilters(const FilterSettings &temperature, const FilterSettings &humidity) {
+    temperatureSettings = temperature;
+    humiditySettings = humidity;
+
+    for (uint8_t i = 0; i < count; i++) {
+        configure(entries[i]);
+    }
+}
+
+/**
+ * Applies the filter settings to a sensor and spreads its readings over the period.
+ */
+void SensorRegistry::configure(entry &e) {
+    e.temperature.configure(temperatureSettings);
+    e.humidity.configure(humiditySettings);
+    updateInterval(e);
+}
+
+/**
+ * Spreads the readings of a sensor over its period, but not closer than the sensor allows.
+ */
+void SensorRegistry::updateInterval(entry &e) {
+    e.interval = e.period / e.temperature.getOversample();
+    if (e.interval < e.sensor->getMinInterval()) {
+        e.interval = e.sensor->getMinInterval();
+    }
+}
+
+/**
+ * Changes the period of a sensor. The filters keep their state, a reading due later than one new interval is moved up.
+ */
+void SensorRegistry::setPeriod(uint8_t id, uint32_t period, uint32_t now) {
+    if (id >= count || entries[id].period == period) {
+        return;
+    }
+
+    entry &e = entries[id];
+    e.period = period;
+    updateInterval(e);
+
+    if (!e.conversion.isArmed() && !Deadline::reached(now + e.interval, e.deadline)) {
+        e.deadline = now + e.interval;
+    }
+}
+
+/**
+ * Reads the result of a finished measurement and passes it through the filters.
+ */
+void SensorRegistry::collect(uint8_t id, uint32_t now) {
+    entry &e = entries[id];
+    Sample reading = {};
+
+    e.conversion.clear();
+    if (!e.sensor->read(reading)) {
+        e.failures++;
+        return;
+    }
+
+    // Both filters get every reading, so they finish their values together
+    int16_t temperature, humidity;
+    bool done = e.temperature.add(reading.temperature, temperature);
+    bool hasHumidity = reading.humidity != SAMPLE_NO_HUMIDITY && e.humidity.add(reading.humidity, humidity);
+    if (!done) {
+        return;
+    }
+
+    Sample sample = {};
+    sample.timestamp = now;
+    sample.temperature = temperature;
+    sample.humidity = hasHumidity ? (humidity < 0 ? 0 : humidity > 10000 ? 10000 : humidity) : SAMPLE_NO_HUMIDITY;
+    sample.sensor = id;
+
+    e.latest = sample;
+    e.ready = true;
+}
+
+/**
+ * Picks up one finished measurement or starts the most overdue one, whatever comes first.
+ * Has to be called often, a measurement is never started before its sensor is due.
+ *
+ * @param now The current time in milliseconds
+ * @return True if a sensor was accessed
+ */
+bool SensorRegistry::update(uint32_t now) {
+    for (uint8_t i = 0; i < count; i++) {
+        if (entries[i].conversion.expired(now)) {
+            collect(i, now);
+            return true;
+        }
+    }
+
+    int next = -1;
+    for (uint8_t i = 0; i < count; i++) {
+        if (entries[i].conversion.isArmed() || !Deadline::reached(now, entries[i].deadline)) {
+            continue;
+        }
+        if (next < 0 || (int32_t)(entries[i].deadline - entries[next].deadline) < 0) {
+            next = i;
+        }
+    }
+
+    if (next < 0) {
+        return false;
+    }
+
+    // Same as the scheduler: keep the cadence, but do not catch up on missed readings
+    entry &e = entries[next];
+    e.deadline += e.interval;
+    if (Deadline::reached(now, e.deadline)) {
+        e.deadline = now + e.interval;
+    }
+
+    uint32_t wait = e.sensor->request();
+    if (wait == 0) {
+        collect(next, now);
+    } else {
+        e.conversion.set(now, wait);
+    }
+    return true;
+}
+
+/**
+ * Makes all sensors due immediately, used to read everything once after a wakeup.
+ */
+void SensorRegistry::triggerAll(uint32_t now) {
+    for (uint8_t i = 0; i < count; i++) {
+        entries[i].deadline = now;
+    }
+}
+
+/**
+ * @return True if a sensor is due or a measurement is running
+ */
+bool SensorRegistry::isBusy(uint32_t now) {
+    for (uint8_t i = 0; i < count; i++) {
+        if (entries[i].conversion.isArmed() || Deadline::reached(now, entries[i].deadline)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Takes the latest reading of a sensor, every reading can be taken only once.
+ *
+ * @return True if there was a new reading
+ */
+bool SensorRegistry::take(uint8_t id, Sample &sample) {
+    if (id >= count || !entries[id].ready) {
+        return false;
+    }
+
+    sample = entries[id].latest;
+    entries[id].ready = false;
+    return true;
+}
+
+uint8_t SensorRegistry::size() { return count; }
+
+const char *SensorRegistry::getSuffix(uint8_t id) { return id < count ? entries[id].suffix : ""; }
+
+Sensor *SensorRegistry::getSensor(uint8_t id) { return id < count ? entries[id].sensor : nullptr; }
+
+uint32_t SensorRegistry::getFailures(uint8_t id) { return id < count ? entries[id].failures : 0; }
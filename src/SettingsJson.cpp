@@ -0,0 +1,103 @@
+#include "SettingsJson.h"
+
+#include "PayloadEncoder.h"
+
+/**
+ * Prints a text as JSON string, with the quotes, backslashes and control characters escaped.
+ * The parts without such a character are written in one piece.
+ */
+static void printString(Print &out, const char *key, const char *text, bool first = false) {
+    out.printf("%s\"%s\":\"", first ? "" : ",", key);
+
+    const char *run = text;
+    for (const char *c = text;; c++) {
+        if (*c != '\0' && *c != '"' && *c != '\\' && (uint8_t)*c >= 0x20) {
+            continue;
+        }
+        out.write((const uint8_t *)run, c - run);
+        if (*c == '\0') {
+            break;
+        }
+        if (*c == '"' || *c == '\\') {
+            out.write('\\');
+            out.write(*c);
+        } else {
+            out.printf("\\u%04x", *c);
+        }
+        run = c + 1;
+    }
+
+    out.write('"');
+}
+
+static void printNumber(Print &out, const char *key, long value, bool first = false) {
+    out.printf("%s\"%s\":%ld", first ? "" : ",", key, value);
+}
+
+/**
+ * Prints a fixed point value with the given number of decimals, like 2130 with 2 decimals as 21.30.
+ */
+static void printFixed(Print &out, const char *key, long value, int decimals) {
+    unsigned long scale = 1;
+    for (int i = 0; i < decimals; i++) {
+        scale *= 10;
+    }
+    unsigned long absolute = value < 0 ? -value : value;
+    out.printf(",\"%s\":%s%lu.%0*lu", key, value < 0 ? "-" : "", absolute / scale, decimals, absolute % scale);
+}
+
+/**
+ * Prints the config as the JSON object the settings page loads from /settings.json, the keys are the fields of the page.
+ * Without a valid config only the defaults of the page are printed.
+ * The values are written directly to the output, so the object is not built in memory.
+ */
+void printSettingsJson(Config &config, Print &out) {
+    out.write('{');
+
+    if (!config.isValid()) {
+        printNumber(out, "mqtt-port", DEFAULT_MQTT_PORT, true);
+        printNumber(out, "temp-correction", 0);
+        printNumber(out, "mqtt-delay", DEFAULT_MESSAGE_DELAY);
+        printNumber(out, "payload-format", PAYLOAD_JSON_STRING);
+        printNumber(out, "wifi-roam-rssi", DEFAULT_WIFI_ROAM_RSSI);
+        out.write('}');
+        return;
+    }
+
+    printString(out, "wifi-ssid", config.getSSID(), true);
+    printString(out, "wifi-passwd", config.getWifiPassword());
+    printString(out, "host", config.getHostname());
+    printString(out, "static-ip", config.getStaticIP());
+    printString(out, "static-gateway", config.getStaticGateway());
+    printString(out, "static-subnet", config.getStaticSubnet());
+    printString(out, "static-dns", config.getStaticDNS());
+    printString(out, "broker-ip", config.getMqttIP());
+    printNumber(out, "mqtt-port", config.getMqttPort());
+    printString(out, "mqtt-user", config.getMqttUsername());
+    printString(out, "mqtt-passwd", config.getMqttPassword());
+    printString(out, "mqtt-topic", config.getMqttTopic());
+    printFixed(out, "temp-correction", config.getTempOffset(), 2);
+    printFixed(out, "temp-gain", config.getTempGain(), 3);
+    printNumber(out, "mqtt-delay", config.getMessageDelay());
+    printNumber(out, "payload-format", config.getPayloadFormat());
+    printNumber(out, "filter-oversample", config.getFilterOversample());
+    printNumber(out, "filter-median", config.getFilterMedian());
+    printNumber(out, "filter-smoothing", config.getFilterSmoothing());
+    printFixed(out, "filter-spike-temp", config.getFilterSpikeTemp(), 2);
+    printFixed(out, "filter-spike-humidity", config.getFilterSpikeHumidity(), 2);
+    printFixed(out, "report-deadband-temp", config.getReportDeadbandTemp(), 2);
+    printFixed(out, "report-deadband-humidity", config.getReportDeadbandHumidity(), 2);
+    printNumber(out, "report-heartbeat", config.getReportHeartbeat());
+    printNumber(out, "topic-layout", config.getTopicLayout());
+    printNumber(out, "ha-discovery", config.getDiscovery() ? 1 : 0);
+    printNumber(out, "wifi-priority", config.getProfilePriority(0));
+    printString(out, "wifi-ssid-2", config.getProfileSSID(1));
+    printString(out, "wifi-passwd-2", config.getProfilePassword(1));
+    printNumber(out, "wifi-priority-2", config.getProfilePriority(1));
+    printString(out, "wifi-ssid-3", config.getProfileSSID(2));
+    printString(out, "wifi-passwd-3", config.getProfilePassword(2));
+    printNumber(out, "wifi-priority-3", config.getProfilePriority(2));
+    printNumber(out, "wifi-roam-rssi", config.getRoamRSSI());
+
+    out.write('}');
+}
@@ -0,0 +1,118 @@
+#include "SignalFilter.h"
+
+/**
+ * Divides and rounds half away from zero, the plain division truncates negative values the wrong way.
+ */
+static int32_t roundedDivide(int32_t value, int32_t divisor) {
+    return value >= 0 ? (value + divisor / 2) / divisor : (value - divisor / 2) / divisor;
+}
+
+/**
+ * Changes the settings, out of range values are clamped. Resets the state.
+ */
+void SignalFilter::configure(const FilterSettings &settings) {
+    this->settings = settings;
+
+    if (this->settings.oversample < 1) {
+        this->settings.oversample = 1;
+    } else if (this->settings.oversample > FILTER_MAX_OVERSAMPLE) {
+        this->settings.oversample = FILTER_MAX_OVERSAMPLE;
+    }
+    if (this->settings.median < 1) {
+        this->settings.median = 1;
+    } else if (this->settings.median > FILTER_MAX_MEDIAN) {
+        this->settings.median = FILTER_MAX_MEDIAN;
+    }
+    this->settings.median |= 1;
+    if (this->settings.gain > 10000) {
+        this->settings.gain = 10000;
+    }
+    if (this->settings.smoothing < 1 || this->settings.smoothing > 100) {
+        this->settings.smoothing = 100;
+    }
+
+    reset();
+}
+
+/**
+ * Forgets all the readings, the next value only depends on readings added from now on.
+ */
+void SignalFilter::reset() {
+    windowIndex = 0;
+    windowCount = 0;
+    rejects = 0;
+    sum = 0;
+    sumCount = 0;
+    averageValid = false;
+}
+
+/**
+ * @return The median of the readings in the window, which must not be empty
+ */
+int16_t SignalFilter::median() {
+    int16_t sorted[FILTER_MAX_MEDIAN];
+
+    // Insertion sort, the window is tiny
+    for (uint8_t i = 0; i < windowCount; i++) {
+        int16_t reading = window[i];
+        uint8_t j = i;
+        for (; j > 0 && sorted[j - 1] > reading; j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = reading;
+    }
+
+    return sorted[windowCount / 2];
+}
+
+/**
+ * Adds a reading.
+ *
+ * @param reading The raw reading
+ * @param value Set to the conditioned value if one is done
+ * @return True if enough readings were added for a new value
+ */
+bool SignalFilter::add(int16_t reading, int16_t &value) {
+    bool spike = settings.spike > 0 && windowCount > 0 && (reading > median() + settings.spike || reading < median() - settings.spike);
+
+    if (spike && rejects < FILTER_MAX_REJECTS) {
+        rejects++;
+    } else {
+        // A spike which lasts is a real step, the old readings would only hold it back
+        if (spike) {
+            windowCount = 0;
+            windowIndex = 0;
+        }
+        rejects = 0;
+
+        window[windowIndex] = reading;
+        windowIndex = (windowIndex + 1) % settings.median;
+        if (windowCount < settings.median) {
+            windowCount++;
+        }
+    }
+
+    sum += median();
+    if (++sumCount < settings.oversample) {
+        return false;
+    }
+
+    int32_t mean = roundedDivide(sum, sumCount);
+    sum = 0;
+    sumCount = 0;
+
+    if (!averageValid) {
+        average = mean * 256;
+        averageValid = true;
+    } else {
+        average += roundedDivide((mean * 256 - average) * settings.smoothing, 100);
+    }
+
+    int32_t calibrated = roundedDivide(roundedDivide(average, 256) * settings.gain, 1000) + settings.offset;
+    value = calibrated > INT16_MAX ? INT16_MAX : calibrated < INT16_MIN ? INT16_MIN : calibrated;
+    return true;
+}
+
+uint8_t SignalFilter::getOversample() {
+    return settings.oversample;
+}
@@ -0,0 +1,35 @@
+#include "SyslogSink.h"
+
+#include "Logger.h"
+
+/**
+ * @param server The IPv4 of the syslog server
+ * @param hostname The name of the device in the messages, has to stay valid
+ * @param port The UDP port of the syslog server
+ */
+SyslogSink::SyslogSink(const char *server, const char *hostname, uint16_t port) : port(port), hostname(hostname) {
+    this->server.fromString(server);
+}
+
+void SyslogSink::write(uint8_t level, const char *line, size_t length) {
+    // Severities of error, warning, informational and debug, indexed by the log level
+    static const uint8_t severities[] = {6, 3, 4, 6, 7};
+
+    if (!server.isSet() || WiFi.status() != WL_CONNECTED) {
+        return;
+    }
+
+    char packet[SYSLOG_PACKET_SIZE];
+    int header = snprintf(packet, sizeof(packet), "<%u>%s thermometer: ", SYSLOG_FACILITY * 8 + severities[level <= LOG_LEVEL_DEBUG ? level : 0], hostname);
+    if (header <= 0 || header >= (int)sizeof(packet)) {
+        return;
+    }
+    if (length > sizeof(packet) - header) {
+        length = sizeof(packet) - header;
+    }
+    memcpy(packet + header, line, length);
+
+    udp.beginPacket(server, port);
+    udp.write((const uint8_t *)packet, header + length);
+    udp.endPacket();
+}
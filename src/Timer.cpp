@@ -0,0 +1,103 @@
+#include "Timer.h"
+
+/**
+ * Checks if a deadline is reached, even if millis() overflowed in between.
+ */
+bool Deadline::reached(uint32_t now, uint32_t deadline) {
+    return (int32_t)(now - deadline) >= 0;
+}
+
+/**
+ * Arms the deadline to expire timeout milliseconds from now.
+ */
+void Deadline::set(uint32_t now, uint32_t timeout) {
+    deadline = now + timeout;
+    armed = true;
+}
+
+void Deadline::clear() {
+    armed = false;
+}
+
+bool Deadline::isArmed() {
+    return armed;
+}
+
+/**
+ * @return True if the deadline is armed and reached. An unarmed deadline never expires.
+ */
+bool Deadline::expired(uint32_t now) {
+    return armed && reached(now, deadline);
+}
+
+/**
+ * @param baseDelay The delay after the first failure in milliseconds
+ * @param maxDelay The upper bound for the delay in milliseconds
+ * @param jitterPercent The maximum random deviation of every delay in percent
+ */
+Backoff::Backoff(uint32_t baseDelay, uint32_t maxDelay, uint8_t jitterPercent)
+    : baseDelay(baseDelay), maxDelay(maxDelay), jitterPercent(jitterPercent), randomState(0x2545F491) {}
+
+/**
+ * Seeds the jitter. Use something unique per device, like the chip id.
+ */
+void Backoff::seed(uint32_t seed) {
+    randomState = seed != 0 ? seed : 0x2545F491;
+}
+
+/**
+ * xorshift32, good enough to spread retries and does not need the arduino core.
+ */
+uint32_t Backoff::nextRandom() {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+/**
+ * @return True if there was no failure yet or the backoff delay has passed.
+ */
+bool Backoff::ready(uint32_t now) {
+    return !next.isArmed() || next.expired(now);
+}
+
+/**
+ * Records a failed attempt and schedules the next one.
+ */
+void Backoff::failed(uint32_t now) {
+    if (failures < UINT8_MAX) {
+        failures++;
+    }
+
+    uint32_t delay = getCurrentDelay();
+    if (jitterPercent > 0) {
+        uint32_t jitter = (uint32_t)((uint64_t)delay * jitterPercent / 100);
+        delay = delay - jitter + nextRandom() % (2 * jitter + 1);
+    }
+
+    next.set(now, delay);
+}
+
+/**
+ * Records a successful attempt. The next failure starts with the base delay again.
+ */
+void Backoff::reset() {
+    failures = 0;
+    next.clear();
+}
+
+/**
+ * @return The delay after the last failure without jitter, 0 if there was no failure.
+ */
+uint32_t Backoff::getCurrentDelay() {
+    if (failures == 0) {
+        return 0;
+    }
+
+    uint32_t delay = baseDelay;
+    for (uint8_t i = 1; i < failures && delay < maxDelay; i++) {
+        delay = delay > maxDelay / 2 ? maxDelay : delay * 2;
+    }
+    return delay < maxDelay ? delay : maxDelay;
+}
@@ -0,0 +1,134 @@
+#include "WiFiSelector.h"
+
+#include <string.h>
+
+/**
+ * Forgets all known networks.
+ */
+void WiFiSelector::clearProfiles() {
+    for (uint8_t i = 0; i < WIFI_SELECTOR_MAX_PROFILES; i++) {
+        profiles[i].ssid = nullptr;
+    }
+    count = 0;
+}
+
+/**
+ * Adds a known network, networks without SSID are skipped.
+ *
+ * @param index The index of the network, reported back in the candidate
+ * @param ssid The SSID, has to live as long as the selector uses it
+ * @param priority Added to the RSSI in dB when ranking the access points
+ * @return False if there is no space for another network
+ */
+bool WiFiSelector::addProfile(uint8_t index, const char *ssid, int8_t priority) {
+    if (index >= WIFI_SELECTOR_MAX_PROFILES) {
+        return false;
+    }
+    if (ssid == nullptr || ssid[0] == '\0') {
+        return true;
+    }
+
+    profiles[index].ssid = ssid;
+    profiles[index].priority = priority;
+    count = index + 1 > count ? index + 1 : count;
+    return true;
+}
+
+uint8_t WiFiSelector::getProfileCount() { return count; }
+
+/**
+ * @return The rank of an access point, higher is better
+ */
+int16_t WiFiSelector::score(const WiFiCandidate &candidate) {
+    return (int16_t)candidate.rssi + profiles[candidate.profile].priority;
+}
+
+/**
+ * Picks the best access point of a known network from the results of a finished scan.
+ * Access points received worse than WIFI_MIN_RSSI are skipped.
+ *
+ * @param best Filled with the chosen access point
+ * @return False if the scan did not find any known network
+ */
+bool WiFiSelector::select(WiFiScanner &scanner, WiFiCandidate &best) {
+    int16_t results = scanner.getResultCount();
+    bool found = false;
+
+    for (int16_t i = 0; i < results; i++) {
+        WiFiNetwork network;
+        if (!scanner.getResult(i, network) || network.rssi < WIFI_MIN_RSSI) {
+            continue;
+        }
+
+        for (uint8_t p = 0; p < count; p++) {
+            if (profiles[p].ssid == nullptr || strcmp(profiles[p].ssid, network.ssid) != 0) {
+                continue;
+            }
+
+            WiFiCandidate candidate;
+            candidate.profile = p;
+            memcpy(candidate.bssid, network.bssid, sizeof(candidate.bssid));
+            candidate.channel = network.channel;
+            candidate.rssi = network.rssi;
+            if (!found || score(candidate) > score(best)) {
+                best = candidate;
+                found = true;
+            }
+        }
+    }
+
+    return found;
+}
+
+/**
+ * Changes the RSSI below which a better access point is searched.
+ *
+ * @param rssi The threshold in dBm, 0 disables roaming
+ */
+void WiFiSelector::setRoamThreshold(int8_t rssi) {
+    roamRssi = rssi;
+    weak = false;
+}
+
+/**
+ * Watches the RSSI of the connection. Has to be called regularly while connected.
+ *
+ * @return True if the RSSI stayed below the threshold long enough and a roaming scan should be started
+ */
+bool WiFiSelector::checkRoam(int8_t rssi, uint32_t now) {
+    if (roamRssi == 0 || rssi >= roamRssi) {
+        weak = false;
+        return false;
+    }
+
+    if (!weak) {
+        weak = true;
+        weakSince = now;
+    }
+
+    if (now - weakSince < WIFI_ROAM_HOLD || (roamBlocked.isArmed() && !roamBlocked.expired(now))) {
+        return false;
+    }
+
+    roamBlocked.set(now, WIFI_ROAM_INTERVAL);
+    return true;
+}
+
+/**
+ * Decides if the best access point of a roaming scan is worth the switch.
+ *
+ * @param bssid The access point of the current connection
+ * @param rssi The RSSI of the current connection
+ * @return True if the candidate is another access point and received clearly better
+ */
+bool WiFiSelector::shouldRoam(const WiFiCandidate &candidate, const uint8_t *bssid, int8_t rssi) {
+    return memcmp(candidate.bssid, bssid, sizeof(candidate.bssid)) != 0 && candidate.rssi >= rssi + WIFI_ROAM_HYSTERESIS;
+}
+
+/**
+ * Starts watching a new connection, the next roaming scan is not done before WIFI_ROAM_INTERVAL.
+ */
+void WiFiSelector::resetRoam(uint32_t now) {
+    weak = false;
+    roamBlocked.set(now, WIFI_ROAM_INTERVAL);
+}
@@ -4,58 +4,382 @@
 #include <DNSServer.h>
 #include <ESP8266WiFi.h>
 #include <ESP8266mDNS.h>
+#include <AsyncMqttClient.h>
 #include <ESPAsyncTCP.h>
 #include <Schedule.h>
+#include <sys/time.h>
+#include <time.h>
 
-#include <Adafruit_Sensor.h>
 #include <ArduinoJson.h>
-#include <DHT.h>
-#include <PubSubClient.h>
+#include <LittleFS.h>
 
+#include "BME280Sensor.h"
+#include "CaptivePortal.h"
+#include "Clock.h"
 #include "Config.h"
+#include "DHTSensor.h"
+#include "DS18B20Sensor.h"
+#include "EepromStorage.h"
+#include "EspWiFiScanner.h"
+#include "FakeSensor.h"
+#include "Journal.h"
+#include "LittleFSStorage.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "MqttLogSink.h"
+#include "MqttPublisher.h"
+#include "OtaUpdater.h"
+#include "PayloadEncoder.h"
+#include "ReportFilter.h"
+#include "RtcState.h"
+#include "SampleBuffer.h"
+#include "Scheduler.h"
+#include "SensorRegistry.h"
+#include "SettingsJson.h"
+#include "SyslogSink.h"
+#include "Timer.h"
+#include "WiFiSelector.h"
+
+// Generated from HTML/ by scripts/embed_html.py
+#include "generated/live_html.h"
+#include "generated/wifi_settings_html.h"
 
 // The hostname used if nothing is set in the config or there is no config
 #define DEFAULT_HOST "esp-thermometer"
 
-// The config for the dht sensor
+// The speed of the serial port. The log is written from a buffer, so a slow port drops lines instead of blocking.
+#ifndef SERIAL_BAUD_RATE
+#define SERIAL_BAUD_RATE 115200
+#endif
+// Log lines up to this level are published to "<topic>/log" with -D LOG_MQTT_LEVEL=LOG_LEVEL_WARN.
+// With -D LOG_SYSLOG_SERVER=\"<ip>\" they are sent to a syslog server instead, up to LOG_SYSLOG_LEVEL.
+#ifndef LOG_SYSLOG_LEVEL
+#define LOG_SYSLOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// The sensors of the node. The dht sensor publishes to the configured topic, the others to "<topic>/<suffix>".
+// With the device topic layout every sensor publishes to "thermometer/<host>/<suffix or name>".
+// The type of the dht sensor can be changed with -D DHT_TYPE=DHT22, -D NO_DHT removes it.
+// A second dht sensor is enabled with -D DHT_PIN_2=<gpio>, it has the type of the first one unless -D DHT_TYPE_2 is given.
+#ifndef DHT_PIN
 #define DHT_PIN 2
+#endif
+#ifndef DHT_TYPE
 #define DHT_TYPE DHT11
-
-// The config website
-static const char html[] PROGMEM = "<!DOCTYPE html><html lang='de' class=''><head> <meta charset='utf-8'> <meta name='viewport' content='width=device-width,initial-scale=1,user-scalable=no' /> <title>ESP Thermometer konfiguration</title> <style> div, fieldset, input, select { padding: 5px; font-size: 1em; } h1 { text-align: center } fieldset { background-color: #fff; } p { margin: 0.5em 0; } input { width: 100%%; box-sizing: border-box; -webkit-box-sizing: border-box; -moz-box-sizing: border-box; } input[type=checkbox], input[type=radio] { width: 1em; margin-right: 6px; vertical-align: -1px; } select { width: 100%%; } textarea { resize: none; width: 98%%; height: 318px; padding: 5px; overflow: auto; } body { text-align: center; font-family: verdana; } td { padding: 0px; } button { border: 0; border-radius: 0.3rem; background-color: #1fa3ec; color: #fff; line-height: 2.4rem; font-size: 1.2rem; width: 100%%; -webkit-transition-duration: 0.4s; transition-duration: 0.4s; cursor: pointer; } button:hover { background-color: #0e70a4; } .bgrn { background-color: #47c266; } .bgrn:hover { background-color: #5aaf6f; } .btnr { background-color: #ff0000; } .btnr:hover { background-color: #cc0000; } a { text-decoration: none; } .p { float: left; text-align: left; } .q { float: right; text-align: right; } </style></head><body> <div style='text-align:left;display:inline-block;min-width:340px;'> <h1>Einstellungen</h1> <form method='get' action='config'> <fieldset> <legend> <b>&nbsp;WLAN&nbsp;</b> </legend> <p> <b>WLAN SSID</b><br /> <input id='wifi-ssid' name='wifi-ssid' placeholder='SSID' maxlength='31' value='%s' required> </p> <p> <b>WLAN Passwort</b><br /> <input id='wifi-passwd' name='wifi-passwd' type='password' placeholder='Passwort' maxlength='31' value='%s' required> </p> <p> <b>Hostname</b><br /> <input id='host' name='host' placeholder='Hostname' value='esp-wifi-thermometer' maxlength='31' value='%s' required> </p><br /> </fieldset><br /> <fieldset> <legend> <b>&nbsp;MQTT&nbsp;</b> </legend> <p> <b>Broker IP-Adresse</b><br /> <input id='broker-ip' name='broker-ip' placeholder='MQTT Broker IP-Adresse' pattern='(25[0-5]|2[0-4]\\d|1\\d\\d|[1-9]?\\d)_*(\\.(25[0-5]|2[0-4]\\d|1\\d\\d|[1-9]?\\d)_*){3}' maxlength='15' value='%s' required> </p> <p> <b>MQTT Port</b><br /> <input name='mqtt-port' type='number' min='0' max=' 65535' placeholder='Port' value='%u' required> </p> <p> <b>MQTT Nutzername</b><br /> <input id='mqtt-user' name='mqtt-user' placeholder='MQTT Nutzername' maxlength='31' value='%s' required> </p> <p> <b>MQTT Passwort</b><br /> <input id='mqtt-passwd' name='mqtt-passwd' type='password' placeholder='Passwort' maxlength='31' value='%s' required> </p> <p> <b>MQTT Topic</b><br /> <input id='mqtt-topic' name='mqtt-topic' placeholder='MQTT Topic' maxlength='254' value='%s' required> </p><br /> </fieldset><br /> <fieldset> <legend> <b>&nbsp;Allgemein&nbsp;</b> </legend> <p> <b>Temperaturanpassung in C&deg (-10 C&deg - 10 C&deg)</b><br /> <input name='temp-correction' type='number' min='-10' max='10' placeholder='Wert in C&deg' value='%d' required> </p> <p> <b>MQTT Nachrichten Frequenz (2-65536 Sekunden)</b><br /> <input name='mqtt-delay' type='number' min='2' max='65536' placeholder='Wert in Sekunden' value='%u' required> </p><br /> </fieldset><br /> <button name='save' type='submit' class='button bgrn'>Speichern</button><br /> </form> <br /> <form action='/rst'> <button name='reset' class='button btnr'>Zurücksetzen</button> </form> </div></body></html>";
+#endif
+#ifndef DHT_TYPE_2
+#define DHT_TYPE_2 DHT_TYPE
+#endif
+#ifndef DHT_PERIOD
+#define DHT_PERIOD 0
+#endif
+// DS18B20 sensors are enabled with -D DS18B20_PIN=<gpio>, every sensor found on the bus is used.
+// A BME280 sensor is enabled with -D BME280_ADDRESS=<i2c address>, a second one with -D BME280_ADDRESS_2=<other address>,
+// the sensor has the address 0x76 or 0x77. -D FAKE_SENSOR adds a simulated sensor to run the firmware without hardware.
+// The periods of all sensors are given in seconds with DHT_PERIOD, DS18B20_PERIOD and BME280_PERIOD, the message delay is used if they are not set.
+// The ESP-01 only has GPIO0 and GPIO2, so the dht sensor has to be moved to another pin or removed to use I2C.
+// The most DS18B20 sensors used, the dht sensors take the remaining place of the SensorRegistry
+#define DS18B20_MAX_COUNT 3
+#ifndef DS18B20_PERIOD
+#define DS18B20_PERIOD 0
+#endif
+#ifndef BME280_SDA
+#define BME280_SDA 0
+#endif
+#ifndef BME280_SCL
+#define BME280_SCL 2
+#endif
+#ifndef BME280_PERIOD
+#define BME280_PERIOD 0
+#endif
+
+// The periods of the scheduler tasks in milliseconds
+#define DNS_PERIOD 10
+#define MDNS_PERIOD 100
+#define WIFI_PERIOD 500
+#define MQTT_PERIOD 100
+#define SENSOR_PERIOD 50
+#define PUBLISH_PERIOD 250
+#define HEALTH_PERIOD 1000
+#define TIME_PERIOD 1000
+// A power loss drops the journal records of at most this time, or of LITTLEFS_SYNC_WRITES records
+#define JOURNAL_SYNC_PERIOD 10000
+
+// The time server, can be changed with -D NTP_SERVER=\"<host>\". The samples are stamped with UTC.
+#ifndef NTP_SERVER
+#define NTP_SERVER "pool.ntp.org"
+#endif
+// The system time is treated as synced after this epoch time, before SNTP answered it starts at 0
+#define TIME_VALID_EPOCH 1600000000UL
+// The longest line of the history export
+#define HISTORY_LINE_SIZE 128
+// The number of browsers on the live page at the same time, every one holds a connection and a message queue on the heap
+#ifndef LIVE_MAX_CLIENTS
+#define LIVE_MAX_CLIENTS 2
+#endif
+// The size of the sensor list sent to a new live client
+#define LIVE_SENSORS_SIZE 160
+
+// The time between two health messages in milliseconds
+#define HEALTH_PUBLISH_PERIOD 60000
+// The size of a health message
+#define HEALTH_MESSAGE_SIZE 256
+
+// Timeouts in milliseconds for the WiFi join with the cached access point and with a full scan
+#define FAST_CONNECT_TIMEOUT 3000
+#define FULL_CONNECT_TIMEOUT 10000
+// Timeout in milliseconds for the scan choosing the access point, the first network is joined without a scan after it
+#define WIFI_SCAN_TIMEOUT 6000
+
+// Deep sleep mode, enabled by building with -D DEEP_SLEEP. GPIO16 has to be wired to RST for the wakeup.
+// After this many wakeups in a row without WiFi, the device stays awake and opens the access point
+#define DEEP_SLEEP_MAX_FAILURES 5
+// The maximum number of backlog packets sent in one wakeup
+#define DEEP_SLEEP_MAX_BATCHES 8
+
+// The reconnect backoff in milliseconds. Starts with the base delay and doubles on every failure.
+#define WIFI_RETRY_DELAY 12000
+#define WIFI_RETRY_MAX_DELAY 300000
+#define MQTT_RETRY_DELAY 15000
+#define MQTT_RETRY_MAX_DELAY 300000
+
+// The time the broker has to answer a connect in milliseconds
+#define MQTT_CONNECT_TIMEOUT 10000
+// The keepalive of the connection in seconds. The broker publishes the last will after 1.5 times this without a packet.
+#define MQTT_KEEPALIVE 15
+// The size of the topic buffers, the configured topic and a suffix
+#define MQTT_TOPIC_SIZE (255 + 32)
+
+// A new firmware has to reach the broker within this time in milliseconds, otherwise the device restarts
+#define OTA_CONFIRM_TIMEOUT 300000
+// After this many restarts without reaching the broker the new firmware is kept running, with the access point to update it again
+#define OTA_MAX_TRIAL_BOOTS 3
+// The maximum size of an update request published to "<topic>/ota"
+#define OTA_MESSAGE_SIZE 320
+
+// The topics of a device start with "thermometer/<host>". Commands are received on "<device>/cmd" and answered on "<device>/cmd/reply".
+// The retained status on "<device>/status" is "online" while connected, the broker sets the last will "offline" when the device is gone.
+#define DEVICE_TOPIC_PREFIX "thermometer"
+#define STATUS_ONLINE "online"
+#define STATUS_OFFLINE "offline"
+// The maximum size of a command
+#define COMMAND_MESSAGE_SIZE 512
+// The maximum size of a reply
+#define REPLY_MESSAGE_SIZE 256
+
+// Home Assistant discovery, one retained config message per measured value on "homeassistant/sensor/<host>/<sensor>_<value>/config"
+#define DISCOVERY_PREFIX "homeassistant"
+// The maximum size of a discovery message
+#define DISCOVERY_MESSAGE_SIZE 768
+
+// Parts of the config changed by a command, each needs something else to be applied
+#define CHANGE_SENSORS 0x01
+#define CHANGE_FILTERS 0x02
+#define CHANGE_REPORT 0x04
+#define CHANGE_FORMAT 0x08
+#define CHANGE_TOPIC 0x10
+#define CHANGE_MQTT 0x20
+#define CHANGE_WIFI 0x40
+#define CHANGE_DISCOVERY 0x80
 
 //All the server objects needed
+// The two config slots are files of their own, older firmware kept the config in the EEPROM
+LittleFSStorage configSlotA("/config_a.bin");
+LittleFSStorage configSlotB("/config_b.bin");
+EepromStorage legacyConfig;
 Config config;
 DNSServer dnsServer;
 AsyncWebServer webServer(80);
-WiFiEventHandler connectedHandler, disconnectedHandler;
+// Pushes the samples and the health message to the live page
+AsyncEventSource liveEvents("/events");
+CaptivePortal captivePortal;
+WiFiEventHandler associatedHandler, connectedHandler, disconnectedHandler;
+Scheduler scheduler;
+
+// Survives restarts and deep sleep, used to reconnect fast
+RtcState rtcState;
+
+// The WiFi join in progress. A fast join uses the access point and IP cached in the RTC state and skips the scan and DHCP.
+// Otherwise the access points are scanned first and the best one of the known networks is joined.
+typedef enum { WIFI_JOIN_NONE, WIFI_JOIN_SCAN, WIFI_JOIN_FULL, WIFI_JOIN_FAST } WiFiJoin;
+WiFiJoin wifiJoin = WIFI_JOIN_NONE;
+unsigned long wifiJoinStart = 0;
+unsigned long wifiAssociated = 0;
+// The network of the join in progress or of the connection, see Config::getProfileSSID
+uint8_t wifiProfile = 0;
+
+// Ranks the access points of the known networks and roams when the signal stays weak
+EspWiFiScanner wifiScanner;
+WiFiSelector wifiSelector;
+bool wifiRoamScan = false;
+// Set while switching to a better access point or to new WiFi settings, the station drops the old one on purpose and the access point mode stays closed
+bool wifiRoaming = false;
+
+// Loop time, heap and connection counters, served on /metrics and published as health message
+Metrics metrics;
+Deadline healthPublish;
 
 // Thermometer stuff
-WiFiClient wifiClient;
-PubSubClient mqttClient(wifiClient);
-DHT dht(DHT_PIN, DHT_TYPE);
+AsyncMqttClient mqttClient;
+PayloadEncoder payloadEncoder;
+MqttPublisher publisher(mqttClient, payloadEncoder);
+Deadline mqttConnectTimeout;
+unsigned long mqttConnectStart = 0;
+SensorRegistry sensors;
+// Suppress the samples which did not change enough, one filter per sensor
+ReportFilter reportFilters[SENSOR_MAX_COUNT];
+#ifndef NO_DHT
+DHTSensor dhtSensor(DHT_PIN, DHT_TYPE);
+#endif
+#ifdef DHT_PIN_2
+DHTSensor dhtSensor2(DHT_PIN_2, DHT_TYPE_2);
+#endif
+#ifdef DS18B20_PIN
+OneWire oneWire(DS18B20_PIN);
+DallasTemperature dallasTemperature(&oneWire);
+// Every sensor on the bus gets a topic of its own, the first one keeps the topic of a single sensor
+DS18B20Sensor ds18b20Sensors[DS18B20_MAX_COUNT] = {{dallasTemperature, 0}, {dallasTemperature, 1}, {dallasTemperature, 2}};
+const char *const ds18b20Suffixes[DS18B20_MAX_COUNT] = {"ds18b20", "ds18b20_2", "ds18b20_3"};
+#endif
+#ifdef BME280_ADDRESS
+BME280Sensor bme280Sensor(BME280_ADDRESS);
+#endif
+#ifdef BME280_ADDRESS_2
+BME280Sensor bme280Sensor2(BME280_ADDRESS_2);
+#endif
+#ifdef FAKE_SENSOR
+FakeSensor fakeSensor("fake", 2150, 4500);
+#endif
 
 // Connection tries, used to determine if a reconnect should be done
-unsigned long lastConnectTry = 0;
-unsigned long lastMQTTConnect = 0;
-unsigned long lastMQTTPublish = 0;
+Backoff wifiBackoff(WIFI_RETRY_DELAY, WIFI_RETRY_MAX_DELAY);
+Backoff mqttBackoff(MQTT_RETRY_DELAY, MQTT_RETRY_MAX_DELAY);
+
+// The topics of the sensors and of the backlog, the publisher keeps pointers to them
+char deviceTopic[MQTT_TOPIC_SIZE];
+char statusTopic[MQTT_TOPIC_SIZE];
+char sampleTopics[SENSOR_MAX_COUNT][MQTT_TOPIC_SIZE];
+char backlogTopic[MQTT_TOPIC_SIZE];
+
+#ifdef LOG_MQTT_LEVEL
+char logTopic[MQTT_TOPIC_SIZE];
+MqttLogSink mqttLogSink(mqttClient, logTopic);
+#endif
+#ifdef LOG_SYSLOG_SERVER
+SyslogSink syslogSink(LOG_SYSLOG_SERVER, config.getHostname());
+#endif
+
+// Firmware updates, pushed to /update or requested on "<topic>/ota"
+OtaUpdater ota;
+Deadline otaConfirm;
+char otaTopic[MQTT_TOPIC_SIZE];
+
+// Remote configuration. A command is received by the network stack and applied by the mqtt task.
+char commandTopic[MQTT_TOPIC_SIZE];
+char replyTopic[MQTT_TOPIC_SIZE];
+char pendingCommand[COMMAND_MESSAGE_SIZE];
+bool commandPending = false;
+
+// Set on connect if the discovery messages were not sent since the last power on or config change
+bool discoveryPending = false;
+
+// The own period of every sensor in seconds, 0 to follow the message delay
+uint16_t sensorPeriods[SENSOR_MAX_COUNT];
+
+// Converts the sample timestamps to epoch time once SNTP answered
+Clock sampleClock;
+// The latest samples of all sensors including the suppressed ones, served on /history
+SampleBuffer history;
+
+// Samples which could not be published, sent in batches when the broker is back.
+// The journal keeps a copy in flash, so they survive a restart.
+SampleBuffer backlog;
+LittleFSStorage journalStorage("/journal.bin");
+Journal journal(journalStorage);
 
 void onHTTPRequest(AsyncWebServerRequest *request);
+void onSettingsRequest(AsyncWebServerRequest *request);
+void onMetricsRequest(AsyncWebServerRequest *request);
+void onHistoryRequest(AsyncWebServerRequest *request);
+void onLiveRequest(AsyncWebServerRequest *request);
+void onLiveConnect(AsyncEventSourceClient *client);
+void sendLiveSample(const Sample &sample);
+void printSensorMetrics(Print &out);
 void onReceivedConfig(AsyncWebServerRequest *request);
 void onReceivedReset(AsyncWebServerRequest *request);
+void onReceivedUpdate(AsyncWebServerRequest *request);
+void onUpdateUpload(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t length, bool final);
 
 void initApMode();
 void initDNSServer();
 void initWebServer();
 
+void initWiFiProfiles();
 bool connectWiFi();
+bool configureIP(bool useCache);
+void beginWiFi(bool fast);
+void joinWiFi(uint8_t profile, const uint8_t *bssid, uint8_t channel, bool fast);
+void startScan();
+void joinScanned();
+void updateRoaming();
 void wifiOnDisconnect(const WiFiEventStationModeDisconnected &event);
+void startApFallback();
+void wifiOnAssociate(const WiFiEventStationModeConnected &event);
 void wifiOnConnect(const WiFiEventStationModeGotIP &event);
 
+void initLogging();
+void initTime();
+void initOTA();
+void otaOnFinished(bool success);
+void initMQTT();
+void initTopics();
+const char *getTopicBase();
+const char *getSensorKey(uint8_t id);
 bool connectMQTT();
-bool publishMQTTData(float temperature, float humidity);
-
+void mqttOnConnect(bool sessionPresent);
+void mqttOnDisconnect(AsyncMqttClientDisconnectReason reason);
+void mqttOnMessage(char *topic, char *payload, AsyncMqttClientMessageProperties properties, size_t length, size_t index, size_t total);
+void requestUpdate(char *payload, size_t length);
+void applyCommand();
+bool setConfigValue(Config &target, const char *key, JsonVariant value);
+bool isWhole(float number, long min, long max);
+uint8_t findChanges(Config &current, Config &updated);
+void sendReply(JsonObject &reply);
+void sendDiscovery();
+bool sendDiscoveryValue(uint8_t id, const char *value, const char *unit);
+bool sendSample(Sample &sample);
+uint32_t journalSample(Sample sample);
+uint8_t sendReadings();
+void requeueInflight();
+
+void initTasks();
+void updateDNS();
+void updateMDNS();
+void updateWiFi();
+void updateMQTT();
+void initJournal();
+void initSensors();
+void addSensor(Sensor *sensor, const char *suffix, uint16_t period, unsigned long now);
+void applyMessageDelay();
+void applyFilters();
+void initReporting();
+void sampleSensors();
 void sendMQTTData();
+void updateHealth();
+void updateTime();
+void syncJournal();
+void flushBacklog();
+
+#ifdef DEEP_SLEEP
+void runDutyCycle();
+bool connectWiFiFast();
+bool waitForScan(unsigned long timeout);
+bool waitForWiFi(unsigned long timeout);
+bool connectMQTTFast();
+bool waitForMQTT(unsigned long timeout);
+bool waitForAcks(unsigned long timeout);
+void publishWakeStats();
+#endif
 
 void setup() {
     // We are doing all this ourselves
@@ -64,18 +388,47 @@ void setup() {
     WiFi.persistent(false);
 
     delay(500);
-    Serial.begin(9600);
-    Serial.println("\n[ESP] Started WIFI thermometer...\n");
+    Serial.begin(SERIAL_BAUD_RATE);
+    LOG_INFO("ESP", "Started WIFI thermometer...");
 
-    // Load and check config
+    // Load and check config, the config slots and the journal are kept on LittleFS
+    if (!LittleFS.begin()) {
+        LOG_ERROR("ESP", "Could not mount the file system!");
+    }
+    Config::setStorage(configSlotA, configSlotB, legacyConfig);
     config.loadConfig();
-    Serial.println(config.flashInitialized() ? "[CONFIG] Flash is initialized" : "[CONFIG] Flash is uninitialized");
-    Serial.println(config.isValid() ? "[CONFIG] Loaded valid config from flash" : "[CONFIG] No valid config stored in flash");
-
-    // Start dht sensor reading
-    dht.begin();
+    LOG_INFO("CONFIG", "Flash is %s", config.flashInitialized() ? "initialized" : "uninitialized");
+    LOG_INFO("CONFIG", "%s", config.isValid() ? "Loaded valid config from flash" : "No valid config stored in flash");
+    payloadEncoder.setFormat((PayloadFormat)config.getPayloadFormat());
+    initLogging();
+
+    // Cached network of the last connection, if this is a restart or a wakeup
+    rtcState.load();
+    initWiFiProfiles();
+    initTime();
+    initOTA();
+
+    // Spread the reconnects of different devices after an outage
+    wifiBackoff.seed(ESP.getChipId());
+    mqttBackoff.seed(ESP.getChipId() ^ millis());
+
+    // Start the sensors
+    initSensors();
+    initReporting();
+    initMQTT();
+
+    // Recover the samples which were not published before the last restart
+    initJournal();
+
+#ifdef DEEP_SLEEP
+    // Only returns if WiFi failed too often, then the access point is opened to fix the config
+    if (config.isValid()) {
+        runDutyCycle();
+    }
+#endif
 
     // Attach wifi handlers to recognize when wifi is dis-/connected
+    associatedHandler = WiFi.onStationModeConnected(wifiOnAssociate);
     connectedHandler = WiFi.onStationModeGotIP(wifiOnConnect);
     disconnectedHandler = WiFi.onStationModeDisconnected(wifiOnDisconnect);
 
@@ -83,317 +436,1793 @@ void setup() {
     initApMode();
     initDNSServer();
     initWebServer();
-    connectWiFi();
+    initTasks();
 }
 
 void loop() {
-    // Update DNS services
+    unsigned long start = micros();
+    scheduler.run(millis());
+    metrics.recordLoop(micros() - start);
+
+    logger.drain(Serial);
+
+    // Sleep until the next task is due. The WiFi stack and the async webserver keep running meanwhile.
+    delay(scheduler.timeUntilNext(millis()));
+}
+
+/**
+ * Registers all the periodic work with the scheduler.
+ * The sensors are read with their own periods by the sensor registry.
+ */
+void initTasks() {
+    unsigned long now = millis();
+
+    scheduler.addTask(updateDNS, DNS_PERIOD, now);
+    scheduler.addTask(updateMDNS, MDNS_PERIOD, now);
+    scheduler.addTask(updateWiFi, WIFI_PERIOD, now);
+    scheduler.addTask(updateMQTT, MQTT_PERIOD, now);
+    scheduler.addTask(sampleSensors, SENSOR_PERIOD, now);
+    scheduler.addTask(sendMQTTData, PUBLISH_PERIOD, now);
+    scheduler.addTask(updateHealth, HEALTH_PERIOD, now);
+    scheduler.addTask(updateTime, TIME_PERIOD, now);
+    scheduler.addTask(syncJournal, JOURNAL_SYNC_PERIOD, now);
+
+    healthPublish.set(now, HEALTH_PUBLISH_PERIOD);
+}
+
+/**
+ * Task answering pending DNS requests of the captive portal.
+ */
+void updateDNS() {
     dnsServer.processNextRequest();
+}
+
+/**
+ * Task keeping the MDNS responder alive.
+ */
+void updateMDNS() {
     MDNS.update();
+}
 
-    // Give time to the webserver to do its thing
-    delay(500);
+/**
+ * Task starting a WiFi connection if there is none.
+ */
+void updateWiFi() {
+    connectWiFi();
+}
 
-    // If wifi is not connected already or after trying to connect, return because it is needed for mqtt
-    if (!connectWiFi()) {
-        return;
+/**
+ * Task keeping the connection to the mqtt broker alive and the messages in flight going.
+ * A connection is only started while WiFi is connected, because it is needed for mqtt.
+ */
+void updateMQTT() {
+    if (otaConfirm.expired(millis())) {
+        LOG_WARN("OTA", "New firmware did not reach the broker, restarting");
+        journal.sync();
+        logger.flush(Serial);
+        ESP.restart();
+    }
+
+    if (commandPending) {
+        applyCommand();
+        commandPending = false;
     }
 
-    // If mqtt is not already connected or trying to connect failed, retrun because we dont even need to try sending data
-    if (!connectMQTT()) {
+    if (!mqttClient.connected()) {
+        requeueInflight();
+        if (WiFi.status() == WL_CONNECTED) {
+            connectMQTT();
+        }
         return;
     }
 
-    mqttClient.loop();
-    delay(50);
+    if (discoveryPending) {
+        sendDiscovery();
+    }
 
-    // Finally publish data to mqtt broker
-    sendMQTTData();
+    uint16_t removed = publisher.update(backlog, millis());
+    if (removed > 0) {
+        journal.markSent(publisher.getJournaled());
+        LOG_INFO("MQTT", "Published %u buffered samples, %u left", removed, backlog.size());
+    }
 
-    yield();
+    flushBacklog();
 }
 
 /**
- * Initialises and starts the acces point mode
+ * Opens the journal and moves the unpublished samples into the backlog.
+ * Only has to be called on startup, after the file system is mounted.
  */
-void initApMode() {
-    WiFi.softAPConfig(IPAddress(192, 168, 1, 1), IPAddress(192, 168, 1, 1), IPAddress(255, 255, 255, 0));
-    const char *host = config.isValid() ? config.getHostname() : DEFAULT_HOST;
-    WiFi.softAP(host);
-    delay(500);
-    WiFi.mode(WIFI_AP_STA);
-    Serial.printf("[WIFI] Starting access point mode with ssid: '%s'\n", host);
+void initJournal() {
+    if (!journal.begin()) {
+        LOG_ERROR("JOURNAL", "Could not open journal, samples will not survive a restart!");
+        return;
+    }
+
+    uint16_t replayed = journal.replay(backlog, millis());
+    LOG_INFO("JOURNAL", "Recovered %u unpublished samples", replayed);
 }
 
 /**
- * Initialieses and starts the DNS server and the MDNS responder.
+ * Task syncing the journal records to the flash, which the storage still keeps in its buffer.
+ * Bounds the samples a power loss can drop to the last JOURNAL_SYNC_PERIOD.
+ */
+void syncJournal() {
+    journal.sync();
+}
+
+/**
+ * Registers and starts the sensors of the node.
  * Only has to be called on startup.
  */
-void initDNSServer() {
-    /* Setup the DNS server redirecting all the domains to the apIP */
-    dnsServer.setErrorReplyCode(DNSReplyCode::NoError);
-    dnsServer.start(53, "*", WiFi.softAPIP());
+void initSensors() {
+    unsigned long now = millis();
+
+#ifndef NO_DHT
+    addSensor(&dhtSensor, "", DHT_PERIOD, now);
+#endif
+#ifdef DHT_PIN_2
+    addSensor(&dhtSensor2, "dht_2", DHT_PERIOD, now);
+#endif
+#ifdef DS18B20_PIN
+    // Every sensor found on the bus is added, in the order of their addresses
+    dallasTemperature.begin();
+    uint8_t found = dallasTemperature.getDeviceCount();
+    if (found == 0) {
+        LOG_ERROR("DS18B20", "No sensor found on the bus!");
+    } else if (found > DS18B20_MAX_COUNT) {
+        LOG_WARN("DS18B20", "Found %u sensors, only the first %u are used", found, DS18B20_MAX_COUNT);
+    }
+    for (uint8_t i = 0; i < found && i < DS18B20_MAX_COUNT; i++) {
+        addSensor(&ds18b20Sensors[i], ds18b20Suffixes[i], DS18B20_PERIOD, now);
+    }
+#endif
+#if defined(BME280_ADDRESS) || defined(BME280_ADDRESS_2)
+    Wire.begin(BME280_SDA, BME280_SCL);
+#endif
+#ifdef BME280_ADDRESS
+    addSensor(&bme280Sensor, "bme280", BME280_PERIOD, now);
+#endif
+#ifdef BME280_ADDRESS_2
+    addSensor(&bme280Sensor2, "bme280_2", BME280_PERIOD, now);
+#endif
+#ifdef FAKE_SENSOR
+    // Drifts by 2 degrees and back, so the report filters and the graphs have something to do
+    fakeSensor.setRamp(5, 200);
+    addSensor(&fakeSensor, "fake", 0, now);
+#endif
+
+    applyFilters();
+
+    sensors.begin();
+    LOG_INFO("SENSOR", "Started %u sensors", sensors.size());
+}
 
-    // MDNS setup
-    const char *host = config.isValid() ? config.getHostname() : DEFAULT_HOST;
-    MDNS.begin(host);
-    MDNS.addService("http", "tcp", 80);
+/**
+ * Registers a sensor with its own period in seconds, or with the message delay if the period is 0.
+ */
+void addSensor(Sensor *sensor, const char *suffix, uint16_t period, unsigned long now) {
+    unsigned long messageDelay = (config.isValid() ? config.getMessageDelay() : DEFAULT_MESSAGE_DELAY) * 1000UL;
+
+    int id = sensors.add(sensor, suffix, period > 0 ? period * 1000UL : messageDelay, now);
+    if (id >= 0) {
+        sensorPeriods[id] = period;
+    } else {
+        LOG_WARN("SENSOR", "No place left for sensor %s", sensor->getName());
+    }
+}
 
-    Serial.println("[DNS] DNS server and MDNS started");
-    Serial.printf("[DNS] Hostname is set to: '%s'\n", host);
+/**
+ * Applies a changed message delay to the sensors without an own period.
+ */
+void applyMessageDelay() {
+    for (uint8_t id = 0; id < sensors.size(); id++) {
+        if (sensorPeriods[id] == 0) {
+            sensors.setPeriod(id, config.getMessageDelay() * 1000UL, millis());
+        }
+    }
 }
 
 /**
- * Initialises and starts the webserver.
+ * Applies the calibration and the filter settings of the config to all sensors.
+ */
+void applyFilters() {
+    // The calibration is part of the temperature filter
+    FilterSettings temperature;
+    FilterSettings humidity;
+    temperature.offset = config.getTempOffset();
+    temperature.gain = config.getTempGain();
+#ifndef DEEP_SLEEP
+    // The filter state does not survive deep sleep, so the sleep variant only uses the calibration
+    temperature.oversample = humidity.oversample = config.getFilterOversample();
+    temperature.median = humidity.median = config.getFilterMedian();
+    temperature.smoothing = humidity.smoothing = config.getFilterSmoothing();
+    temperature.spike = config.getFilterSpikeTemp();
+    humidity.spike = config.getFilterSpikeHumidity();
+#endif
+    sensors.setFilters(temperature, humidity);
+}
+
+/**
+ * Applies the deadbands and the heartbeat of the config to the report filters.
+ * The sleep variant publishes every sample, the filters do not survive deep sleep.
+ */
+void initReporting() {
+#ifndef DEEP_SLEEP
+    for (uint8_t i = 0; i < SENSOR_MAX_COUNT; i++) {
+        reportFilters[i].configure(config.getReportDeadbandTemp(), config.getReportDeadbandHumidity(), config.getReportHeartbeat() * 1000UL);
+    }
+#endif
+}
+
+/**
+ * Sets up the mqtt client and the topics. The connection is started by the mqtt task.
  * Only has to be called on startup.
  */
-void initWebServer() {
-    webServer.on("/", onHTTPRequest);
-    webServer.on("/generate_204", onHTTPRequest); //Android captive portal. Maybe not needed. Might be handled by notFound handler.
-    webServer.on("/fwlink", onHTTPRequest);       //Microsoft captive portal. Maybe not needed. Might be handled by notFound handler.
-    webServer.onNotFound(onHTTPRequest);          //Any page
+void initMQTT() {
+    snprintf(deviceTopic, sizeof(deviceTopic), "%s/%s", DEVICE_TOPIC_PREFIX, config.getHostname());
+    snprintf(statusTopic, sizeof(statusTopic), "%s/status", deviceTopic);
+    snprintf(commandTopic, sizeof(commandTopic), "%s/cmd", deviceTopic);
+    snprintf(replyTopic, sizeof(replyTopic), "%s/cmd/reply", deviceTopic);
+    initTopics();
+
+    mqttClient.setClientId(config.getHostname());
+    mqttClient.setKeepAlive(MQTT_KEEPALIVE);
+#ifndef DEEP_SLEEP
+    // A sleeping device is not connected most of the time, it is watched by the age of its samples instead
+    mqttClient.setWill(statusTopic, 1, true, STATUS_OFFLINE);
+#endif
+    mqttClient.setCredentials(config.getMqttUsername(), config.getMqttPassword());
+    mqttClient.setServer(config.getMqttIP(), config.getMqttPort());
+    mqttClient.onConnect(mqttOnConnect);
+    mqttClient.onDisconnect(mqttOnDisconnect);
+    mqttClient.onMessage(mqttOnMessage);
+    publisher.begin();
+}
 
-    webServer.on("/config", onReceivedConfig);
-    webServer.on("/rst", onReceivedReset);
+/**
+ * Builds the topics below the configured topic or the device topic, depending on the topic layout.
+ * Called again when the topic is changed by a command.
+ */
+void initTopics() {
+    const char *base = getTopicBase();
 
-    webServer.begin();
+    for (uint8_t id = 0; id < sensors.size(); id++) {
+        if (config.getTopicLayout() == TOPIC_LAYOUT_DEVICE) {
+            snprintf(sampleTopics[id], MQTT_TOPIC_SIZE, "%s/%s", base, getSensorKey(id));
+        } else {
+            // Every sensor has its own topic, the first one publishes to the configured topic itself
+            const char *suffix = sensors.getSuffix(id);
+            snprintf(sampleTopics[id], MQTT_TOPIC_SIZE, suffix[0] != '\0' ? "%s/%s" : "%s", base, suffix);
+        }
+    }
+    snprintf(backlogTopic, sizeof(backlogTopic), "%s/backlog", base);
+    snprintf(otaTopic, sizeof(otaTopic), "%s/ota", base);
+#ifdef LOG_MQTT_LEVEL
+    snprintf(logTopic, sizeof(logTopic), "%s/log", base);
+#endif
+}
+
+/**
+ * @return The topic the sample, backlog, health and update topics are placed below
+ */
+const char *getTopicBase() {
+    return config.getTopicLayout() == TOPIC_LAYOUT_DEVICE ? deviceTopic : config.getMqttTopic();
+}
 
-    Serial.println("[WEBSERVER] Webserver started");
+/**
+ * @return The name of a sensor in topics and discovery ids, its suffix or the name of its driver for the first sensor
+ */
+const char *getSensorKey(uint8_t id) {
+    const char *suffix = sensors.getSuffix(id);
+    return suffix[0] != '\0' ? suffix : sensors.getSensor(id)->getName();
 }
 
 /**
- * Callback function for the http server.
- * Builds and sends responses to normal http requests, sending the config page.
+ * Starts SNTP, it syncs the system time in the background as soon as WiFi is connected.
+ * After a deep sleep the clock starts with the time estimated before the sleep, until SNTP answers.
  */
-void onHTTPRequest(AsyncWebServerRequest *request) {
-    size_t bufferSize = strlen_P(html) + sizeof(config) + 1;
-    char *htmlBuffer = (char *)calloc(bufferSize, sizeof(char));
+void initTime() {
+    payloadEncoder.setClock(&sampleClock);
+    configTime(0, 0, NTP_SERVER);
 
-    if (config.isValid()) {
-        snprintf_P(htmlBuffer, bufferSize, html, config.getSSID(), config.getWifiPassword(), config.getHostname(), config.getMqttIP(), (uint)config.getMqttPort(),
-                   config.getMqttUsername(), config.getMqttPassword(), config.getMqttTopic(), (int)config.getTempCorrection(), (uint)config.getMessageDelay());
-    } else {
-        snprintf_P(htmlBuffer, bufferSize, html, "", "", "", "", 1883, "", "", "", 0, (uint)10);
+    if (rtcState.getWakeEpoch() != 0) {
+        // The estimate is the time of the reset, which is millis() 0
+        sampleClock.sync(rtcState.getWakeEpoch(), 0, 0);
     }
+}
 
-    request->send(200, "text/html", htmlBuffer);
-    free(htmlBuffer);
+/**
+ * Task taking the system time over into the clock of the samples, once SNTP synced it.
+ */
+void updateTime() {
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    if ((unsigned long)now.tv_sec < TIME_VALID_EPOCH) {
+        return;
+    }
 
-    Serial.print("[WEBSERVER] Responded to http client: ");
-    Serial.println(IPAddress(request->client()->getRemoteAddress()));
+    if (!sampleClock.isSynced() || rtcState.getWakeEpoch() != 0) {
+        LOG_INFO("TIME", "Time synced");
+        rtcState.setWakeEpoch(0);
+    }
+    sampleClock.sync(now.tv_sec, now.tv_usec / 1000, millis());
 }
 
 /**
- * Callback function for the http server.
- * Reacts to http requests containing config information.
- * Checks the config and if its valid, saves the config and restarts the esp.
+ * Hands the log lines to the network sink selected at build time, if any.
  */
-void onReceivedConfig(AsyncWebServerRequest *request) {
-    Config newConfig;
-    newConfig.setSSID((char *)request->arg("wifi-ssid").c_str());
-    newConfig.setWifiPassword((char *)request->arg("wifi-passwd").c_str());
-    newConfig.setHostname((char *)request->arg("host").c_str());
-    newConfig.setMqttIP((char *)request->arg("broker-ip").c_str());
-    newConfig.setMqttPort(request->arg("mqtt-port").toInt());
-    newConfig.setMqttUsername((char *)request->arg("mqtt-user").c_str());
-    newConfig.setMqttPassword((char *)request->arg("mqtt-passwd").c_str());
-    newConfig.setMqttTopic((char *)request->arg("mqtt-topic").c_str());
-    newConfig.setTempCorrection(request->arg("temp-correction").toInt());
-    newConfig.setMessageDelay(request->arg("mqtt-delay").toInt());
-
-    newConfig.setMagicNumber(MAGIC_NUMBER);
-
-    if (newConfig.isValid()) {
-        newConfig.saveConfig();
-        AsyncWebServerResponse *response = request->beginResponse(200, "text/html", "<h1>OK saved new config! Restarting in 3 seconds...</h1> <p> You are redirected automatically in 8 seconds</p>");
-        String url = String("url=http://") + String(config.getHostname()) + String(".local");
-        response->addHeader("refresh", "8;" + url);
-        request->send(response);
+void initLogging() {
+#ifdef LOG_MQTT_LEVEL
+    logger.setSink(&mqttLogSink, LOG_MQTT_LEVEL);
+#elif defined(LOG_SYSLOG_SERVER)
+    logger.setSink(&syslogSink, LOG_SYSLOG_LEVEL);
+#endif
+}
 
-        Serial.println("[ESP] Saved new config. Restarting in 3 seconds...");
+/**
+ * Checks if a new firmware is on trial. It has to reach the broker in time, otherwise the device restarts.
+ * The ESP8266 overwrites the old firmware while installing the new one, so a failing firmware can not be rolled back.
+ * After too many restarts it is kept running and can be replaced over the access point or the webserver.
+ */
+void initOTA() {
+    ota.onFinished(otaOnFinished);
 
-        //Runs the code in 3 seconds
-        schedule_function(
-            []() {
-                delay(3000);
-                ESP.restart();
-            });
+    if (!rtcState.isOtaTrial()) {
+        return;
+    }
 
+    uint16_t boots = rtcState.countOtaBoot();
+    if (boots > OTA_MAX_TRIAL_BOOTS) {
+        LOG_ERROR("OTA", "New firmware did not reach the broker after %u restarts, please update again", boots - 1);
+        rtcState.endOtaTrial();
     } else {
-        Serial.println("[ESP] Received bad config. Ignoring it!");
-
-        AsyncWebServerResponse *response = request->beginResponse(200, "text/html", "<h1>An error occured...please go back to where you came from.</h1><p>You are redirected automatically in 5 seconds</p>");
-        String url = String("url=http://") + String(config.getHostname()) + String(".local");
-        response->addHeader("refresh", "5;" + url);
-        request->send(response);
+        LOG_INFO("OTA", "New firmware on trial, start %u of %u", boots, OTA_MAX_TRIAL_BOOTS);
+#ifndef DEEP_SLEEP
+        otaConfirm.set(millis(), OTA_CONFIRM_TIMEOUT);
+#endif
     }
+    rtcState.save();
 }
 
 /**
- * Callback function for the http server.
- * Reacts to http respnses, responding a reset.
- * Resets the flash memory and resrarts the esp.
+ * Called when a firmware update ended. A new firmware is started on trial.
  */
-void onReceivedReset(AsyncWebServerRequest *request) {
-    AsyncWebServerResponse *response = request->beginResponse(200, "text/html", "<h1>Resetting device in 3 seconds!</h1><p>You are redirected automatically in 8 seconds</p>");
-    String url = String("url=http://") + String(DEFAULT_HOST) + String(".local");
-    response->addHeader("refresh", "8;" + url);
-    request->send(response);
+void otaOnFinished(bool success) {
+    if (!success) {
+        return;
+    }
 
-    Serial.println("[ESP] Resetted flash. Restarting in 3 seconds...");
+    rtcState.startOtaTrial();
+    rtcState.save();
 
-    //Runs the code in 3 seconds
+    //Runs the code in 3 seconds, gives the webserver time to answer
     schedule_function(
         []() {
-            config.eraseConfigFlash();
+            journal.sync();
+            logger.flush(Serial);
             delay(3000);
             ESP.restart();
         });
 }
 
 /**
- * Connect the esp to wifi.
- * 
- * @return True if WiFi is connected. False if WiFi is disconnected.
+ * Callback to be called when a message on a subscribed topic arrives.
+ * Retained update requests are ignored, they would install the same firmware after every restart.
  */
-bool connectWiFi() {
-    if (!config.isValid()) {
-        return false;
+void mqttOnMessage(char *topic, char *payload, AsyncMqttClientMessageProperties properties, size_t length, size_t index, size_t total) {
+    if (index != 0 || length != total) {
+        LOG_WARN("MQTT", "Ignoring message of %u bytes on %s", (unsigned)total, topic);
+        return;
     }
 
-    // If already connected, return true
-    if (WiFi.status() == WL_CONNECTED) {
-        return true;
+    if (strcmp(topic, commandTopic) == 0) {
+        if (commandPending || length >= COMMAND_MESSAGE_SIZE) {
+            LOG_WARN("CMD", "Ignoring command of %u bytes", (unsigned)length);
+            return;
+        }
+        memcpy(pendingCommand, payload, length);
+        pendingCommand[length] = '\0';
+        commandPending = true;
+    } else if (strcmp(topic, otaTopic) == 0 && !properties.retain) {
+        requestUpdate(payload, length);
     }
+}
 
-    // Check if its time to connect. If not return false, because WiFi can not be connected at this point
-    if (millis() < (lastConnectTry + 12000)) {
-        return false;
+/**
+ * Starts the download of a firmware. Update requests look like {"url":"http://host/firmware.bin","md5":"..."},
+ * the digest is required.
+ */
+void requestUpdate(char *payload, size_t length) {
+    if (length >= OTA_MESSAGE_SIZE) {
+        LOG_WARN("OTA", "Ignoring update request of %u bytes", (unsigned)length);
+        return;
     }
 
-    Serial.printf("[WIFI] Connecting to WiFi: %s\n", config.getSSID());
-    WiFi.begin(config.getSSID(), config.getWifiPassword());
-
-    lastConnectTry = millis();
+    char message[OTA_MESSAGE_SIZE];
+    memcpy(message, payload, length);
+    message[length] = '\0';
 
-    delay(1500);
-
-    // Check if wifi is connected after 1,5 seconds
-    if (WiFi.status() == WL_CONNECTED) {
-        return true;
-    } else {
-        return false;
+    StaticJsonBuffer<OTA_MESSAGE_SIZE> jsonBuffer;
+    JsonObject &request = jsonBuffer.parseObject(message);
+    if (!request.success() || !request["url"].is<const char *>() || !request["md5"].is<const char *>()) {
+        LOG_WARN("OTA", "Invalid update request, it needs an url and a MD5 digest");
+        return;
     }
+
+    ota.fetch(request["url"], request["md5"]);
 }
 
 /**
- * Callback to be called when WiFi disconnects.
- * This reenables the acces point mode.
+ * Applies a command with a partial config, like {"id":7,"mqtt-delay":30,"report-deadband-temp":0.2}.
+ * The keys and units are the ones of the settings page. Every change is applied without a restart,
+ * the config is only saved if a value changed. Invalid commands change nothing.
+ * The reply echoes the id and tells if the command was accepted.
  */
-void wifiOnDisconnect(const WiFiEventStationModeDisconnected &event) {
-    if (WiFi.getMode() != WIFI_AP_STA) {
-        //Runs the code when its time for it
-        schedule_function(
-            []() {
-                Serial.println("[WIFI] WiFi disconnected!");
-                initApMode();
-                MDNS.notifyAPChange();
-            });
+void applyCommand() {
+    StaticJsonBuffer<COMMAND_MESSAGE_SIZE> commandBuffer;
+    JsonObject &command = commandBuffer.parseObject(pendingCommand);
+    StaticJsonBuffer<REPLY_MESSAGE_SIZE> replyBuffer;
+    JsonObject &reply = replyBuffer.createObject();
+
+    if (!command.success()) {
+        LOG_WARN("CMD", "Received invalid command");
+        reply["ok"] = false;
+        reply["error"] = "invalid json";
+        sendReply(reply);
+        return;
+    }
+    if (command.containsKey("id")) {
+        reply["id"] = command["id"];
     }
-}
 
-/**
- * Callback to be called when WiFi connects.
- * This closes the acces point.
- */
-void wifiOnConnect(const WiFiEventStationModeGotIP &event) {
-    Serial.print("[WIFI] Connected to WiFi: ");
-    Serial.println(WiFi.SSID());
-    Serial.print("[NETWORK] Got IPv4: ");
-    Serial.println(WiFi.localIP());
+    Config updated = config;
+    for (JsonPair &pair : command) {
+        if (strcmp(pair.key, "id") != 0 && !setConfigValue(updated, pair.key, pair.value)) {
+            LOG_WARN("CMD", "Rejected command, invalid value of %s", pair.key);
+            reply["ok"] = false;
+            reply["error"] = "invalid value";
+            reply["key"] = pair.key;
+            sendReply(reply);
+            return;
+        }
+    }
 
-    MDNS.notifyAPChange();
-    WiFi.mode(WIFI_STA); //close AP network
-    Serial.println("[WIFI] Disabling access point mode");
-}
+    uint8_t changes = findChanges(config, updated);
+    if (changes != 0) {
+        // Unsubscribed before the topics change
+        if (changes & CHANGE_TOPIC) {
+            mqttClient.unsubscribe(otaTopic);
+        }
 
-/**
- * Tries to connect to the mqtt broker.
- * 
- * @return True if connection was succesfull, else false.
- */
-bool connectMQTT() {
-    // MQTT is already connected
-    if (mqttClient.connected()) {
-        return true;
+        config = updated;
+        config.saveConfig();
+        LOG_INFO("CMD", "Applied command, changes 0x%02x", changes);
     }
 
-    // MQTT is not connected, but its not time to try to connect it
-    if (millis() < (lastMQTTConnect + 15000)) {
-        return false;
+    if (changes & CHANGE_SENSORS) {
+        applyMessageDelay();
+    }
+    if (changes & CHANGE_FILTERS) {
+        applyFilters();
+    }
+    if (changes & CHANGE_REPORT) {
+        initReporting();
+    }
+    if (changes & CHANGE_FORMAT) {
+        payloadEncoder.setFormat((PayloadFormat)config.getPayloadFormat());
+    }
+    if (changes & CHANGE_TOPIC) {
+        initTopics();
+        mqttClient.subscribe(otaTopic, 1);
+    }
+    if (changes & (CHANGE_TOPIC | CHANGE_DISCOVERY)) {
+        // The discovery points to the sample topics, it is sent again with the new ones
+        rtcState.setDiscoverySent(false);
+        rtcState.save();
+        discoveryPending = config.getDiscovery();
     }
 
-    //MQTT is not connected but its time to try to connect, try to connect now
-    Serial.print("[MQTT] Connecting to MQTT broker ");
-    Serial.println(config.getMqttIP());
+    reply["ok"] = true;
+    reply["saved"] = changes != 0;
+    sendReply(reply);
+
+    // The connections are dropped after the reply, the tasks connect again with the new settings
+    if (changes & CHANGE_WIFI) {
+        LOG_INFO("CMD", "WiFi settings changed, reconnecting");
+        initWiFiProfiles();
+        rtcState.clearNetwork();
+        rtcState.clearBrokerIP();
+        rtcState.save();
+        wifiBackoff.reset();
+        // The connection is dropped on purpose, the access point only opens if the new settings do not connect
+        wifiRoaming = true;
+        wifiJoinStart = millis();
+        WiFi.disconnect();
+    } else if (changes & CHANGE_MQTT) {
+        LOG_INFO("CMD", "Broker settings changed, reconnecting");
+        rtcState.clearBrokerIP();
+        rtcState.save();
+        mqttClient.setServer(config.getMqttIP(), config.getMqttPort());
+        mqttClient.setCredentials(config.getMqttUsername(), config.getMqttPassword());
+        mqttBackoff.reset();
+        mqttClient.disconnect();
+    }
+}
 
-    lastMQTTConnect = millis();
+/**
+ * Sets one value of a command, the keys and units are the ones of the settings page.
+ *
+ * @return False if the key is unknown or the value is invalid
+ */
+bool setConfigValue(Config &target, const char *key, JsonVariant value) {
+    // Text values, the setters do not change the text and refuse a text longer than its field
+    char *text = (char *)value.as<const char *>();
+    if (strcmp(key, "wifi-ssid") == 0) {
+        return text != nullptr && strlen(text) > 0 && target.setSSID(text);
+    } else if (strcmp(key, "wifi-passwd") == 0) {
+        return text != nullptr && target.setWifiPassword(text);
+    } else if (strncmp(key, "wifi-ssid-", 10) == 0) {
+        // The more networks are numbered from 2 like on the settings page
+        int index = atoi(key + 10) - 1;
+        return text != nullptr && index > 0 && target.setProfileSSID(index, text);
+    } else if (strncmp(key, "wifi-passwd-", 12) == 0) {
+        int index = atoi(key + 12) - 1;
+        return text != nullptr && index > 0 && target.setProfilePassword(index, text);
+    } else if (strcmp(key, "static-ip") == 0) {
+        return text != nullptr && target.setStaticIP(text);
+    } else if (strcmp(key, "static-gateway") == 0) {
+        return text != nullptr && target.setStaticGateway(text);
+    } else if (strcmp(key, "static-subnet") == 0) {
+        return text != nullptr && target.setStaticSubnet(text);
+    } else if (strcmp(key, "static-dns") == 0) {
+        return text != nullptr && target.setStaticDNS(text);
+    } else if (strcmp(key, "broker-ip") == 0) {
+        return text != nullptr && strlen(text) > 0 && target.setMqttIP(text);
+    } else if (strcmp(key, "mqtt-user") == 0) {
+        return text != nullptr && target.setMqttUsername(text);
+    } else if (strcmp(key, "mqtt-passwd") == 0) {
+        return text != nullptr && target.setMqttPassword(text);
+    } else if (strcmp(key, "mqtt-topic") == 0) {
+        return text != nullptr && strlen(text) > 0 && target.setMqttTopic(text);
+    }
 
-    mqttClient.setServer(config.getMqttIP(), config.getMqttPort());
-    if (!mqttClient.connect(config.getHostname(), config.getMqttUsername(), config.getMqttPassword())) {
-        Serial.print("[MQTT] Connection to broker failed. Reconnecting in 15 seconds! Error code is:");
-        Serial.println(mqttClient.state());
+    // Numbers, given like on the settings page. They are checked against the bounds of the page before they are narrowed
+    if (!value.is<float>() && !value.is<long>()) {
         return false;
-    } else {
-        Serial.println("[MQTT] Connected to MQTT broker");
-        return true;
     }
+    float number = value.as<float>();
+    if (strcmp(key, "mqtt-port") == 0) {
+        return isWhole(number, 1, 65535) && target.setMqttPort(number);
+    } else if (strcmp(key, "mqtt-delay") == 0) {
+        return isWhole(number, 1, 65535) && target.setMessageDelay(number);
+    } else if (strcmp(key, "payload-format") == 0) {
+        return isWhole(number, 0, PAYLOAD_FORMAT_COUNT - 1) && target.setPayloadFormat(number);
+    } else if (strcmp(key, "temp-correction") == 0) {
+        return number >= -10 && number <= 10 && target.setTempOffset(lroundf(number * 100));
+    } else if (strcmp(key, "temp-gain") == 0) {
+        return number >= 0.5f && number <= 2 && target.setTempGain(lroundf(number * 1000));
+    } else if (strcmp(key, "filter-oversample") == 0) {
+        return isWhole(number, 1, FILTER_MAX_OVERSAMPLE) && target.setFilterOversample(number);
+    } else if (strcmp(key, "filter-median") == 0) {
+        return isWhole(number, 1, FILTER_MAX_MEDIAN) && target.setFilterMedian(number);
+    } else if (strcmp(key, "filter-smoothing") == 0) {
+        return isWhole(number, 1, 100) && target.setFilterSmoothing(number);
+    } else if (strcmp(key, "filter-spike-temp") == 0) {
+        return number >= 0 && number <= 655 && target.setFilterSpikeTemp(lroundf(number * 100));
+    } else if (strcmp(key, "filter-spike-humidity") == 0) {
+        return number >= 0 && number <= 655 && target.setFilterSpikeHumidity(lroundf(number * 100));
+    } else if (strcmp(key, "report-deadband-temp") == 0) {
+        return number >= 0 && number <= 655 && target.setReportDeadbandTemp(lroundf(number * 100));
+    } else if (strcmp(key, "report-deadband-humidity") == 0) {
+        return number >= 0 && number <= 655 && target.setReportDeadbandHumidity(lroundf(number * 100));
+    } else if (strcmp(key, "report-heartbeat") == 0) {
+        return isWhole(number, 0, 65535) && target.setReportHeartbeat(number);
+    } else if (strcmp(key, "topic-layout") == 0) {
+        return isWhole(number, TOPIC_LAYOUT_CUSTOM, TOPIC_LAYOUT_DEVICE) && target.setTopicLayout(number);
+    } else if (strcmp(key, "ha-discovery") == 0) {
+        return isWhole(number, 0, 1) && target.setDiscovery(number != 0);
+    } else if (strcmp(key, "wifi-priority") == 0) {
+        return isWhole(number, -100, 100) && target.setProfilePriority(0, number);
+    } else if (strncmp(key, "wifi-priority-", 14) == 0) {
+        int index = atoi(key + 14) - 1;
+        return isWhole(number, -100, 100) && index > 0 && target.setProfilePriority(index, number);
+    } else if (strcmp(key, "wifi-roam-rssi") == 0) {
+        return isWhole(number, -100, 0) && target.setRoamRSSI(number);
+    }
+
+    return false;
 }
 
 /**
- * Publishes temperature and humidity as JSON object to the MQTT broker.
- * 
- * @param temperature The temperature to send (in degrees) 
- * @param humidity The humidty value to send (in percent)
-*/
-bool publishMQTTData(float temperature, float humidity) {
-    StaticJsonBuffer<200> jsonBuffer;
-    JsonObject &jObj = jsonBuffer.createObject();
-
-    jObj["temperature"] = (String)temperature;
-    jObj["humidity"] = (String)humidity;
+ * Checks a number for a setting which is stored as an integer, before it is narrowed to its field.
+ *
+ * @return True if the number is a whole number between min and max
+ */
+bool isWhole(float number, long min, long max) {
+    return number >= min && number <= max && number == floorf(number);
+}
 
-    char data[200];
-    jObj.printTo(data, jObj.measureLength() + 1);
+/**
+ * Compares two configs.
+ *
+ * @return The parts which differ, see CHANGE_*
+ */
+uint8_t findChanges(Config &current, Config &updated) {
+    uint8_t changes = 0;
 
-    lastMQTTPublish = millis();
+    if (current.getMessageDelay() != updated.getMessageDelay()) {
+        changes |= CHANGE_SENSORS;
+    }
+    if (current.getTempOffset() != updated.getTempOffset() || current.getTempGain() != updated.getTempGain() ||
+        current.getFilterOversample() != updated.getFilterOversample() || current.getFilterMedian() != updated.getFilterMedian() ||
+        current.getFilterSmoothing() != updated.getFilterSmoothing() || current.getFilterSpikeTemp() != updated.getFilterSpikeTemp() ||
+        current.getFilterSpikeHumidity() != updated.getFilterSpikeHumidity()) {
+        changes |= CHANGE_FILTERS;
+    }
+    if (current.getReportDeadbandTemp() != updated.getReportDeadbandTemp() || current.getReportDeadbandHumidity() != updated.getReportDeadbandHumidity() ||
+        current.getReportHeartbeat() != updated.getReportHeartbeat()) {
+        changes |= CHANGE_REPORT;
+    }
+    if (current.getPayloadFormat() != updated.getPayloadFormat()) {
+        changes |= CHANGE_FORMAT;
+    }
+    if (strcmp(current.getMqttTopic(), updated.getMqttTopic()) != 0 || current.getTopicLayout() != updated.getTopicLayout()) {
+        changes |= CHANGE_TOPIC;
+    }
+    if (current.getDiscovery() != updated.getDiscovery()) {
+        changes |= CHANGE_DISCOVERY;
+    }
+    if (strcmp(current.getMqttIP(), updated.getMqttIP()) != 0 || current.getMqttPort() != updated.getMqttPort() ||
+        strcmp(current.getMqttUsername(), updated.getMqttUsername()) != 0 || strcmp(current.getMqttPassword(), updated.getMqttPassword()) != 0) {
+        changes |= CHANGE_MQTT;
+    }
+    if (strcmp(current.getStaticIP(), updated.getStaticIP()) != 0 || strcmp(current.getStaticGateway(), updated.getStaticGateway()) != 0 ||
+        strcmp(current.getStaticSubnet(), updated.getStaticSubnet()) != 0 || strcmp(current.getStaticDNS(), updated.getStaticDNS()) != 0 ||
+        current.getRoamRSSI() != updated.getRoamRSSI()) {
+        changes |= CHANGE_WIFI;
+    }
+    for (uint8_t i = 0; i < WIFI_PROFILE_COUNT; i++) {
+        if (strcmp(current.getProfileSSID(i), updated.getProfileSSID(i)) != 0 || strcmp(current.getProfilePassword(i), updated.getProfilePassword(i)) != 0 ||
+            current.getProfilePriority(i) != updated.getProfilePriority(i)) {
+            changes |= CHANGE_WIFI;
+        }
+    }
 
-    if (mqttClient.connected() && !mqttClient.publish(config.getMqttTopic(), data, true)) {
-        Serial.print("[MQTT] Publishing sensor data failed due to error: ");
-        Serial.println(mqttClient.getWriteError());
+    return changes;
+}
 
-        yield();
-        return false;
-    } else {
-        yield();
-        return true;
+/**
+ * Publishes the reply to a command, if the broker is connected.
+ */
+void sendReply(JsonObject &reply) {
+    if (!mqttClient.connected()) {
+        return;
     }
+
+    char message[REPLY_MESSAGE_SIZE];
+    reply.printTo(message, sizeof(message));
+    mqttClient.publish(replyTopic, 1, false, message);
 }
 
 /**
- * If its time for it, publishes the data to the mqtt broker
+ * Announces the values of all sensors to Home Assistant with retained config messages.
+ * Sent once after the power on or a config change, the broker keeps them for later connects.
+ * If the connection can not take all messages right now, they are sent again in the next run.
  */
-void sendMQTTData() {
-    // Publish mqtt packets every ? seconds
-    if (millis() > lastMQTTPublish + (config.getMessageDelay() * 1000)) {
-        float humidity = dht.readHumidity();
-        float temp = dht.readTemperature() + config.getTempCorrection();
+void sendDiscovery() {
+    if (!mqttClient.connected()) {
+        return;
+    }
+    if (payloadEncoder.isBinary()) {
+        LOG_WARN("MQTT", "Home Assistant can not read binary payloads, skipping discovery");
+        discoveryPending = false;
+        return;
+    }
 
-        if (isnan(humidity) || isnan(temp)) {
-            Serial.println("[DHT] Failed to read from DHT sensor!");
+    for (uint8_t id = 0; id < sensors.size(); id++) {
+        if (!sendDiscoveryValue(id, "temperature", "\u00b0C")) {
+            return;
+        }
+        if (sensors.getSensor(id)->hasHumidity() && !sendDiscoveryValue(id, "humidity", "%")) {
             return;
-        } else {
-            publishMQTTData(temp, humidity);
         }
     }
-}
\ No newline at end of file
+
+    discoveryPending = false;
+    rtcState.setDiscoverySent(true);
+    rtcState.save();
+    LOG_INFO("MQTT", "Sent Home Assistant discovery");
+}
+
+/**
+ * Publishes the discovery message of one value of a sensor, using the abbreviated keys of Home Assistant.
+ *
+ * @param value The key of the value in the sample payload, also used as device class
+ * @return False if the connection could not take the message
+ */
+bool sendDiscoveryValue(uint8_t id, const char *value, const char *unit) {
+    const char *host = config.getHostname();
+    const char *sensor = getSensorKey(id);
+
+    char topic[MQTT_TOPIC_SIZE];
+    char name[96];
+    char uniqueId[96];
+    char valueTemplate[48];
+    snprintf(topic, sizeof(topic), "%s/sensor/%s/%s_%s/config", DISCOVERY_PREFIX, host, sensor, value);
+    snprintf(name, sizeof(name), "%s %s %s", host, sensor, value);
+    snprintf(uniqueId, sizeof(uniqueId), "%s_%s_%s", host, sensor, value);
+    snprintf(valueTemplate, sizeof(valueTemplate), "{{ value_json.%s }}", value);
+
+    StaticJsonBuffer<JSON_OBJECT_SIZE(10) + JSON_OBJECT_SIZE(4) + JSON_ARRAY_SIZE(1)> jsonBuffer;
+    JsonObject &message = jsonBuffer.createObject();
+    message["name"] = (const char *)name;
+    message["uniq_id"] = (const char *)uniqueId;
+    message["stat_t"] = (const char *)sampleTopics[id];
+    message["val_tpl"] = (const char *)valueTemplate;
+    message["unit_of_meas"] = unit;
+    message["dev_cla"] = value;
+    message["stat_cla"] = "measurement";
+#ifdef DEEP_SLEEP
+    // A sleeping device has no availability, its values expire after three missed wakeups
+    message["exp_aft"] = config.getMessageDelay() * 3UL;
+#else
+    message["avty_t"] = (const char *)statusTopic;
+#endif
+    JsonObject &device = message.createNestedObject("dev");
+    device.createNestedArray("ids").add(host);
+    device["name"] = host;
+    device["mdl"] = "ESP8266 MQTT thermometer";
+    device["mf"] = "DIY";
+
+    char payload[DISCOVERY_MESSAGE_SIZE];
+    if (message.measureLength() >= sizeof(payload)) {
+        LOG_WARN("MQTT", "Discovery message of %s is too long", uniqueId);
+        return true;
+    }
+    message.printTo(payload, sizeof(payload));
+    return mqttClient.publish(topic, 1, true, payload) != 0;
+}
+
+/**
+ * Initialises and starts the acces point mode
+ */
+void initApMode() {
+    WiFi.softAPConfig(IPAddress(192, 168, 1, 1), IPAddress(192, 168, 1, 1), IPAddress(255, 255, 255, 0));
+    const char *host = config.isValid() ? config.getHostname() : DEFAULT_HOST;
+    WiFi.softAP(host);
+    delay(500);
+    WiFi.mode(WIFI_AP_STA);
+    LOG_INFO("WIFI", "Starting access point mode with ssid: '%s'", host);
+}
+
+/**
+ * Initialieses and starts the DNS server and the MDNS responder.
+ * Only has to be called on startup.
+ */
+void initDNSServer() {
+    /* Setup the DNS server redirecting all the domains to the apIP */
+    dnsServer.setErrorReplyCode(DNSReplyCode::NoError);
+    dnsServer.start(53, "*", WiFi.softAPIP());
+
+    // MDNS setup
+    const char *host = config.isValid() ? config.getHostname() : DEFAULT_HOST;
+    MDNS.begin(host);
+    MDNS.addService("http", "tcp", 80);
+
+    LOG_INFO("DNS", "DNS server and MDNS started");
+    LOG_INFO("DNS", "Hostname is set to: '%s'", host);
+}
+
+/**
+ * Initialises and starts the webserver.
+ * Only has to be called on startup.
+ */
+void initWebServer() {
+    webServer.on("/", onHTTPRequest);
+    webServer.on("/settings.json", onSettingsRequest);
+    webServer.on("/metrics", onMetricsRequest);
+    webServer.on("/history", onHistoryRequest);
+    webServer.on("/live", onLiveRequest);
+
+    // Further clients of the live page are turned away before anything is allocated for them
+    liveEvents.setFilter([](AsyncWebServerRequest *request) { return liveEvents.count() < LIVE_MAX_CLIENTS; });
+    liveEvents.onConnect(onLiveConnect);
+    webServer.addHandler(&liveEvents);
+    webServer.on("/events", [](AsyncWebServerRequest *request) { request->send(503, "text/plain", "Too many live clients"); });
+    webServer.on("/config", onReceivedConfig);
+    webServer.on("/rst", onReceivedReset);
+    webServer.on("/update", HTTP_POST, onReceivedUpdate, onUpdateUpload);
+
+    // Connectivity checks of the operating systems and any other page are redirected to the config page
+    captivePortal.begin(webServer, WiFi.softAPIP());
+
+    webServer.begin();
+
+    LOG_INFO("WEBSERVER", "Webserver started");
+}
+
+/**
+ * Callback function for the http server.
+ * Sends the config page. It is stored gzipped in flash and sent as it is, the browser unpacks it.
+ * The page loads the current config from /settings.json.
+ */
+void onHTTPRequest(AsyncWebServerRequest *request) {
+    AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", wifi_settings_html_gz, wifi_settings_html_gz_len);
+    response->addHeader("Content-Encoding", "gzip");
+    request->send(response);
+
+    LOG_DEBUG("WEBSERVER", "Responded to http client: %s", IPAddress(request->client()->getRemoteAddress()).toString().c_str());
+}
+
+/**
+ * Callback function for the http server.
+ * Sends the current config as JSON object, the keys are the names of the inputs of the config page.
+ */
+void onSettingsRequest(AsyncWebServerRequest *request) {
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    printSettingsJson(config, *response);
+    request->send(response);
+}
+
+/**
+ * Callback function for the http server.
+ * Sends the counters of the device in the prometheus text format.
+ */
+void onMetricsRequest(AsyncWebServerRequest *request) {
+    AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+    captivePortal.printMetrics(*response);
+    metrics.printMetrics(*response);
+    printSensorMetrics(*response);
+    publisher.printMetrics(*response);
+    request->send(response);
+}
+
+/**
+ * Callback function for the http server.
+ * Sends the live page, stored gzipped in flash like the config page. It receives the data over /events.
+ */
+void onLiveRequest(AsyncWebServerRequest *request) {
+    AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", live_html_gz, live_html_gz_len);
+    response->addHeader("Content-Encoding", "gzip");
+    request->send(response);
+}
+
+/**
+ * Called when a browser opened the live page. Sends it the names of the sensors, the samples follow as they are taken.
+ */
+void onLiveConnect(AsyncEventSourceClient *client) {
+    char message[LIVE_SENSORS_SIZE];
+    size_t length = snprintf(message, sizeof(message), "[");
+    for (uint8_t id = 0; id < sensors.size() && length < sizeof(message); id++) {
+        length += snprintf(message + length, sizeof(message) - length, "%s{\"id\":%u,\"name\":\"%s\"}", id > 0 ? "," : "", id, getSensorKey(id));
+    }
+    if (length + 1 >= sizeof(message)) {
+        return;
+    }
+    strcpy(message + length, "]");
+
+    client->send(message, "sensors", millis());
+}
+
+/**
+ * Pushes a new sample once to all browsers on the live page. Nothing is encoded without a browser.
+ */
+void sendLiveSample(const Sample &sample) {
+    if (liveEvents.count() == 0) {
+        return;
+    }
+
+    char line[HISTORY_LINE_SIZE];
+    size_t length = payloadEncoder.encodeLine(sample, false, line, sizeof(line));
+    if (length == 0) {
+        return;
+    }
+    // An event ends with an empty line, the line break of the NDJSON line is not needed
+    line[length - 1] = '\0';
+    liveEvents.send(line, "sample", millis());
+}
+
+/**
+ * Callback function for the http server.
+ * Streams the recent samples, oldest first, as CSV or with ?format=ndjson as one JSON object per line.
+ * The samples are written in chunks as the connection takes them, the history is never copied.
+ */
+void onHistoryRequest(AsyncWebServerRequest *request) {
+    bool csv = !request->hasParam("format") || request->getParam("format")->value() != "ndjson";
+
+    // Positions are counted over all samples ever added, samples overwritten while streaming are skipped
+    uint32_t next = history.getDropped();
+    uint32_t end = history.getDropped() + history.size();
+    bool header = csv;
+
+    AsyncWebServerResponse *response = request->beginChunkedResponse(
+        csv ? "text/csv" : "application/x-ndjson", [csv, next, end, header](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+            size_t length = 0;
+            if (header && maxLen >= strlen(PAYLOAD_CSV_HEADER)) {
+                length = strlen(PAYLOAD_CSV_HEADER);
+                memcpy(buffer, PAYLOAD_CSV_HEADER, length);
+                header = false;
+            }
+
+            char line[HISTORY_LINE_SIZE];
+            while (next < end) {
+                uint32_t first = history.getDropped();
+                if (next < first) {
+                    next = first;
+                    continue;
+                }
+
+                size_t written = payloadEncoder.encodeLine(history.peek(next - first), csv, line, sizeof(line));
+                if (length + written > maxLen) {
+                    break;
+                }
+                memcpy(buffer + length, line, written);
+                length += written;
+                next++;
+            }
+
+            // Nothing fits right now, but the response is not done yet
+            if (length == 0 && (next < end || header)) {
+                return RESPONSE_TRY_AGAIN;
+            }
+            return length;
+        });
+    request->send(response);
+}
+
+/**
+ * Prints the read failures of the sensors and the counters of the report filters in the prometheus text format.
+ */
+void printSensorMetrics(Print &out) {
+    out.print("# TYPE sensor_read_failures_total counter\n");
+    for (uint8_t id = 0; id < sensors.size(); id++) {
+        out.printf("sensor_read_failures_total{sensor=\"%u\",type=\"%s\"} %lu\n", id, sensors.getSensor(id)->getName(), (unsigned long)sensors.getFailures(id));
+    }
+    out.print("# TYPE samples_reported_total counter\n");
+    for (uint8_t id = 0; id < sensors.size(); id++) {
+        out.printf("samples_reported_total{sensor=\"%u\",type=\"%s\"} %lu\n", id, sensors.getSensor(id)->getName(), (unsigned long)reportFilters[id].getReported());
+    }
+    out.print("# TYPE samples_suppressed_total counter\n");
+    for (uint8_t id = 0; id < sensors.size(); id++) {
+        out.printf("samples_suppressed_total{sensor=\"%u\",type=\"%s\"} %lu\n", id, sensors.getSensor(id)->getName(), (unsigned long)reportFilters[id].getSuppressed());
+    }
+}
+
+/**
+ * Callback function for the http server.
+ * Reacts to http requests containing config information.
+ * Checks the config and if its valid, saves the config and restarts the esp.
+ */
+void onReceivedConfig(AsyncWebServerRequest *request) {
+    // The fields of the settings page are checked like the keys of a command, an invalid field rejects the config as a whole
+    const char *const textFields[] = {"wifi-ssid", "wifi-passwd", "static-ip", "static-gateway", "static-subnet", "static-dns", "broker-ip", "mqtt-user",
+                                      "mqtt-passwd", "mqtt-topic", "wifi-ssid-2", "wifi-passwd-2", "wifi-ssid-3", "wifi-passwd-3"};
+    const char *const numberFields[] = {"mqtt-port", "mqtt-delay", "payload-format", "temp-correction", "temp-gain", "filter-oversample", "filter-median",
+                                        "filter-smoothing", "filter-spike-temp", "filter-spike-humidity", "report-deadband-temp",
+                                        "report-deadband-humidity", "report-heartbeat", "topic-layout", "ha-discovery", "wifi-priority",
+                                        "wifi-priority-2", "wifi-priority-3", "wifi-roam-rssi"};
+
+    Config newConfig;
+    bool accepted = newConfig.setHostname((char *)request->arg("host").c_str());
+    for (const char *field : textFields) {
+        accepted &= setConfigValue(newConfig, field, request->arg(field).c_str());
+    }
+    for (const char *field : numberFields) {
+        // An empty or malformed field is refused, toInt() would have turned it into 0
+        const String &text = request->arg(field);
+        char *end;
+        float number = strtof(text.c_str(), &end);
+        accepted &= text.length() > 0 && *end == '\0' && setConfigValue(newConfig, field, number);
+    }
+
+    if (accepted && newConfig.isValid() && newConfig.saveConfig()) {
+        AsyncWebServerResponse *response = request->beginResponse(200, "text/html", "<h1>OK saved new config! Restarting in 3 seconds...</h1> <p> You are redirected automatically in 8 seconds</p>");
+        String url = String("url=http://") + String(config.getHostname()) + String(".local");
+        response->addHeader("refresh", "8;" + url);
+        request->send(response);
+
+        LOG_INFO("ESP", "Saved new config. Restarting in 3 seconds...");
+
+        // The network, the broker or the topics might have changed
+        rtcState.clearNetwork();
+        rtcState.clearBrokerIP();
+        rtcState.setDiscoverySent(false);
+        rtcState.save();
+
+        //Runs the code in 3 seconds
+        schedule_function(
+            []() {
+                journal.sync();
+                logger.flush(Serial);
+                delay(3000);
+                ESP.restart();
+            });
+
+    } else {
+        LOG_WARN("ESP", "Received bad config. Ignoring it!");
+
+        AsyncWebServerResponse *response = request->beginResponse(200, "text/html", "<h1>An error occured...please go back to where you came from.</h1><p>You are redirected automatically in 5 seconds</p>");
+        String url = String("url=http://") + String(config.getHostname()) + String(".local");
+        response->addHeader("refresh", "5;" + url);
+        request->send(response);
+    }
+}
+
+/**
+ * Callback function for the http server.
+ * Reacts to http respnses, responding a reset.
+ * Resets the flash memory and resrarts the esp.
+ */
+void onReceivedReset(AsyncWebServerRequest *request) {
+    AsyncWebServerResponse *response = request->beginResponse(200, "text/html", "<h1>Resetting device in 3 seconds!</h1><p>You are redirected automatically in 8 seconds</p>");
+    String url = String("url=http://") + String(DEFAULT_HOST) + String(".local");
+    response->addHeader("refresh", "8;" + url);
+    request->send(response);
+
+    LOG_INFO("ESP", "Resetted flash. Restarting in 3 seconds...");
+
+    //Runs the code in 3 seconds
+    schedule_function(
+        []() {
+            config.eraseConfigFlash();
+            journal.sync();
+            logger.flush(Serial);
+            delay(3000);
+            ESP.restart();
+        });
+}
+
+/**
+ * Callback function for the http server, called after the firmware upload to /update.
+ * The image was written while it was received, so only the result is left to answer.
+ */
+void onReceivedUpdate(AsyncWebServerRequest *request) {
+    if (ota.hasFailed() || ota.isRunning()) {
+        request->send(500, "text/html", "<h1>Firmware update failed!</h1><p>Please check the file and the MD5 digest.</p>");
+        return;
+    }
+
+    AsyncWebServerResponse *response = request->beginResponse(200, "text/html", "<h1>Firmware updated! Restarting in 3 seconds...</h1> <p> You are redirected automatically in 15 seconds</p>");
+    String url = String("url=http://") + String(config.isValid() ? config.getHostname() : DEFAULT_HOST) + String(".local");
+    response->addHeader("refresh", "15;" + url);
+    request->send(response);
+}
+
+/**
+ * Callback function for the http server, called for every part of the uploaded firmware.
+ * The parts are written to the flash directly, at no time more than one part is in RAM.
+ * The MD5 digest is taken from the header X-MD5 or the form field md5 in front of the file, an upload without it is refused.
+ */
+void onUpdateUpload(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t length, bool final) {
+    if (index == 0) {
+        const char *md5 = "";
+        if (request->hasHeader("X-MD5")) {
+            md5 = request->getHeader("X-MD5")->value().c_str();
+        } else if (request->hasParam("md5", true)) {
+            md5 = request->getParam("md5", true)->value().c_str();
+        }
+        LOG_INFO("OTA", "Receiving firmware '%s'", filename.c_str());
+        if (ota.beginUpload(md5)) {
+            // A partial image of a client which went away is discarded
+            request->onDisconnect([]() { ota.abort(); });
+        }
+    }
+
+    if (length > 0) {
+        ota.writeUpload(data, length);
+    }
+    if (final) {
+        ota.endUpload();
+    }
+}
+
+/**
+ * Hands the known networks of the config to the selector.
+ */
+void initWiFiProfiles() {
+    wifiSelector.clearProfiles();
+    for (uint8_t i = 0; i < WIFI_PROFILE_COUNT; i++) {
+        wifiSelector.addProfile(i, config.getProfileSSID(i), config.getProfilePriority(i));
+    }
+    wifiSelector.setRoamThreshold(config.getRoamRSSI());
+}
+
+/**
+ * Connect the esp to wifi.
+ * Tries a fast join with the cached access point first and falls back to a scan if it does not finish in time.
+ * While connected, a better access point is searched if the signal stays weak.
+ * 
+ * @return True if WiFi is connected. False if WiFi is disconnected.
+ */
+bool connectWiFi() {
+    if (!config.isValid()) {
+        return false;
+    }
+
+    // If already connected, return true
+    if (WiFi.status() == WL_CONNECTED) {
+        updateRoaming();
+        return true;
+    }
+    wifiRoamScan = false;
+
+    // The roam did not finish in time, fall back like on any other lost connection
+    if (wifiRoaming && millis() - wifiJoinStart >= FULL_CONNECT_TIMEOUT) {
+        LOG_WARN("WIFI", "Roaming failed");
+        wifiRoaming = false;
+        startApFallback();
+    }
+
+    // Join the best access point when the scan is done
+    if (wifiJoin == WIFI_JOIN_SCAN) {
+        if (wifiScanner.getResultCount() != WIFI_SCANNER_RUNNING || millis() - wifiJoinStart >= WIFI_SCAN_TIMEOUT) {
+            joinScanned();
+        }
+        return false;
+    }
+
+    // The cached access point is gone or changed its channel, scan without waiting for the backoff
+    if (wifiJoin == WIFI_JOIN_FAST && millis() - wifiJoinStart >= FAST_CONNECT_TIMEOUT) {
+        LOG_WARN("WIFI", "Fast connect failed, scanning");
+        rtcState.clearNetwork();
+        rtcState.save();
+        WiFi.disconnect();
+        startScan();
+        return false;
+    }
+
+    // Check if its time to connect. If not return false, because WiFi can not be connected at this point
+    if (!wifiBackoff.ready(millis())) {
+        return false;
+    }
+
+    if (rtcState.hasNetwork()) {
+        beginWiFi(true);
+    } else {
+        startScan();
+    }
+
+    // Counts as failure until wifiOnConnect reports success
+    wifiBackoff.failed(millis());
+
+    // The connection is established in the background, wifiOnConnect is called when it is done
+    return false;
+}
+
+/**
+ * Sets the IP configuration of the station. A static IP of the config always wins over the cached lease.
+ *
+ * @param useCache Use the IP leased in the last connection instead of DHCP
+ * @return True if DHCP is skipped
+ */
+bool configureIP(bool useCache) {
+    IPAddress ip, gateway, subnet, dns;
+
+    if (ip.fromString(config.getStaticIP())) {
+        if (gateway.fromString(config.getStaticGateway()) && subnet.fromString(config.getStaticSubnet())) {
+            if (!dns.fromString(config.getStaticDNS())) {
+                dns = gateway;
+            }
+            return WiFi.config(ip, gateway, subnet, dns);
+        }
+        LOG_WARN("WIFI", "Static IP needs a gateway and a subnet mask, using DHCP");
+    } else if (useCache && rtcState.hasNetwork()) {
+        return WiFi.config(rtcState.getIP(), rtcState.getGateway(), rtcState.getSubnet(), rtcState.getDNS());
+    }
+
+    WiFi.config(IPAddress(), IPAddress(), IPAddress());
+    return false;
+}
+
+/**
+ * Starts joining the access point cached in the RTC state, or the first network if there is none. Does not wait for it.
+ *
+ * @param fast Join the access point cached in the RTC state directly, without a scan
+ */
+void beginWiFi(bool fast) {
+    uint8_t profile = rtcState.getProfile();
+    fast = fast && rtcState.hasNetwork() && profile < WIFI_PROFILE_COUNT && strlen(config.getProfileSSID(profile)) > 0;
+
+    if (fast) {
+        joinWiFi(profile, rtcState.getBSSID(), rtcState.getChannel(), true);
+    } else {
+        joinWiFi(0, nullptr, 0, false);
+    }
+}
+
+/**
+ * Starts joining a network, does not wait for it.
+ *
+ * @param bssid The access point to join, nullptr to let the WiFi stack choose
+ * @param fast Use the IP cached in the RTC state
+ */
+void joinWiFi(uint8_t profile, const uint8_t *bssid, uint8_t channel, bool fast) {
+    configureIP(fast);
+
+    LOG_INFO("WIFI", "Connecting to WiFi: %s%s", config.getProfileSSID(profile), fast ? " (cached access point)" : "");
+    WiFi.begin(config.getProfileSSID(profile), config.getProfilePassword(profile), channel, bssid);
+
+    // A join after a scan is timed from the start of the scan
+    if (wifiJoin != WIFI_JOIN_SCAN) {
+        wifiJoinStart = millis();
+    }
+    wifiJoin = fast ? WIFI_JOIN_FAST : WIFI_JOIN_FULL;
+    wifiProfile = profile;
+    wifiAssociated = 0;
+}
+
+/**
+ * Starts a scan for the access points of the known networks, joinScanned() picks one when it is done.
+ * If the scan can not be started, the first network is joined right away.
+ */
+void startScan() {
+    wifiJoin = WIFI_JOIN_NONE;
+    if (!wifiScanner.start()) {
+        LOG_WARN("WIFI", "Could not start scan");
+        beginWiFi(false);
+        return;
+    }
+
+    wifiJoin = WIFI_JOIN_SCAN;
+    wifiJoinStart = millis();
+}
+
+/**
+ * Joins the best access point found by the scan. Without a known network in range, the first network is joined anyway,
+ * it might be hidden from the scan.
+ */
+void joinScanned() {
+    WiFiCandidate best;
+    bool found = wifiScanner.getResultCount() > 0 && wifiSelector.select(wifiScanner, best);
+    wifiScanner.clear();
+
+    if (found) {
+        LOG_INFO("WIFI", "Best access point %02x:%02x:%02x:%02x:%02x:%02x with %d dBm", best.bssid[0], best.bssid[1], best.bssid[2], best.bssid[3],
+                 best.bssid[4], best.bssid[5], best.rssi);
+        joinWiFi(best.profile, best.bssid, best.channel, false);
+    } else {
+        LOG_WARN("WIFI", "No known network found by the scan");
+        joinWiFi(0, nullptr, 0, false);
+    }
+}
+
+/**
+ * Searches a better access point while the signal of the connection stays weak and switches to it.
+ * The station stays connected during the scan.
+ */
+void updateRoaming() {
+    if (!wifiRoamScan) {
+        if (wifiSelector.checkRoam(WiFi.RSSI(), millis())) {
+            LOG_INFO("WIFI", "Weak signal of %d dBm, searching a better access point", WiFi.RSSI());
+            wifiRoamScan = wifiScanner.start();
+        }
+        return;
+    }
+
+    if (wifiScanner.getResultCount() == WIFI_SCANNER_RUNNING) {
+        return;
+    }
+    wifiRoamScan = false;
+
+    WiFiCandidate best;
+    bool found = wifiScanner.getResultCount() > 0 && wifiSelector.select(wifiScanner, best);
+    wifiScanner.clear();
+
+    if (found && wifiSelector.shouldRoam(best, WiFi.BSSID(), WiFi.RSSI())) {
+        LOG_INFO("WIFI", "Roaming from %d dBm to %d dBm", WiFi.RSSI(), best.rssi);
+        metrics.countWiFiRoam();
+        rtcState.clearNetwork();
+        rtcState.save();
+        wifiRoaming = true;
+        joinWiFi(best.profile, best.bssid, best.channel, false);
+        // Gives the join time before the WiFi task starts another one
+        wifiBackoff.failed(millis());
+    }
+}
+
+/**
+ * Callback to be called when WiFi disconnects.
+ * This reenables the acces point mode, unless the station is roaming to another access point.
+ */
+void wifiOnDisconnect(const WiFiEventStationModeDisconnected &event) {
+    if (!wifiRoaming) {
+        startApFallback();
+    }
+}
+
+/**
+ * Opens the access point mode, if it is not open yet, to configure the device while there is no WiFi.
+ */
+void startApFallback() {
+    if (WiFi.getMode() != WIFI_AP_STA) {
+        //Runs the code when its time for it
+        schedule_function(
+            []() {
+                LOG_WARN("WIFI", "WiFi disconnected!");
+                initApMode();
+                MDNS.notifyAPChange();
+            });
+    }
+}
+
+/**
+ * Callback to be called when the station associated with the access point, before it has an IP.
+ */
+void wifiOnAssociate(const WiFiEventStationModeConnected &event) {
+    if (wifiJoin != WIFI_JOIN_NONE && wifiAssociated == 0) {
+        wifiAssociated = millis();
+        metrics.observeWiFiAssociate(wifiJoin == WIFI_JOIN_FAST, wifiAssociated - wifiJoinStart);
+    }
+}
+
+/**
+ * Callback to be called when WiFi connects.
+ * This closes the acces point.
+ */
+void wifiOnConnect(const WiFiEventStationModeGotIP &event) {
+    LOG_INFO("WIFI", "Connected to WiFi: %s", WiFi.SSID().c_str());
+    LOG_INFO("NETWORK", "Got IPv4: %s", WiFi.localIP().toString().c_str());
+
+    wifiBackoff.reset();
+    wifiRoaming = false;
+
+    if (wifiJoin != WIFI_JOIN_NONE) {
+        unsigned long now = millis();
+        metrics.observeWiFiConnect(wifiJoin == WIFI_JOIN_FAST, wifiAssociated != 0 ? now - wifiAssociated : 0, now - wifiJoinStart);
+        LOG_INFO("WIFI", "Joined in %lu ms", now - wifiJoinStart);
+        wifiJoin = WIFI_JOIN_NONE;
+    }
+
+    // Remember the access point and the lease for the next join
+    rtcState.setNetwork(wifiProfile, WiFi.BSSID(), WiFi.channel(), WiFi.localIP(), WiFi.gatewayIP(), WiFi.subnetMask(), WiFi.dnsIP());
+    rtcState.save();
+    wifiSelector.resetRoam(millis());
+
+    MDNS.notifyAPChange();
+    WiFi.mode(WIFI_STA); //close AP network
+    LOG_INFO("WIFI", "Disabling access point mode");
+}
+
+/**
+ * Starts a connection to the mqtt broker, if it is time for it. Does not wait for the connection.
+ *
+ * @return True if the broker is connected
+ */
+bool connectMQTT() {
+    // MQTT is already connected
+    if (mqttClient.connected()) {
+        return true;
+    }
+
+    // A connection is on the way, give up on it if the broker does not answer
+    if (mqttConnectTimeout.isArmed()) {
+        if (mqttConnectTimeout.expired(millis())) {
+            LOG_WARN("MQTT", "Connection to broker timed out");
+            mqttConnectTimeout.clear();
+            mqttClient.disconnect(true);
+        }
+        return false;
+    }
+
+    // MQTT is not connected, but its not time to try to connect it
+    if (!mqttBackoff.ready(millis())) {
+        return false;
+    }
+
+    LOG_INFO("MQTT", "Connecting to MQTT broker %s", config.getMqttIP());
+
+    // Counts as failure until mqttOnConnect reports success
+    mqttBackoff.failed(millis());
+    mqttConnectStart = millis();
+    mqttConnectTimeout.set(mqttConnectStart, MQTT_CONNECT_TIMEOUT);
+    mqttClient.connect();
+
+    return false;
+}
+
+/**
+ * Callback to be called when the broker accepted the connection.
+ */
+void mqttOnConnect(bool sessionPresent) {
+    mqttConnectTimeout.clear();
+    metrics.observeMqttConnect(millis() - mqttConnectStart);
+    mqttBackoff.reset();
+    LOG_INFO("MQTT", "Connected to MQTT broker");
+
+    if (rtcState.isOtaTrial()) {
+        rtcState.endOtaTrial();
+        rtcState.save();
+        otaConfirm.clear();
+        LOG_INFO("OTA", "New firmware reached the broker");
+    }
+
+    discoveryPending = config.getDiscovery() && !rtcState.isDiscoverySent();
+
+#ifndef DEEP_SLEEP
+    // Replaces the last will of a previous connection
+    mqttClient.publish(statusTopic, 1, true, STATUS_ONLINE);
+    mqttClient.subscribe(otaTopic, 1);
+    mqttClient.subscribe(commandTopic, 1);
+#endif
+}
+
+/**
+ * Callback to be called when the connection to the broker is lost or could not be established.
+ * The messages in flight are handed back by the mqtt task.
+ */
+void mqttOnDisconnect(AsyncMqttClientDisconnectReason reason) {
+    bool wasConnecting = mqttConnectTimeout.isArmed();
+    mqttConnectTimeout.clear();
+
+    if (wasConnecting) {
+        LOG_WARN("MQTT", "Connection to broker failed. Reconnecting in %u seconds! Error code is: %d", (unsigned)(mqttBackoff.getCurrentDelay() / 1000), (int)reason);
+    } else {
+        metrics.countMqttDisconnect();
+        LOG_WARN("MQTT", "Disconnected from broker. Error code is: %d", (int)reason);
+    }
+}
+
+/**
+ * Moves the samples which were in flight when the connection was lost into the backlog.
+ */
+void requeueInflight() {
+    if (publisher.isIdle()) {
+        return;
+    }
+
+    Sample unacked[MQTT_INFLIGHT_WINDOW];
+    uint8_t count = publisher.abort(unacked, MQTT_INFLIGHT_WINDOW);
+    for (uint8_t i = 0; i < count; i++) {
+        unacked[i].journal = journalSample(unacked[i]);
+        backlog.push(unacked[i]);
+    }
+}
+
+/**
+ * Task reading the sensors which are due, one sensor access per run.
+ * The readings are kept until the publish task sends them.
+ */
+void sampleSensors() {
+    sensors.update(millis());
+}
+
+/**
+ * Task publishing the new sensor readings to the mqtt broker.
+ */
+void sendMQTTData() {
+    sendReadings();
+}
+
+/**
+ * Task tracking the lowest free heap and publishing the health message of the device.
+ * The health message is sent without retain and QoS 0, a lost one is replaced by the next.
+ */
+void updateHealth() {
+    metrics.sampleHeap();
+
+    if (!healthPublish.expired(millis())) {
+        return;
+    }
+    healthPublish.set(millis(), HEALTH_PUBLISH_PERIOD);
+
+    // The health message goes to the broker and to the live page
+    bool live = liveEvents.count() > 0;
+    if (!mqttClient.connected() && !live) {
+        return;
+    }
+
+    uint32_t failures = 0;
+    for (uint8_t id = 0; id < sensors.size(); id++) {
+        failures += sensors.getFailures(id);
+    }
+
+    char topic[MQTT_TOPIC_SIZE];
+    char message[HEALTH_MESSAGE_SIZE];
+    snprintf(topic, sizeof(topic), "%s/health", getTopicBase());
+    if (metrics.writeHealth(message, sizeof(message), failures, backlog.size()) == 0) {
+        return;
+    }
+    if (live) {
+        liveEvents.send(message, "health", millis());
+    }
+    if (mqttClient.connected()) {
+        mqttClient.publish(topic, 0, false, message);
+    }
+}
+
+/**
+ * Publishes a sample. If the broker is not reachable or too many messages are in flight, it is kept in the backlog instead.
+ *
+ * @return True if the sample was published
+ */
+bool sendSample(Sample &sample) {
+    if (mqttClient.connected() && publisher.publish(sampleTopics[sample.sensor], sample, millis())) {
+        return true;
+    }
+
+    sample.journal = journalSample(sample);
+    backlog.push(sample);
+    return false;
+}
+
+/**
+ * Keeps a sample in the journal until it is published. Its epoch time is stored with it, if known,
+ * so the sample keeps its time over a restart.
+ *
+ * @return The journal sequence of the sample, 0 if it could not be written
+ */
+uint32_t journalSample(Sample sample) {
+    if (sample.epoch == 0) {
+        sampleClock.toEpoch(sample.timestamp, sample.epoch, sample.epochMillis);
+    }
+    return journal.append(sample);
+}
+
+/**
+ * Sends the new readings of all sensors, unless they did not change enough since the last report.
+ *
+ * @return The number of published readings
+ */
+uint8_t sendReadings() {
+    uint8_t published = 0;
+
+    for (uint8_t id = 0; id < sensors.size(); id++) {
+        Sample sample;
+        if (!sensors.take(id, sample)) {
+            continue;
+        }
+
+        history.push(sample);
+        sendLiveSample(sample);
+        if (!reportFilters[id].check(sample)) {
+            continue;
+        }
+
+        if (sendSample(sample)) {
+            published++;
+        }
+    }
+
+    return published;
+}
+
+/**
+ * Publishes the oldest samples of the backlog to the backlog topic, one batch at a time.
+ * The next batch is sent when the broker acknowledged the last one, so a large backlog does not stall the other tasks.
+ */
+void flushBacklog() {
+    if (backlog.isEmpty() || publisher.isBatchInFlight()) {
+        return;
+    }
+
+    // If the connection can not take the batch right now, it is tried again in the next run
+    publisher.publishBatch(backlogTopic, backlog, millis());
+}
+
+#ifdef DEEP_SLEEP
+/**
+ * Runs one deep sleep duty cycle: sample, connect, publish and go back to sleep.
+ * Samples which can not be published are written to the journal and sent in a later cycle.
+ * Does not return, unless WiFi failed in too many cycles in a row.
+ */
+void runDutyCycle() {
+    // Read every sensor once, the conversions of slow sensors run in parallel
+    sensors.triggerAll(millis());
+    while (sensors.isBusy(millis())) {
+        sensors.update(millis());
+        logger.drain(Serial);
+        delay(10);
+    }
+
+    bool wifiConnected = connectWiFiFast();
+    rtcState.countWake(wifiConnected);
+
+    if (wifiConnected && connectMQTTFast()) {
+        // SNTP usually answered by now, otherwise the samples carry the estimated time
+        updateTime();
+        if (discoveryPending) {
+            sendDiscovery();
+        }
+        if (sendReadings() > 0 && waitForAcks(MQTT_ACK_TIMEOUT)) {
+            rtcState.countPublish(millis());
+            LOG_INFO("SLEEP", "Published %lu ms after wakeup", millis());
+        }
+
+        for (uint8_t i = 0; i < DEEP_SLEEP_MAX_BATCHES && !backlog.isEmpty() && mqttClient.connected(); i++) {
+            flushBacklog();
+            if (!waitForAcks(MQTT_ACK_TIMEOUT)) {
+                break;
+            }
+        }
+        publishWakeStats();
+
+        mqttClient.disconnect();
+        waitForMQTT(0);
+    }
+
+    // Without a broker or PUBACK the readings go to the journal
+    requeueInflight();
+    sendReadings();
+
+    rtcState.save();
+
+    if (rtcState.getFailedWakes() >= DEEP_SLEEP_MAX_FAILURES) {
+        LOG_WARN("SLEEP", "WiFi failed too often, staying awake");
+        WiFi.disconnect();
+        return;
+    }
+
+    // Subtract the time we were awake to keep the interval
+    uint64_t interval = config.getMessageDelay() * 1000000ULL;
+    uint64_t awake = millis() * 1000ULL;
+    uint64_t sleep = interval > awake + 1000000ULL ? interval - awake : 1000000ULL;
+
+    // Keeps the time over the sleep, the RTC timer is only accurate to a few percent, so SNTP corrects it when it answers
+    uint32_t seconds;
+    uint16_t milliseconds;
+    if (sampleClock.toEpoch(millis(), seconds, milliseconds)) {
+        rtcState.setWakeEpoch(seconds + (uint32_t)((sleep / 1000 + milliseconds) / 1000));
+        rtcState.save();
+    }
+
+    LOG_INFO("SLEEP", "Sleeping for %lu ms", (unsigned long)(sleep / 1000));
+    journal.sync();
+    logger.flush(Serial);
+    ESP.deepSleep(sleep, WAKE_RF_DEFAULT);
+}
+
+/**
+ * Connects to WiFi in station mode only.
+ * Tries the access point, channel and IP cached in RTC memory first, which skips the scan and DHCP.
+ * Falls back to a normal connect and caches the new values if that fails.
+ *
+ * @return True if WiFi is connected
+ */
+bool connectWiFiFast() {
+    WiFi.mode(WIFI_STA);
+
+    if (rtcState.hasNetwork()) {
+        beginWiFi(true);
+        if (waitForWiFi(FAST_CONNECT_TIMEOUT)) {
+            return true;
+        }
+
+        LOG_WARN("WIFI", "Fast connect failed, scanning");
+        rtcState.clearNetwork();
+        WiFi.disconnect();
+    }
+
+    startScan();
+    if (wifiJoin == WIFI_JOIN_SCAN) {
+        waitForScan(WIFI_SCAN_TIMEOUT);
+        joinScanned();
+    }
+    if (!waitForWiFi(FULL_CONNECT_TIMEOUT)) {
+        LOG_WARN("WIFI", "Could not connect to WiFi");
+        return false;
+    }
+
+    rtcState.setNetwork(wifiProfile, WiFi.BSSID(), WiFi.channel(), WiFi.localIP(), WiFi.gatewayIP(), WiFi.subnetMask(), WiFi.dnsIP());
+    return true;
+}
+
+/**
+ * Waits until the scan for access points is done.
+ *
+ * @return True if the scan finished before the timeout
+ */
+bool waitForScan(unsigned long timeout) {
+    unsigned long start = millis();
+    while (wifiScanner.getResultCount() == WIFI_SCANNER_RUNNING) {
+        if (millis() - start >= timeout) {
+            return false;
+        }
+        logger.drain(Serial);
+        delay(10);
+    }
+    return true;
+}
+
+/**
+ * Waits until WiFi is connected.
+ *
+ * @return True if WiFi connected before the timeout
+ */
+bool waitForWiFi(unsigned long timeout) {
+    unsigned long start = millis();
+    while (WiFi.status() != WL_CONNECTED) {
+        if (millis() - start >= timeout) {
+            return false;
+        }
+        logger.drain(Serial);
+        delay(10);
+    }
+    return true;
+}
+
+/**
+ * Connects to the mqtt broker, using the broker address cached in RTC memory to skip the DNS lookup.
+ *
+ * @return True if the broker is connected
+ */
+bool connectMQTTFast() {
+    IPAddress broker;
+    if (rtcState.hasBrokerIP()) {
+        broker = rtcState.getBrokerIP();
+    } else if (!broker.fromString(config.getMqttIP()) && !WiFi.hostByName(config.getMqttIP(), broker)) {
+        LOG_WARN("MQTT", "Could not resolve MQTT broker");
+        return false;
+    }
+
+    mqttClient.setServer(broker, config.getMqttPort());
+    mqttConnectStart = millis();
+    mqttClient.connect();
+    if (!waitForMQTT(MQTT_CONNECT_TIMEOUT)) {
+        LOG_WARN("MQTT", "Connection to broker failed");
+        mqttClient.disconnect(true);
+        rtcState.clearBrokerIP();
+        return false;
+    }
+
+    rtcState.setBrokerIP(broker);
+    return true;
+}
+
+/**
+ * Waits until the mqtt client is connected, or disconnected if the timeout is 0.
+ *
+ * @param timeout The time to wait for the connection in milliseconds, 0 to wait shortly for the disconnect
+ * @return True if the client reached the state
+ */
+bool waitForMQTT(unsigned long timeout) {
+    bool connect = timeout > 0;
+    unsigned long start = millis();
+
+    while (mqttClient.connected() != connect) {
+        if (millis() - start >= (connect ? timeout : 100)) {
+            return false;
+        }
+        logger.drain(Serial);
+        delay(10);
+    }
+    return true;
+}
+
+/**
+ * Waits until the broker acknowledged all messages in flight.
+ *
+ * @return True if nothing is in flight anymore
+ */
+bool waitForAcks(unsigned long timeout) {
+    unsigned long start = millis();
+
+    while (true) {
+        if (publisher.update(backlog, millis()) > 0) {
+            journal.markSent(publisher.getJournaled());
+        }
+        if (publisher.isIdle()) {
+            return true;
+        }
+        if (!mqttClient.connected() || millis() - start >= timeout) {
+            return false;
+        }
+        logger.drain(Serial);
+        delay(10);
+    }
+}
+
+/**
+ * Publishes the wakeup counters, to keep track of how long the device is awake in every cycle.
+ */
+void publishWakeStats() {
+    char topic[MQTT_TOPIC_SIZE];
+    snprintf(topic, sizeof(topic), "%s/wake", getTopicBase());
+
+    char data[128];
+    snprintf(data, sizeof(data), "{\"wakes\":%lu,\"publishes\":%lu,\"last_ms\":%lu,\"avg_ms\":%lu}", (unsigned long)rtcState.getWakeCount(),
+             (unsigned long)rtcState.getPublishCount(), (unsigned long)rtcState.getLastWakeToPublish(), (unsigned long)rtcState.getAverageWakeToPublish());
+
+    mqttClient.publish(topic, 0, true, data);
+}
+#endif
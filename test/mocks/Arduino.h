@@ -0,0 +1,81 @@
+#ifndef MOCK_ARDUINO_H
+#define MOCK_ARDUINO_H
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+/**
+ * The part of the ESP8266 Arduino core used by the hardware-free modules, for the host tests.
+ * millis() returns a simulated time, which only moves with delay() or mockSetMillis().
+ */
+
+using std::max;
+using std::min;
+
+typedef uint8_t uint8;
+typedef int8_t int8;
+typedef uint16_t uint16;
+typedef int16_t int16;
+typedef uint32_t uint32;
+typedef int32_t int32;
+
+// There is no separate flash on the host
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define strncpy_P strncpy
+#define vsnprintf_P vsnprintf
+
+inline uint32_t mockMillis = 0;
+
+inline unsigned long millis() { return mockMillis; }
+
+inline void delay(unsigned long ms) { mockMillis += ms; }
+
+inline void mockSetMillis(uint32_t now) { mockMillis = now; }
+
+/**
+ * Output of text and bytes, collects everything in a string when used as is.
+ */
+class Print {
+
+  public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+
+    virtual size_t write(const uint8_t *buffer, size_t size) {
+        size_t written = 0;
+        while (size-- > 0) {
+            written += write(*buffer++);
+        }
+        return written;
+    }
+
+    virtual int availableForWrite() { return 256; }
+
+    virtual void flush() {}
+
+    size_t print(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+
+    __attribute__((format(printf, 2, 3))) size_t printf(const char *format, ...) {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (length < 0) {
+            return 0;
+        }
+        return write((const uint8_t *)buffer, (size_t)length < sizeof(buffer) ? length : sizeof(buffer) - 1);
+    }
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef MOCK_ASYNC_MQTT_CLIENT_H
+#define MOCK_ASYNC_MQTT_CLIENT_H
+
+#include <Arduino.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * In-process broker standing in for AsyncMqttClient in the host tests.
+ * Every accepted publish is recorded. The PUBACKs are held back until ack() or ackAll() is called,
+ * so the tests decide when and whether the broker answers.
+ */
+class AsyncMqttClient {
+
+  public:
+    typedef std::function<void(uint16_t packetId)> OnPublishUserCallback;
+
+    typedef struct message_struct {
+        std::string topic;
+        std::string payload;
+        uint8_t qos;
+        bool retain;
+        bool dup;
+        uint16_t packetId;
+    } Message;
+
+    std::vector<Message> messages; // Everything published, in order
+    std::vector<uint16_t> pending; // Packet ids waiting for their PUBACK
+    bool online = true;            // Publishes are refused and disconnect() is recorded while offline
+    bool full = false;             // Refuses publishes like a full TCP send buffer
+    bool connecting = false;       // Set by connect(), the test decides when the broker accepts the connection
+    uint32_t disconnects = 0;
+
+  private:
+    OnPublishUserCallback onPublishCallback;
+    uint16_t nextPacketId = 1;
+
+  public:
+    AsyncMqttClient &onPublish(OnPublishUserCallback callback) {
+        onPublishCallback = callback;
+        return *this;
+    }
+
+    bool connected() { return online; }
+
+    void connect() { connecting = true; }
+
+    void disconnect(bool force = false) {
+        online = false;
+        connecting = false;
+        pending.clear();
+        disconnects++;
+    }
+
+    uint16_t publish(const char *topic, uint8_t qos, bool retain, const char *payload = nullptr, size_t length = 0, bool dup = false,
+                     uint16_t messageId = 0) {
+        if (!online || full) {
+            return 0;
+        }
+
+        uint16_t packetId = messageId;
+        if (packetId == 0 && qos > 0) {
+            packetId = nextPacketId++;
+            if (nextPacketId == 0) {
+                nextPacketId = 1;
+            }
+        }
+
+        size_t size = payload == nullptr ? 0 : length > 0 ? length : strlen(payload);
+        messages.push_back({topic, std::string(payload != nullptr ? payload : "", size), qos, retain, dup, packetId});
+        if (qos > 0) {
+            pending.push_back(packetId);
+        }
+        return qos > 0 ? packetId : 1;
+    }
+
+    /**
+     * Sends the PUBACK of one packet.
+     */
+    void ack(uint16_t packetId) {
+        for (size_t i = 0; i < pending.size(); i++) {
+            if (pending[i] == packetId) {
+                pending.erase(pending.begin() + i);
+                if (onPublishCallback) {
+                    onPublishCallback(packetId);
+                }
+                return;
+            }
+        }
+    }
+
+    /**
+     * Sends the PUBACKs of all packets waiting for one.
+     */
+    void ackAll() {
+        std::vector<uint16_t> acks = pending;
+        for (uint16_t packetId : acks) {
+            ack(packetId);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef RAM_STORAGE_H
+#define RAM_STORAGE_H
+
+#include <string.h>
+
+#include <vector>
+
+#include "JournalStorage.h"
+
+/**
+ * Storage in RAM standing in for the flash in the host tests. It keeps its data over begin() and end(),
+ * like a file survives a restart. A power loss is simulated with failAfter(): the write in progress
+ * stops after the given number of bytes and all later writes fail.
+ */
+class RamStorage : public JournalStorage {
+
+  public:
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> writesPerByte; // How often every byte was written, to check the wear leveling
+    uint32_t writes = 0;
+    bool open = false;
+
+  private:
+    long budget = -1; // Bytes left until the simulated power loss, -1 for none
+
+  public:
+    /**
+     * Keeps the data if the size did not change, like LittleFSStorage.
+     */
+    bool begin(size_t size) override {
+        if (data.size() != size) {
+            data.assign(size, 0);
+            writesPerByte.assign(size, 0);
+        }
+        open = true;
+        return true;
+    }
+
+    bool read(size_t offset, void *buffer, size_t length) override {
+        if (!open || offset + length > data.size()) {
+            return false;
+        }
+        memcpy(buffer, data.data() + offset, length);
+        return true;
+    }
+
+    bool write(size_t offset, const void *buffer, size_t length) override {
+        if (!open || offset + length > data.size() || budget == 0) {
+            return false;
+        }
+
+        size_t done = budget > 0 && (size_t)budget < length ? budget : length;
+        memcpy(data.data() + offset, buffer, done);
+        for (size_t i = offset; i < offset + done; i++) {
+            writesPerByte[i]++;
+        }
+        writes++;
+        if (budget > 0) {
+            budget -= done;
+        }
+        return done == length;
+    }
+
+    void end() override { open = false; }
+
+    /**
+     * Cuts the power after the given number of written bytes.
+     */
+    void failAfter(long bytes) { budget = bytes; }
+
+    /**
+     * Restores the power, the data written so far stays.
+     */
+    void restore() { budget = -1; }
+};
+
+#endif
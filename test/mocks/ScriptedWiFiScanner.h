@@ -0,0 +1,70 @@
+#ifndef SCRIPTED_WIFI_SCANNER_H
+#define SCRIPTED_WIFI_SCANNER_H
+
+#include <string.h>
+
+#include <vector>
+
+#include "WiFiScanner.h"
+
+/**
+ * Scanner returning access points set by the test instead of scanning the air.
+ * A scan stays running until finish() is called, unless it is set to finish at once.
+ */
+class ScriptedWiFiScanner : public WiFiScanner {
+
+  public:
+    std::vector<WiFiNetwork> networks;
+    bool immediate = true; // Finish every scan as soon as it is started
+    bool fail = false;     // Let start() fail
+    uint32_t scans = 0;
+
+  private:
+    bool running = false;
+    bool done = false;
+
+  public:
+    void add(const char *ssid, uint8_t lastByte, uint8_t channel, int8_t rssi) {
+        WiFiNetwork network = {};
+        strncpy(network.ssid, ssid, sizeof(network.ssid) - 1);
+        memset(network.bssid, 0xAA, sizeof(network.bssid));
+        network.bssid[5] = lastByte;
+        network.channel = channel;
+        network.rssi = rssi;
+        networks.push_back(network);
+    }
+
+    void finish() {
+        running = false;
+        done = true;
+    }
+
+    bool start() override {
+        if (fail) {
+            return false;
+        }
+        scans++;
+        running = !immediate;
+        done = immediate;
+        return true;
+    }
+
+    int16_t getResultCount() override {
+        if (running) {
+            return WIFI_SCANNER_RUNNING;
+        }
+        return done ? (int16_t)networks.size() : WIFI_SCANNER_FAILED;
+    }
+
+    bool getResult(uint8_t index, WiFiNetwork &network) override {
+        if (!done || index >= networks.size()) {
+            return false;
+        }
+        network = networks[index];
+        return true;
+    }
+
+    void clear() override { done = false; }
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef STRING_PRINT_H
+#define STRING_PRINT_H
+
+#include <Arduino.h>
+
+#include <string>
+
+/**
+ * Print collecting the output in a string, standing in for the response streams of the webserver in the host tests.
+ */
+class StringPrint : public Print {
+
+  public:
+    std::string text;
+
+    size_t write(uint8_t c) override {
+        text += (char)c;
+        return 1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size) override {
+        text.append((const char *)buffer, size);
+        return size;
+    }
+};
+
+#endif
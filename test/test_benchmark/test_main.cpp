@@ -0,0 +1,296 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <unity.h>
+
+#include <stdlib.h>
+
+#include <chrono>
+
+#include "Config.h"
+#include "MqttPublisher.h"
+#include "PayloadEncoder.h"
+#include "RamStorage.h"
+#include "SettingsJson.h"
+#include "StringPrint.h"
+
+/*
+ * Micro-benchmarks of the work done on every sample, on every configuration change and for the settings page.
+ * They run on the host, so the times say nothing about the ESP8266 itself. The limits are many times the host
+ * timings and only catch a change of the cost class, like a loop over the whole flash on every save
+ * or a payload encoded twice.
+ *
+ * The times are written to BENCHMARK_REPORT and compared to BENCHMARK_BASELINE, a benchmark which got
+ * slower by more than BENCHMARK_THRESHOLD percent fails. The BENCHMARK_THRESHOLD environment variable
+ * overrides the threshold of the build flags. Set BENCHMARK_UPDATE_BASELINE=1 to store the current times as new baseline.
+ */
+
+#ifndef BENCHMARK_THRESHOLD
+#define BENCHMARK_THRESHOLD 100
+#endif
+#ifndef BENCHMARK_REPORT
+#define BENCHMARK_REPORT "benchmark_report.json"
+#endif
+#ifndef BENCHMARK_BASELINE
+#define BENCHMARK_BASELINE "scripts/benchmark_baseline.json"
+#endif
+
+#define BENCHMARK_ROUNDS 2000
+// Every benchmark is run this often and the fastest run counts, which keeps other work of the host out of the times
+#define BENCHMARK_REPEATS 10
+#define BENCHMARK_MAX_RESULTS 16
+#define BENCHMARK_NAME_SIZE 32
+
+// The payload buffers of the publisher, MQTT_SAMPLE_SIZE and MQTT_BATCH_SIZE
+#define SAMPLE_PAYLOAD_SIZE 96
+#define BATCH_PAYLOAD_SIZE 512
+
+typedef struct benchmark_result_struct {
+    char name[BENCHMARK_NAME_SIZE];
+    double average; // Time of one round in nanoseconds
+} BenchmarkResult;
+
+static BenchmarkResult results[BENCHMARK_MAX_RESULTS];
+static uint8_t resultCount = 0;
+
+static RamStorage slotA;
+static RamStorage slotB;
+static RamStorage eeprom;
+
+static Sample makeSample(uint32_t timestamp, int16_t temperature, uint16_t humidity) {
+    Sample sample = {};
+    sample.timestamp = timestamp;
+    sample.temperature = temperature;
+    sample.humidity = humidity;
+    return sample;
+}
+
+/**
+ * Runs the function the given number of rounds and returns the average time of one round in nanoseconds.
+ * The time is kept for the report.
+ */
+template <typename Function> static double measure(const char *name, uint32_t rounds, Function function) {
+    double average = 0;
+    for (uint8_t repeat = 0; repeat < BENCHMARK_REPEATS; repeat++) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < rounds; i++) {
+            function(i);
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        if (repeat == 0 || (double)elapsed.count() / rounds < average) {
+            average = (double)elapsed.count() / rounds;
+        }
+    }
+    printf("%-24s %10.0f ns\n", name, average);
+
+    if (resultCount < BENCHMARK_MAX_RESULTS) {
+        snprintf(results[resultCount].name, BENCHMARK_NAME_SIZE, "%s", name);
+        results[resultCount].average = average;
+        resultCount++;
+    }
+    return average;
+}
+
+/**
+ * Writes the times as JSON object of names and nanoseconds, one per line.
+ *
+ * @return False if the file could not be written
+ */
+static bool writeTimes(const char *path, const BenchmarkResult *times, uint8_t count) {
+    FILE *file = fopen(path, "w");
+    if (file == nullptr) {
+        return false;
+    }
+
+    fprintf(file, "{\n");
+    for (uint8_t i = 0; i < count; i++) {
+        fprintf(file, "    \"%s\": %.0f%s\n", times[i].name, times[i].average, i + 1 < count ? "," : "");
+    }
+    fprintf(file, "}\n");
+    return fclose(file) == 0;
+}
+
+/**
+ * Reads the times written by writeTimes().
+ *
+ * @return The number of times read, 0 if there is no such file
+ */
+static uint8_t readTimes(const char *path, BenchmarkResult *times, uint8_t size) {
+    FILE *file = fopen(path, "r");
+    if (file == nullptr) {
+        return 0;
+    }
+
+    uint8_t count = 0;
+    char line[128];
+    while (count < size && fgets(line, sizeof(line), file) != nullptr) {
+        if (sscanf(line, " \"%31[^\"]\": %lf", times[count].name, &times[count].average) == 2) {
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+void setUp() {
+    slotA = RamStorage();
+    slotB = RamStorage();
+    eeprom = RamStorage();
+    Config::setStorage(slotA, slotB, eeprom);
+    mockSetMillis(0);
+}
+
+void tearDown() {}
+
+void test_config_save_and_load() {
+    char topic[] = "room/temperature";
+    Config config;
+    config.setMqttTopic(topic);
+
+    double save = measure("config save", BENCHMARK_ROUNDS, [&](uint32_t i) {
+        config.setMqttPort(1000 + i % 1000);
+        TEST_ASSERT_TRUE(config.saveConfig());
+    });
+    double load = measure("config load", BENCHMARK_ROUNDS, [&](uint32_t) {
+        Config loaded;
+        TEST_ASSERT_TRUE(loaded.loadConfig());
+    });
+
+    TEST_ASSERT_LESS_THAN(2000000.0, save);
+    TEST_ASSERT_LESS_THAN(2000000.0, load);
+}
+
+void test_sample_encoding() {
+    uint8_t buffer[SAMPLE_PAYLOAD_SIZE];
+    PayloadEncoder string(PAYLOAD_JSON_STRING);
+    PayloadEncoder json(PAYLOAD_JSON_NUMBER);
+    PayloadEncoder cbor(PAYLOAD_CBOR);
+
+    double stringTime = measure("json string sample", BENCHMARK_ROUNDS, [&](uint32_t i) {
+        TEST_ASSERT_GREATER_THAN(0, string.encode(makeSample(i, 2000 + i % 100, 4500), buffer, sizeof(buffer)));
+    });
+    double jsonTime = measure("json sample", BENCHMARK_ROUNDS, [&](uint32_t i) {
+        TEST_ASSERT_GREATER_THAN(0, json.encode(makeSample(i, 2000 + i % 100, 4500), buffer, sizeof(buffer)));
+    });
+    double cborTime = measure("cbor sample", BENCHMARK_ROUNDS, [&](uint32_t i) {
+        TEST_ASSERT_GREATER_THAN(0, cbor.encode(makeSample(i, 2000 + i % 100, 4500), buffer, sizeof(buffer)));
+    });
+
+    TEST_ASSERT_LESS_THAN(20000.0, stringTime);
+    TEST_ASSERT_LESS_THAN(20000.0, jsonTime);
+    TEST_ASSERT_LESS_THAN(20000.0, cborTime);
+}
+
+void test_batch_encoding() {
+    uint8_t buffer[BATCH_PAYLOAD_SIZE];
+    PayloadEncoder encoder(PAYLOAD_JSON_NUMBER);
+    SampleBuffer samples;
+    for (int i = 0; i < SAMPLE_BUFFER_SIZE; i++) {
+        samples.push(makeSample(i * 1000, 2000 + i, 4500));
+    }
+
+    double batch = measure("json batch", BENCHMARK_ROUNDS, [&](uint32_t) {
+        uint16_t count;
+        TEST_ASSERT_GREATER_THAN(0, encoder.encodeBatch(samples, SAMPLE_BUFFER_SIZE * 1000, buffer, sizeof(buffer), count));
+    });
+
+    TEST_ASSERT_LESS_THAN(200000.0, batch);
+}
+
+void test_publish_cycle() {
+    AsyncMqttClient client;
+    PayloadEncoder encoder(PAYLOAD_JSON_NUMBER);
+    MqttPublisher publisher(client, encoder);
+    SampleBuffer backlog;
+    publisher.begin();
+
+    // Publish, acknowledge and free the slot, like one sample on a good connection
+    double cycle = measure("publish and ack", BENCHMARK_ROUNDS, [&](uint32_t i) {
+        TEST_ASSERT_TRUE(publisher.publish("room", makeSample(i, 2000, 4500), i));
+        client.ackAll();
+        publisher.update(backlog, i);
+        client.messages.clear();
+    });
+
+    TEST_ASSERT_TRUE(publisher.isIdle());
+    TEST_ASSERT_LESS_THAN(50000.0, cycle);
+}
+
+void test_settings_json() {
+    char ssid[] = "home";
+    char passwd[] = "secret \"quoted\"";
+    char host[] = "thermometer";
+    char ip[] = "192.168.1.2";
+    char topic[] = "room/temperature";
+    Config config;
+    config.setSSID(ssid);
+    config.setWifiPassword(passwd);
+    config.setHostname(host);
+    config.setMqttIP(ip);
+    config.setMqttUsername(host);
+    config.setMqttPassword(passwd);
+    config.setMqttTopic(topic);
+    config.setProfileSSID(1, ssid);
+    config.setProfilePassword(1, passwd);
+    TEST_ASSERT_TRUE(config.isValid());
+
+    // Like the response stream of the webserver, which collects the page in its buffer
+    StringPrint response;
+    double settings = measure("settings json", BENCHMARK_ROUNDS, [&](uint32_t) {
+        response.text.clear();
+        printSettingsJson(config, response);
+        TEST_ASSERT_TRUE(response.text.back() == '}');
+    });
+
+    TEST_ASSERT_LESS_THAN(200000.0, settings);
+}
+
+/**
+ * Writes the report and compares the times to the baseline. Has to run after all other benchmarks.
+ */
+void test_against_baseline() {
+    TEST_ASSERT_TRUE_MESSAGE(writeTimes(BENCHMARK_REPORT, results, resultCount), "Could not write " BENCHMARK_REPORT);
+
+    const char *variable = getenv("BENCHMARK_UPDATE_BASELINE");
+    if (variable != nullptr && strcmp(variable, "1") == 0) {
+        TEST_ASSERT_TRUE_MESSAGE(writeTimes(BENCHMARK_BASELINE, results, resultCount), "Could not write " BENCHMARK_BASELINE);
+        printf("Benchmark baseline updated\n");
+        return;
+    }
+
+    BenchmarkResult baseline[BENCHMARK_MAX_RESULTS];
+    uint8_t baselineCount = readTimes(BENCHMARK_BASELINE, baseline, BENCHMARK_MAX_RESULTS);
+    if (baselineCount == 0) {
+        printf("No benchmark baseline stored\n");
+        return;
+    }
+
+    variable = getenv("BENCHMARK_THRESHOLD");
+    double threshold = variable != nullptr ? atof(variable) : BENCHMARK_THRESHOLD;
+
+    uint8_t slower = 0;
+    for (uint8_t i = 0; i < resultCount; i++) {
+        for (uint8_t j = 0; j < baselineCount; j++) {
+            if (strcmp(results[i].name, baseline[j].name) != 0 || baseline[j].average <= 0) {
+                continue;
+            }
+            double change = (results[i].average - baseline[j].average) * 100.0 / baseline[j].average;
+            printf("%-24s %10.0f ns (%+.2f%%)\n", results[i].name, results[i].average, change);
+            if (change > threshold) {
+                printf("%s got slower by more than %.2f%%\n", results[i].name, threshold);
+                slower++;
+            }
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT8_MESSAGE(0, slower, "Benchmarks slower than the baseline");
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_config_save_and_load);
+    RUN_TEST(test_sample_encoding);
+    RUN_TEST(test_batch_encoding);
+    RUN_TEST(test_publish_cycle);
+    RUN_TEST(test_settings_json);
+    RUN_TEST(test_against_baseline);
+    return UNITY_END();
+}
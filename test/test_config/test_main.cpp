@@ -0,0 +1,331 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "Config.h"
+#include "Crc32.h"
+#include "PayloadEncoder.h"
+#include "RamStorage.h"
+#include "SettingsJson.h"
+#include "StringPrint.h"
+
+// The header in front of a stored config, the layout is part of the flash format
+typedef struct slot_header_struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;
+    uint32_t sequence;
+    uint32_t crc;
+} SlotHeader;
+
+// The layout of version 1, kept at the start of the EEPROM without a header
+typedef struct config_v1_struct {
+    int magicNumber;
+    char wifi_ssid[32];
+    char wifi_passwd[32];
+    char wifi_hostname[32];
+    char mqtt_ip[16];
+    unsigned short mqtt_port;
+    char mqtt_user[32];
+    char mqtt_passwd[32];
+    char mqtt_topic[255];
+    int8_t temp_correct;
+    uint16_t messageDelay;
+} ConfigV1;
+
+static RamStorage slotA;
+static RamStorage slotB;
+static RamStorage eeprom;
+
+/**
+ * Fills a config with values which differ from the defaults.
+ */
+static void fill(Config &config) {
+    char ssid[] = "home";
+    char passwd[] = "secret";
+    char hostname[] = "thermometer";
+    char ip[] = "192.168.1.2";
+    char user[] = "user";
+    char topic[] = "room/temperature";
+
+    config.setSSID(ssid);
+    config.setWifiPassword(passwd);
+    config.setHostname(hostname);
+    config.setMqttIP(ip);
+    config.setMqttPort(1884);
+    config.setMqttUsername(user);
+    config.setMqttPassword(passwd);
+    config.setMqttTopic(topic);
+    config.setPayloadFormat(PAYLOAD_CBOR);
+    config.setTempOffset(123);
+    config.setReportDeadbandTemp(50);
+    config.setTopicLayout(TOPIC_LAYOUT_DEVICE);
+    config.setRoamRSSI(-60);
+}
+
+static SlotHeader readHeader(RamStorage &storage, size_t offset) {
+    SlotHeader header;
+    memcpy(&header, storage.data.data() + offset, sizeof(header));
+    return header;
+}
+
+/**
+ * Marks a stored config as written by an older version, as if that firmware had saved it.
+ */
+static void setVersion(RamStorage &storage, size_t offset, uint16_t version) {
+    SlotHeader header = readHeader(storage, offset);
+    header.version = version;
+    header.crc = calculateCRC32(&header, offsetof(SlotHeader, crc));
+    header.crc = calculateCRC32(storage.data.data() + offset + sizeof(header), header.length, header.crc);
+    memcpy(storage.data.data() + offset, &header, sizeof(header));
+}
+
+void setUp() {
+    slotA = RamStorage();
+    slotB = RamStorage();
+    eeprom = RamStorage();
+    Config::setStorage(slotA, slotB, eeprom);
+}
+
+void tearDown() {}
+
+void test_empty_flash_loads_defaults() {
+    Config config;
+    TEST_ASSERT_FALSE(config.loadConfig());
+    TEST_ASSERT_FALSE(config.flashInitialized());
+    TEST_ASSERT_EQUAL_UINT16(DEFAULT_MQTT_PORT, config.getMqttPort());
+    TEST_ASSERT_EQUAL_UINT16(DEFAULT_TEMP_GAIN, config.getTempGain());
+    TEST_ASSERT_EQUAL_INT(DEFAULT_WIFI_ROAM_RSSI, config.getRoamRSSI());
+    TEST_ASSERT_FALSE(config.isValid());
+}
+
+void test_save_and_load() {
+    Config config;
+    fill(config);
+    TEST_ASSERT_TRUE(config.saveConfig());
+
+    Config loaded;
+    TEST_ASSERT_TRUE(loaded.loadConfig());
+    TEST_ASSERT_TRUE(loaded.isValid());
+    TEST_ASSERT_EQUAL_STRING("home", loaded.getSSID());
+    TEST_ASSERT_EQUAL_STRING("room/temperature", loaded.getMqttTopic());
+    TEST_ASSERT_EQUAL_UINT16(1884, loaded.getMqttPort());
+    TEST_ASSERT_EQUAL_UINT8(PAYLOAD_CBOR, loaded.getPayloadFormat());
+    TEST_ASSERT_EQUAL_INT16(123, loaded.getTempOffset());
+    TEST_ASSERT_EQUAL_INT(-60, loaded.getRoamRSSI());
+}
+
+void test_saves_alternate_between_slots() {
+    Config config;
+    fill(config);
+    config.saveConfig();
+    config.saveConfig();
+    config.saveConfig();
+
+    TEST_ASSERT_EQUAL_UINT32(CONFIG_MAGIC, readHeader(slotA, 0).magic);
+    TEST_ASSERT_EQUAL_UINT32(CONFIG_MAGIC, readHeader(slotB, 0).magic);
+    TEST_ASSERT_EQUAL_UINT32(3, readHeader(slotA, 0).sequence);
+    TEST_ASSERT_EQUAL_UINT32(2, readHeader(slotB, 0).sequence);
+}
+
+void test_corrupt_slot_falls_back_to_other() {
+    Config config;
+    fill(config);
+    config.saveConfig();
+    config.setMqttPort(1999);
+    config.saveConfig();
+
+    // A bit flips in the newer config in slot B
+    slotB.data[sizeof(SlotHeader) + 5] ^= 0x01;
+
+    Config loaded;
+    TEST_ASSERT_TRUE(loaded.loadConfig());
+    TEST_ASSERT_EQUAL_UINT16(1884, loaded.getMqttPort());
+}
+
+void test_power_loss_during_save_keeps_old_config() {
+    Config config;
+    fill(config);
+    config.saveConfig();
+
+    config.setMqttPort(1999);
+    slotB.failAfter(100);
+    TEST_ASSERT_FALSE(config.saveConfig());
+    slotB.restore();
+
+    Config loaded;
+    TEST_ASSERT_TRUE(loaded.loadConfig());
+    TEST_ASSERT_EQUAL_UINT16(1884, loaded.getMqttPort());
+}
+
+void test_imports_version_1_from_eeprom() {
+    ConfigV1 old = {};
+    old.magicNumber = 0xC0FFEE;
+    strcpy(old.wifi_ssid, "legacy");
+    strcpy(old.wifi_passwd, "secret");
+    strcpy(old.wifi_hostname, "thermometer");
+    strcpy(old.mqtt_ip, "10.0.0.1");
+    old.mqtt_port = 1885;
+    strcpy(old.mqtt_user, "user");
+    strcpy(old.mqtt_passwd, "secret");
+    strcpy(old.mqtt_topic, "old/topic");
+    old.temp_correct = -2;
+    old.messageDelay = 30;
+    eeprom.begin(2 * CONFIG_SLOT_SIZE);
+    eeprom.write(0, &old, sizeof(old));
+
+    Config config;
+    TEST_ASSERT_TRUE(config.loadConfig());
+    TEST_ASSERT_TRUE(config.isValid());
+    TEST_ASSERT_EQUAL_STRING("legacy", config.getSSID());
+    TEST_ASSERT_EQUAL_STRING("old/topic", config.getMqttTopic());
+    TEST_ASSERT_EQUAL_UINT16(1885, config.getMqttPort());
+    TEST_ASSERT_EQUAL_UINT16(30, config.getMessageDelay());
+    // The fields of the later versions get the values keeping the old behaviour
+    TEST_ASSERT_EQUAL_UINT8(PAYLOAD_JSON_STRING, config.getPayloadFormat());
+    TEST_ASSERT_EQUAL_INT16(-200, config.getTempOffset());
+    TEST_ASSERT_EQUAL_UINT16(DEFAULT_TEMP_GAIN, config.getTempGain());
+    TEST_ASSERT_EQUAL_UINT8(1, config.getFilterOversample());
+    TEST_ASSERT_EQUAL_UINT16(0, config.getReportDeadbandTemp());
+    TEST_ASSERT_EQUAL_UINT16(DEFAULT_REPORT_HEARTBEAT, config.getReportHeartbeat());
+    TEST_ASSERT_EQUAL_STRING("", config.getStaticIP());
+    TEST_ASSERT_EQUAL_UINT8(TOPIC_LAYOUT_CUSTOM, config.getTopicLayout());
+    TEST_ASSERT_FALSE(config.getDiscovery());
+    TEST_ASSERT_EQUAL_STRING("", config.getProfileSSID(1));
+    TEST_ASSERT_EQUAL_INT(DEFAULT_WIFI_ROAM_RSSI, config.getRoamRSSI());
+
+    // It moved into the slots in the current version and the EEPROM is cleared
+    TEST_ASSERT_EQUAL_UINT16(CONFIG_VERSION, readHeader(slotA, 0).version);
+    for (uint8_t byte : eeprom.data) {
+        TEST_ASSERT_EQUAL_UINT8(0, byte);
+    }
+    Config again;
+    TEST_ASSERT_TRUE(again.loadConfig());
+    TEST_ASSERT_EQUAL_STRING("legacy", again.getSSID());
+}
+
+void test_imports_slots_from_eeprom() {
+    Config config;
+    fill(config);
+    config.saveConfig();
+
+    // Older firmware kept the second slot behind the first one in the EEPROM
+    eeprom.begin(2 * CONFIG_SLOT_SIZE);
+    memcpy(eeprom.data.data() + CONFIG_SLOT_SIZE, slotA.data.data(), CONFIG_SLOT_SIZE);
+    setVersion(eeprom, CONFIG_SLOT_SIZE, 7);
+    slotA = RamStorage();
+
+    Config loaded;
+    TEST_ASSERT_TRUE(loaded.loadConfig());
+    TEST_ASSERT_EQUAL_STRING("home", loaded.getSSID());
+    TEST_ASSERT_EQUAL_UINT8(TOPIC_LAYOUT_DEVICE, loaded.getTopicLayout());
+    TEST_ASSERT_EQUAL_INT(DEFAULT_WIFI_ROAM_RSSI, loaded.getRoamRSSI());
+    TEST_ASSERT_EQUAL_UINT16(CONFIG_VERSION, readHeader(slotA, 0).version);
+}
+
+void test_migrates_every_version() {
+    for (uint16_t version = 2; version <= CONFIG_VERSION; version++) {
+        setUp();
+        Config config;
+        fill(config);
+        config.saveConfig();
+        setVersion(slotA, 0, version);
+
+        Config loaded;
+        TEST_ASSERT_TRUE(loaded.loadConfig());
+        TEST_ASSERT_EQUAL_STRING("home", loaded.getSSID());
+        TEST_ASSERT_EQUAL_UINT16(1884, loaded.getMqttPort());
+
+        // Every migration resets the fields its version added, the later ones are kept
+        TEST_ASSERT_EQUAL_UINT8(version <= 2 ? PAYLOAD_JSON_STRING : PAYLOAD_CBOR, loaded.getPayloadFormat());
+        TEST_ASSERT_EQUAL_INT16(version <= 3 ? 0 : 123, loaded.getTempOffset());
+        TEST_ASSERT_EQUAL_UINT16(version <= 4 ? 0 : 50, loaded.getReportDeadbandTemp());
+        TEST_ASSERT_EQUAL_UINT8(version <= 6 ? TOPIC_LAYOUT_CUSTOM : TOPIC_LAYOUT_DEVICE, loaded.getTopicLayout());
+        TEST_ASSERT_EQUAL_INT(version <= 7 ? DEFAULT_WIFI_ROAM_RSSI : -60, loaded.getRoamRSSI());
+
+        // A migrated config is saved in the current version, into the other slot
+        SlotHeader saved = readHeader(version < CONFIG_VERSION ? slotB : slotA, 0);
+        TEST_ASSERT_EQUAL_UINT16(CONFIG_VERSION, saved.version);
+    }
+}
+
+void test_rejects_oversized_strings() {
+    Config config;
+    fill(config);
+
+    char ssid[33];
+    memset(ssid, 'a', 32);
+    ssid[32] = '\0';
+    TEST_ASSERT_FALSE(config.setSSID(ssid));
+    TEST_ASSERT_EQUAL_STRING("home", config.getSSID());
+    ssid[31] = '\0';
+    TEST_ASSERT_TRUE(config.setSSID(ssid));
+    TEST_ASSERT_EQUAL_UINT(31, strlen(config.getSSID()));
+
+    char ip[17] = "192.168.100.1000";
+    TEST_ASSERT_FALSE(config.setMqttIP(ip));
+    TEST_ASSERT_FALSE(config.setStaticIP(ip));
+    TEST_ASSERT_EQUAL_STRING("192.168.1.2", config.getMqttIP());
+
+    char topic[300];
+    memset(topic, 't', sizeof(topic) - 1);
+    topic[sizeof(topic) - 1] = '\0';
+    TEST_ASSERT_FALSE(config.setMqttTopic(topic));
+    TEST_ASSERT_EQUAL_STRING("room/temperature", config.getMqttTopic());
+    TEST_ASSERT_FALSE(config.setProfileSSID(1, topic));
+}
+
+void test_settings_json_of_empty_config() {
+    Config config;
+    StringPrint out;
+    printSettingsJson(config, out);
+    TEST_ASSERT_EQUAL_STRING("{\"mqtt-port\":1883,\"temp-correction\":0,\"mqtt-delay\":10,\"payload-format\":0,\"wifi-roam-rssi\":-75}", out.text.c_str());
+}
+
+void test_settings_json_has_page_values() {
+    Config config;
+    fill(config);
+    config.setTempOffset(-5);
+    config.setTempGain(1250);
+    char ssid[] = "say \"hi\" \\ \t";
+    config.setProfileSSID(1, ssid);
+
+    StringPrint out;
+    printSettingsJson(config, out);
+    const char *json = out.text.c_str();
+    TEST_ASSERT_NOT_NULL(strstr(json, "{\"wifi-ssid\":\"home\",\"wifi-passwd\":\"secret\",\"host\":\"thermometer\","));
+    TEST_ASSERT_NOT_NULL(strstr(json, ",\"mqtt-port\":1884,"));
+    TEST_ASSERT_NOT_NULL(strstr(json, ",\"temp-correction\":-0.05,\"temp-gain\":1.250,"));
+    TEST_ASSERT_NOT_NULL(strstr(json, ",\"payload-format\":2,"));
+    TEST_ASSERT_NOT_NULL(strstr(json, ",\"report-deadband-temp\":0.50,"));
+    TEST_ASSERT_NOT_NULL(strstr(json, ",\"wifi-ssid-2\":\"say \\\"hi\\\" \\\\ \\u0009\","));
+    TEST_ASSERT_NOT_NULL(strstr(json, ",\"wifi-roam-rssi\":-60}"));
+}
+
+void test_erase_clears_everything() {
+    Config config;
+    fill(config);
+    config.saveConfig();
+    config.saveConfig();
+    config.eraseConfigFlash();
+
+    Config loaded;
+    TEST_ASSERT_FALSE(loaded.loadConfig());
+    TEST_ASSERT_EQUAL_STRING("", loaded.getSSID());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_flash_loads_defaults);
+    RUN_TEST(test_save_and_load);
+    RUN_TEST(test_saves_alternate_between_slots);
+    RUN_TEST(test_corrupt_slot_falls_back_to_other);
+    RUN_TEST(test_power_loss_during_save_keeps_old_config);
+    RUN_TEST(test_imports_version_1_from_eeprom);
+    RUN_TEST(test_imports_slots_from_eeprom);
+    RUN_TEST(test_migrates_every_version);
+    RUN_TEST(test_rejects_oversized_strings);
+    RUN_TEST(test_settings_json_of_empty_config);
+    RUN_TEST(test_settings_json_has_page_values);
+    RUN_TEST(test_erase_clears_everything);
+    return UNITY_END();
+}
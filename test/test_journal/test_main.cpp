@@ -0,0 +1,213 @@
+#include <unity.h>
+
+#include <algorithm>
+
+#include "Journal.h"
+#include "RamStorage.h"
+
+static RamStorage storage;
+
+static Sample makeSample(uint32_t timestamp, int16_t temperature) {
+    Sample sample = {};
+    sample.timestamp = timestamp;
+    sample.temperature = temperature;
+    sample.humidity = SAMPLE_NO_HUMIDITY;
+    return sample;
+}
+
+/**
+ * Opens the journal again on the same storage, like after a reboot, and returns the replayed samples.
+ */
+static uint16_t reboot(SampleBuffer &buffer, uint32_t now) {
+    storage.end();
+    Journal journal(storage);
+    TEST_ASSERT_TRUE(journal.begin());
+    return journal.replay(buffer, now);
+}
+
+void setUp() {
+    storage = RamStorage();
+}
+
+void tearDown() {}
+
+void test_empty_journal_replays_nothing() {
+    Journal journal(storage);
+    TEST_ASSERT_TRUE(journal.begin());
+    TEST_ASSERT_EQUAL_UINT32(0, journal.getPending());
+
+    SampleBuffer buffer;
+    TEST_ASSERT_EQUAL_UINT16(0, journal.replay(buffer, 1000));
+    TEST_ASSERT_TRUE(buffer.isEmpty());
+}
+
+void test_replays_unsent_samples_in_order() {
+    Journal journal(storage);
+    journal.begin();
+    for (int16_t i = 0; i < 10; i++) {
+        TEST_ASSERT_TRUE(journal.append(makeSample(1000 + i * 100, i)));
+    }
+    journal.markSent(4);
+
+    SampleBuffer buffer;
+    TEST_ASSERT_EQUAL_UINT16(6, reboot(buffer, 50));
+    for (uint16_t i = 0; i < 6; i++) {
+        TEST_ASSERT_EQUAL_INT16(4 + i, buffer.peek(i).temperature);
+    }
+}
+
+void test_replayed_samples_keep_their_sequence() {
+    Journal journal(storage);
+    journal.begin();
+    TEST_ASSERT_EQUAL_UINT32(1, journal.append(makeSample(100, 1)));
+    TEST_ASSERT_EQUAL_UINT32(2, journal.append(makeSample(200, 2)));
+    TEST_ASSERT_EQUAL_UINT32(3, journal.append(makeSample(300, 3)));
+    journal.markSent(1);
+
+    SampleBuffer buffer;
+    reboot(buffer, 1000);
+    TEST_ASSERT_EQUAL_UINT32(2, buffer.peek(0).journal);
+    TEST_ASSERT_EQUAL_UINT32(3, buffer.peek(1).journal);
+}
+
+void test_replay_moves_timestamps_to_now() {
+    Journal journal(storage);
+    journal.begin();
+    journal.append(makeSample(900000, 1));
+    journal.append(makeSample(905000, 2));
+
+    SampleBuffer buffer;
+    reboot(buffer, 100000);
+    TEST_ASSERT_EQUAL_UINT32(95000, buffer.peek(0).timestamp);
+    TEST_ASSERT_EQUAL_UINT32(100000, buffer.peek(1).timestamp);
+}
+
+void test_replay_keeps_epoch() {
+    Journal journal(storage);
+    journal.begin();
+    Sample sample = makeSample(900000, 1);
+    sample.epoch = 1700000000;
+    sample.epochMillis = 250;
+    journal.append(sample);
+
+    SampleBuffer buffer;
+    reboot(buffer, 10);
+    TEST_ASSERT_EQUAL_UINT32(1700000000, buffer.peek(0).epoch);
+    TEST_ASSERT_EQUAL_UINT16(250, buffer.peek(0).epochMillis);
+}
+
+void test_all_sent_replays_nothing() {
+    Journal journal(storage);
+    journal.begin();
+    for (int16_t i = 0; i < 5; i++) {
+        journal.append(makeSample(i, i));
+    }
+    journal.markSent(journal.getHead());
+
+    SampleBuffer buffer;
+    TEST_ASSERT_EQUAL_UINT16(0, reboot(buffer, 0));
+}
+
+void test_keeps_newest_slots_when_full() {
+    Journal journal(storage);
+    journal.begin();
+    for (int16_t i = 0; i < JOURNAL_SLOTS + 40; i++) {
+        journal.append(makeSample(i, i));
+    }
+    TEST_ASSERT_EQUAL_UINT32(JOURNAL_SLOTS, journal.getPending());
+
+    SampleBuffer buffer;
+    TEST_ASSERT_EQUAL_UINT16(JOURNAL_SLOTS, reboot(buffer, 0));
+    // The buffer keeps the newest samples of the replay
+    TEST_ASSERT_EQUAL_UINT16(SAMPLE_BUFFER_SIZE, buffer.size());
+    TEST_ASSERT_EQUAL_INT16(JOURNAL_SLOTS + 39, buffer.peek(buffer.size() - 1).temperature);
+}
+
+void test_torn_record_is_skipped() {
+    Journal journal(storage);
+    journal.begin();
+    journal.append(makeSample(100, 1));
+    journal.append(makeSample(200, 2));
+
+    // The power is lost in the middle of the third record
+    storage.failAfter(10);
+    TEST_ASSERT_FALSE(journal.append(makeSample(300, 3)));
+    storage.restore();
+
+    SampleBuffer buffer;
+    TEST_ASSERT_EQUAL_UINT16(2, reboot(buffer, 1000));
+    TEST_ASSERT_EQUAL_INT16(1, buffer.peek(0).temperature);
+    TEST_ASSERT_EQUAL_INT16(2, buffer.peek(1).temperature);
+}
+
+void test_torn_marker_keeps_older_marker() {
+    Journal journal(storage);
+    journal.begin();
+    for (int16_t i = 1; i <= 6; i++) {
+        journal.append(makeSample(i, i));
+    }
+    journal.markSent(3);
+
+    // The marker of 4 goes to the other slot than the marker of 3, which stays intact
+    storage.failAfter(6);
+    journal.markSent(4);
+    storage.restore();
+
+    SampleBuffer buffer;
+    TEST_ASSERT_EQUAL_UINT16(3, reboot(buffer, 1000));
+    TEST_ASSERT_EQUAL_INT16(4, buffer.peek(0).temperature);
+}
+
+void test_appends_after_reboot_continue_sequence() {
+    Journal journal(storage);
+    journal.begin();
+    journal.append(makeSample(1, 1));
+    journal.append(makeSample(2, 2));
+    uint32_t head = journal.getHead();
+
+    storage.end();
+    Journal again(storage);
+    again.begin();
+    TEST_ASSERT_EQUAL_UINT32(head, again.getHead());
+    again.append(makeSample(3, 3));
+    TEST_ASSERT_EQUAL_UINT32(head + 1, again.getHead());
+    TEST_ASSERT_EQUAL_UINT32(3, again.getPending());
+}
+
+void test_writes_are_spread_over_all_slots() {
+    Journal journal(storage);
+    journal.begin();
+    for (uint32_t i = 0; i < JOURNAL_SLOTS * 10; i++) {
+        journal.append(makeSample(i, i));
+        if (i % 16 == 15) {
+            journal.markSent(journal.getHead());
+        }
+    }
+
+    // Every byte of the records, at the end of the storage, is written equally often
+    size_t recordSize = sizeof(uint32_t) + sizeof(Sample) + sizeof(uint32_t); // Sequence, sample and CRC
+    uint32_t lowest = UINT32_MAX;
+    uint32_t highest = 0;
+    for (size_t i = storage.data.size() - JOURNAL_SLOTS * recordSize; i < storage.data.size(); i++) {
+        lowest = std::min(lowest, storage.writesPerByte[i]);
+        highest = std::max(highest, storage.writesPerByte[i]);
+    }
+    TEST_ASSERT_GREATER_OR_EQUAL(9, lowest);
+    TEST_ASSERT_LESS_OR_EQUAL(11, highest);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_journal_replays_nothing);
+    RUN_TEST(test_replays_unsent_samples_in_order);
+    RUN_TEST(test_replayed_samples_keep_their_sequence);
+    RUN_TEST(test_replay_moves_timestamps_to_now);
+    RUN_TEST(test_replay_keeps_epoch);
+    RUN_TEST(test_all_sent_replays_nothing);
+    RUN_TEST(test_keeps_newest_slots_when_full);
+    RUN_TEST(test_torn_record_is_skipped);
+    RUN_TEST(test_torn_marker_keeps_older_marker);
+    RUN_TEST(test_appends_after_reboot_continue_sequence);
+    RUN_TEST(test_writes_are_spread_over_all_slots);
+    return UNITY_END();
+}
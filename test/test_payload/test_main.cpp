@@ -0,0 +1,221 @@
+#include <unity.h>
+
+#include "Clock.h"
+#include "PayloadEncoder.h"
+
+// The payload buffers of the publisher, MQTT_SAMPLE_SIZE and MQTT_BATCH_SIZE
+#define SAMPLE_PAYLOAD_SIZE 96
+#define BATCH_PAYLOAD_SIZE 512
+
+static Sample makeSample(uint32_t timestamp, int16_t temperature, uint16_t humidity, uint8_t sensor = 0) {
+    Sample sample = {};
+    sample.timestamp = timestamp;
+    sample.temperature = temperature;
+    sample.humidity = humidity;
+    sample.sensor = sensor;
+    return sample;
+}
+
+static const char *encode(PayloadEncoder &encoder, const Sample &sample) {
+    static uint8_t buffer[SAMPLE_PAYLOAD_SIZE];
+    TEST_ASSERT_GREATER_THAN(0, encoder.encode(sample, buffer, sizeof(buffer)));
+    return (const char *)buffer;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_json_string_format() {
+    Clock clock;
+    clock.sync(1700000000, 0, 10000);
+    PayloadEncoder encoder(PAYLOAD_JSON_STRING);
+    encoder.setClock(&clock);
+
+    TEST_ASSERT_EQUAL_STRING("{\"temperature\":\"21.30\",\"humidity\":\"45.00\",\"time\":\"1700000000.250\"}",
+                             encode(encoder, makeSample(10250, 2130, 4500)));
+}
+
+void test_json_number_format() {
+    Clock clock;
+    clock.sync(1700000000, 0, 10000);
+    PayloadEncoder encoder(PAYLOAD_JSON_NUMBER);
+    encoder.setClock(&clock);
+
+    TEST_ASSERT_EQUAL_STRING("{\"temperature\":21.30,\"humidity\":45.00,\"time\":1700000000.250}", encode(encoder, makeSample(10250, 2130, 4500)));
+    TEST_ASSERT_EQUAL_STRING("{\"temperature\":-5.05,\"time\":1699999999.000}", encode(encoder, makeSample(9000, -505, SAMPLE_NO_HUMIDITY)));
+    TEST_ASSERT_EQUAL_STRING("{\"temperature\":-0.50,\"time\":1700000000.000}", encode(encoder, makeSample(10000, -50, SAMPLE_NO_HUMIDITY)));
+}
+
+void test_uptime_without_clock() {
+    PayloadEncoder encoder(PAYLOAD_JSON_NUMBER);
+    TEST_ASSERT_EQUAL_STRING("{\"temperature\":21.30,\"uptime_ms\":10250}", encode(encoder, makeSample(10250, 2130, SAMPLE_NO_HUMIDITY)));
+}
+
+void test_stored_epoch_wins_over_clock() {
+    Clock clock;
+    clock.sync(1800000000, 0, 0);
+    PayloadEncoder encoder(PAYLOAD_JSON_NUMBER);
+    encoder.setClock(&clock);
+
+    Sample sample = makeSample(5, 2130, SAMPLE_NO_HUMIDITY);
+    sample.epoch = 1700000000;
+    sample.epochMillis = 7;
+    TEST_ASSERT_EQUAL_STRING("{\"temperature\":21.30,\"time\":1700000000.007}", encode(encoder, sample));
+}
+
+void test_cbor_format() {
+    Clock clock;
+    clock.sync(1700000000, 0, 0);
+    PayloadEncoder encoder(PAYLOAD_CBOR);
+    encoder.setClock(&clock);
+    TEST_ASSERT_TRUE(encoder.isBinary());
+
+    uint8_t buffer[SAMPLE_PAYLOAD_SIZE];
+    // {"t":2130,"h":4500,"e":1700000000}
+    const uint8_t expected[] = {0xA3, 0x61, 't', 0x19, 0x08, 0x52, 0x61, 'h', 0x19, 0x11, 0x94, 0x61, 'e', 0x1A, 0x65, 0x53, 0xF1, 0x00};
+    TEST_ASSERT_EQUAL_UINT(sizeof(expected), encoder.encode(makeSample(0, 2130, 4500), buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_MEMORY(expected, buffer, sizeof(expected));
+
+    // {"t":-550,"u":10}
+    const uint8_t negative[] = {0xA2, 0x61, 't', 0x39, 0x02, 0x25, 0x61, 'u', 0x0A};
+    encoder.setClock(nullptr);
+    TEST_ASSERT_EQUAL_UINT(sizeof(negative), encoder.encode(makeSample(10, -550, SAMPLE_NO_HUMIDITY), buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_MEMORY(negative, buffer, sizeof(negative));
+}
+
+void test_too_small_buffer() {
+    PayloadEncoder encoder(PAYLOAD_JSON_NUMBER);
+    uint8_t buffer[16];
+    TEST_ASSERT_EQUAL_UINT(0, encoder.encode(makeSample(10250, 2130, 4500), buffer, sizeof(buffer)));
+
+    encoder.setFormat(PAYLOAD_CBOR);
+    TEST_ASSERT_EQUAL_UINT(0, encoder.encode(makeSample(10250, 2130, 4500), buffer, 8));
+}
+
+void test_unknown_format_falls_back_to_original() {
+    PayloadEncoder encoder(PAYLOAD_CBOR);
+    encoder.setFormat((PayloadFormat)7);
+    TEST_ASSERT_EQUAL(PAYLOAD_JSON_STRING, encoder.getFormat());
+}
+
+void test_json_batch() {
+    PayloadEncoder encoder(PAYLOAD_JSON_NUMBER);
+    SampleBuffer samples;
+    samples.push(makeSample(1000, 2130, 4500));
+    samples.push(makeSample(3000, 1900, SAMPLE_NO_HUMIDITY, 1));
+
+    uint8_t buffer[BATCH_PAYLOAD_SIZE];
+    uint16_t count;
+    size_t length = encoder.encodeBatch(samples, 11000, buffer, sizeof(buffer), count);
+    TEST_ASSERT_EQUAL_UINT16(2, count);
+    TEST_ASSERT_EQUAL_STRING("[{\"age\":10,\"temperature\":21.30,\"humidity\":45.00,\"uptime_ms\":1000},"
+                             "{\"age\":8,\"sensor\":1,\"temperature\":19.00,\"uptime_ms\":3000}]",
+                             (const char *)buffer);
+    TEST_ASSERT_EQUAL_UINT(strlen((const char *)buffer), length);
+    // The samples stay in the buffer until they are acknowledged
+    TEST_ASSERT_EQUAL_UINT16(2, samples.size());
+}
+
+void test_batch_stops_when_full() {
+    PayloadEncoder encoder(PAYLOAD_JSON_NUMBER);
+    SampleBuffer samples;
+    for (int i = 0; i < 40; i++) {
+        samples.push(makeSample(i * 1000, 2000 + i, 4500));
+    }
+
+    uint8_t buffer[BATCH_PAYLOAD_SIZE];
+    uint16_t count;
+    size_t length = encoder.encodeBatch(samples, 40000, buffer, sizeof(buffer), count);
+    TEST_ASSERT_GREATER_THAN(0, count);
+    TEST_ASSERT_LESS_THAN(40, count);
+    TEST_ASSERT_LESS_THAN(sizeof(buffer), length);
+    TEST_ASSERT_EQUAL(']', buffer[length - 1]);
+    TEST_ASSERT_EQUAL('\0', buffer[length]);
+
+    // A buffer too small for one sample encodes nothing
+    TEST_ASSERT_EQUAL_UINT(0, encoder.encodeBatch(samples, 40000, buffer, 20, count));
+    TEST_ASSERT_EQUAL_UINT16(0, count);
+}
+
+void test_cbor_batch() {
+    PayloadEncoder encoder(PAYLOAD_CBOR);
+    SampleBuffer samples;
+    samples.push(makeSample(1000, 2130, SAMPLE_NO_HUMIDITY, 1));
+
+    uint8_t buffer[BATCH_PAYLOAD_SIZE];
+    uint16_t count;
+    // [_ {"a":10,"s":1,"t":2130,"u":1000}]
+    const uint8_t expected[] = {0x9F, 0xA4, 0x61, 'a', 0x0A, 0x61, 's', 0x01, 0x61, 't', 0x19, 0x08, 0x52, 0x61, 'u', 0x19, 0x03, 0xE8, 0xFF};
+    TEST_ASSERT_EQUAL_UINT(sizeof(expected), encoder.encodeBatch(samples, 11000, buffer, sizeof(buffer), count));
+    TEST_ASSERT_EQUAL_UINT16(1, count);
+    TEST_ASSERT_EQUAL_MEMORY(expected, buffer, sizeof(expected));
+}
+
+void test_batch_age_from_stored_epoch() {
+    Clock clock;
+    clock.sync(1700000100, 0, 5000);
+    PayloadEncoder encoder(PAYLOAD_JSON_NUMBER);
+    encoder.setClock(&clock);
+
+    // Taken before a restart, its timestamp means nothing in this boot
+    Sample sample = makeSample(4000000000UL, 2130, SAMPLE_NO_HUMIDITY);
+    sample.epoch = 1700000000;
+    SampleBuffer samples;
+    samples.push(sample);
+
+    uint8_t buffer[BATCH_PAYLOAD_SIZE];
+    uint16_t count;
+    encoder.encodeBatch(samples, 5000, buffer, sizeof(buffer), count);
+    TEST_ASSERT_EQUAL_STRING("[{\"age\":100,\"temperature\":21.30,\"time\":1700000000.000}]", (const char *)buffer);
+}
+
+void test_history_lines() {
+    PayloadEncoder encoder;
+    char line[128];
+    Sample sample = makeSample(10250, -505, 4500, 2);
+
+    encoder.encodeLine(sample, true, line, sizeof(line));
+    TEST_ASSERT_EQUAL_STRING(",10250,2,-5.05,45.00\n", line);
+    encoder.encodeLine(sample, false, line, sizeof(line));
+    TEST_ASSERT_EQUAL_STRING("{\"uptime_ms\":10250,\"sensor\":2,\"temperature\":-5.05,\"humidity\":45.00}\n", line);
+
+    sample.epoch = 1700000000;
+    sample.epochMillis = 250;
+    encoder.encodeLine(sample, true, line, sizeof(line));
+    TEST_ASSERT_EQUAL_STRING("1700000000.250,10250,2,-5.05,45.00\n", line);
+}
+
+void test_payload_sizes() {
+    const char *names[PAYLOAD_FORMAT_COUNT] = {"json string", "json number", "cbor"};
+    size_t sizes[PAYLOAD_FORMAT_COUNT];
+
+    // The encode times are measured by test_benchmark
+    for (uint8_t format = 0; format < PAYLOAD_FORMAT_COUNT; format++) {
+        PayloadEncoder encoder((PayloadFormat)format);
+        uint8_t buffer[SAMPLE_PAYLOAD_SIZE];
+        sizes[format] = encoder.encode(makeSample(10250, 2130, 4500), buffer, sizeof(buffer));
+        printf("%-12s %3u bytes\n", names[format], (unsigned)sizes[format]);
+    }
+
+    TEST_ASSERT_LESS_THAN(sizes[PAYLOAD_JSON_STRING], sizes[PAYLOAD_JSON_NUMBER]);
+    TEST_ASSERT_LESS_THAN(sizes[PAYLOAD_JSON_NUMBER] / 2, sizes[PAYLOAD_CBOR]);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_json_string_format);
+    RUN_TEST(test_json_number_format);
+    RUN_TEST(test_uptime_without_clock);
+    RUN_TEST(test_stored_epoch_wins_over_clock);
+    RUN_TEST(test_cbor_format);
+    RUN_TEST(test_too_small_buffer);
+    RUN_TEST(test_unknown_format_falls_back_to_original);
+    RUN_TEST(test_json_batch);
+    RUN_TEST(test_batch_stops_when_full);
+    RUN_TEST(test_cbor_batch);
+    RUN_TEST(test_batch_age_from_stored_epoch);
+    RUN_TEST(test_history_lines);
+    RUN_TEST(test_payload_sizes);
+    return UNITY_END();
+}
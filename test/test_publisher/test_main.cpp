@@ -0,0 +1,192 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "MqttPublisher.h"
+
+static AsyncMqttClient *client;
+static PayloadEncoder *encoder;
+static MqttPublisher *publisher;
+static SampleBuffer *backlog;
+
+static Sample makeSample(uint32_t timestamp, int16_t temperature) {
+    Sample sample = {};
+    sample.timestamp = timestamp;
+    sample.temperature = temperature;
+    sample.humidity = SAMPLE_NO_HUMIDITY;
+    return sample;
+}
+
+void setUp() {
+    mockSetMillis(0);
+    client = new AsyncMqttClient();
+    encoder = new PayloadEncoder(PAYLOAD_JSON_NUMBER);
+    publisher = new MqttPublisher(*client, *encoder);
+    backlog = new SampleBuffer();
+    publisher->begin();
+}
+
+void tearDown() {
+    delete publisher;
+    delete encoder;
+    delete client;
+    delete backlog;
+}
+
+void test_publishes_retained_with_qos_1() {
+    TEST_ASSERT_TRUE(publisher->publish("room", makeSample(1000, 2130), 0));
+
+    TEST_ASSERT_EQUAL_UINT(1, client->messages.size());
+    TEST_ASSERT_EQUAL_STRING("room", client->messages[0].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("{\"temperature\":21.30,\"uptime_ms\":1000}", client->messages[0].payload.c_str());
+    TEST_ASSERT_EQUAL_UINT8(1, client->messages[0].qos);
+    TEST_ASSERT_TRUE(client->messages[0].retain);
+    TEST_ASSERT_EQUAL_UINT8(1, publisher->getInflight());
+}
+
+void test_window_limits_messages_in_flight() {
+    for (int i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+        TEST_ASSERT_TRUE(publisher->publish("room", makeSample(i, i), 0));
+    }
+    TEST_ASSERT_FALSE(publisher->publish("room", makeSample(9, 9), 0));
+
+    // A PUBACK frees its slot with the next update
+    client->ack(client->pending[0]);
+    TEST_ASSERT_FALSE(publisher->publish("room", makeSample(9, 9), 0));
+    publisher->update(*backlog, 10);
+    TEST_ASSERT_TRUE(publisher->publish("room", makeSample(9, 9), 10));
+}
+
+void test_refused_by_full_connection() {
+    client->full = true;
+    TEST_ASSERT_FALSE(publisher->publish("room", makeSample(0, 0), 0));
+    TEST_ASSERT_TRUE(publisher->isIdle());
+}
+
+void test_resends_with_dup_after_timeout() {
+    publisher->publish("room", makeSample(0, 2130), 0);
+    uint16_t packetId = client->messages[0].packetId;
+
+    publisher->update(*backlog, MQTT_ACK_TIMEOUT - 1);
+    TEST_ASSERT_EQUAL_UINT(1, client->messages.size());
+
+    publisher->update(*backlog, MQTT_ACK_TIMEOUT);
+    TEST_ASSERT_EQUAL_UINT(2, client->messages.size());
+    TEST_ASSERT_TRUE(client->messages[1].dup);
+    TEST_ASSERT_EQUAL_UINT16(packetId, client->messages[1].packetId);
+    TEST_ASSERT_EQUAL_STRING(client->messages[0].payload.c_str(), client->messages[1].payload.c_str());
+
+    client->ack(packetId);
+    publisher->update(*backlog, MQTT_ACK_TIMEOUT + 10);
+    TEST_ASSERT_TRUE(publisher->isIdle());
+}
+
+void test_disconnects_after_max_retries() {
+    publisher->publish("room", makeSample(0, 2130), 0);
+
+    uint32_t now = 0;
+    for (int i = 0; i < MQTT_MAX_RETRIES; i++) {
+        now += MQTT_ACK_TIMEOUT;
+        publisher->update(*backlog, now);
+    }
+    TEST_ASSERT_EQUAL_UINT(1 + MQTT_MAX_RETRIES, client->messages.size());
+    TEST_ASSERT_TRUE(client->connected());
+
+    publisher->update(*backlog, now + MQTT_ACK_TIMEOUT);
+    TEST_ASSERT_FALSE(client->connected());
+    TEST_ASSERT_EQUAL_UINT32(1, client->disconnects);
+}
+
+void test_abort_hands_back_unacked_samples() {
+    publisher->publish("room", makeSample(0, 1), 0);
+    publisher->publish("room", makeSample(0, 2), 0);
+    publisher->publish("room", makeSample(0, 3), 0);
+    client->ack(client->pending[1]);
+
+    Sample unacked[MQTT_INFLIGHT_WINDOW];
+    TEST_ASSERT_EQUAL_UINT8(2, publisher->abort(unacked, MQTT_INFLIGHT_WINDOW));
+    TEST_ASSERT_EQUAL_INT16(1, unacked[0].temperature);
+    TEST_ASSERT_EQUAL_INT16(3, unacked[1].temperature);
+    TEST_ASSERT_TRUE(publisher->isIdle());
+}
+
+void test_batch_removed_from_backlog_on_ack() {
+    for (int i = 0; i < 5; i++) {
+        backlog->push(makeSample(i * 1000, i));
+    }
+
+    TEST_ASSERT_TRUE(publisher->publishBatch("backlog", *backlog, 5000));
+    TEST_ASSERT_TRUE(publisher->isBatchInFlight());
+    TEST_ASSERT_FALSE(client->messages[0].retain);
+    // Only one batch at a time
+    TEST_ASSERT_FALSE(publisher->publishBatch("backlog", *backlog, 5000));
+
+    TEST_ASSERT_EQUAL_UINT16(0, publisher->update(*backlog, 5100));
+    TEST_ASSERT_EQUAL_UINT16(5, backlog->size());
+
+    client->ackAll();
+    TEST_ASSERT_EQUAL_UINT16(5, publisher->update(*backlog, 5200));
+    TEST_ASSERT_TRUE(backlog->isEmpty());
+    TEST_ASSERT_FALSE(publisher->isBatchInFlight());
+}
+
+void test_batch_ack_reports_newest_journaled_sample() {
+    for (int i = 0; i < 3; i++) {
+        Sample sample = makeSample(i * 1000, i);
+        sample.journal = 40 + i;
+        backlog->push(sample);
+    }
+    // A sample which could not be written to the journal
+    backlog->push(makeSample(3000, 3));
+
+    publisher->publishBatch("backlog", *backlog, 3000);
+    client->ackAll();
+    publisher->update(*backlog, 3100);
+    TEST_ASSERT_EQUAL_UINT32(42, publisher->getJournaled());
+}
+
+void test_batch_stays_in_backlog_without_ack() {
+    backlog->push(makeSample(0, 1));
+    publisher->publishBatch("backlog", *backlog, 0);
+
+    Sample unacked[MQTT_INFLIGHT_WINDOW];
+    TEST_ASSERT_EQUAL_UINT8(0, publisher->abort(unacked, MQTT_INFLIGHT_WINDOW));
+    TEST_ASSERT_EQUAL_UINT16(1, backlog->size());
+    TEST_ASSERT_FALSE(publisher->isBatchInFlight());
+}
+
+void test_batch_ack_skips_overwritten_samples() {
+    for (int i = 0; i < SAMPLE_BUFFER_SIZE; i++) {
+        backlog->push(makeSample(i, i));
+    }
+    publisher->publishBatch("backlog", *backlog, 0);
+    uint16_t packetId = client->messages[0].packetId;
+    const std::string &payload = client->messages[0].payload;
+    uint16_t batched = std::count(payload.begin(), payload.end(), '{');
+
+    // Three new samples overwrite three samples of the batch in flight
+    backlog->push(makeSample(1000, 1000));
+    backlog->push(makeSample(1001, 1001));
+    backlog->push(makeSample(1002, 1002));
+
+    client->ack(packetId);
+    uint16_t removed = publisher->update(*backlog, 100);
+    TEST_ASSERT_EQUAL_UINT16(batched - 3, removed);
+    TEST_ASSERT_EQUAL_UINT16(SAMPLE_BUFFER_SIZE - removed, backlog->size());
+    // The oldest sample left is the first one which was not in the batch
+    TEST_ASSERT_EQUAL_INT16(removed + 3, backlog->peek(0).temperature);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_publishes_retained_with_qos_1);
+    RUN_TEST(test_window_limits_messages_in_flight);
+    RUN_TEST(test_refused_by_full_connection);
+    RUN_TEST(test_resends_with_dup_after_timeout);
+    RUN_TEST(test_disconnects_after_max_retries);
+    RUN_TEST(test_abort_hands_back_unacked_samples);
+    RUN_TEST(test_batch_removed_from_backlog_on_ack);
+    RUN_TEST(test_batch_ack_reports_newest_journaled_sample);
+    RUN_TEST(test_batch_stays_in_backlog_without_ack);
+    RUN_TEST(test_batch_ack_skips_overwritten_samples);
+    return UNITY_END();
+}
@@ -0,0 +1,102 @@
+#include <unity.h>
+
+#include "ReportFilter.h"
+
+static Sample makeSample(uint32_t timestamp, int16_t temperature, uint16_t humidity) {
+    Sample sample = {};
+    sample.timestamp = timestamp;
+    sample.temperature = temperature;
+    sample.humidity = humidity;
+    return sample;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_reports_first_sample() {
+    ReportFilter filter;
+    filter.configure(50, 100, 0);
+    TEST_ASSERT_TRUE(filter.check(makeSample(0, 2000, 5000)));
+}
+
+void test_deadbands_of_both_channels() {
+    ReportFilter filter;
+    filter.configure(50, 100, 0);
+    filter.check(makeSample(0, 2000, 5000));
+
+    TEST_ASSERT_FALSE(filter.check(makeSample(1000, 2049, 5099)));
+    TEST_ASSERT_TRUE(filter.check(makeSample(2000, 1950, 5000)));
+    TEST_ASSERT_FALSE(filter.check(makeSample(3000, 1960, 5050)));
+    TEST_ASSERT_TRUE(filter.check(makeSample(4000, 1960, 5100)));
+    TEST_ASSERT_EQUAL_UINT32(3, filter.getReported());
+    TEST_ASSERT_EQUAL_UINT32(2, filter.getSuppressed());
+}
+
+void test_compares_with_last_reported_sample() {
+    ReportFilter filter;
+    filter.configure(50, 100, 0);
+    filter.check(makeSample(0, 2000, 5000));
+
+    // A slow drift is reported once it adds up to the deadband
+    TEST_ASSERT_FALSE(filter.check(makeSample(1000, 2020, 5000)));
+    TEST_ASSERT_FALSE(filter.check(makeSample(2000, 2040, 5000)));
+    TEST_ASSERT_TRUE(filter.check(makeSample(3000, 2060, 5000)));
+}
+
+void test_zero_deadband_reports_every_sample_of_channel() {
+    ReportFilter temperature;
+    temperature.configure(0, 100, 0);
+    temperature.check(makeSample(0, 2000, 5000));
+    TEST_ASSERT_TRUE(temperature.check(makeSample(1000, 2000, 5000)));
+
+    ReportFilter humidity;
+    humidity.configure(50, 0, 0);
+    humidity.check(makeSample(0, 2000, 5000));
+    TEST_ASSERT_TRUE(humidity.check(makeSample(1000, 2000, 5000)));
+
+    // Without humidity only the temperature counts
+    ReportFilter noHumidity;
+    noHumidity.configure(50, 0, 0);
+    noHumidity.check(makeSample(0, 2000, SAMPLE_NO_HUMIDITY));
+    TEST_ASSERT_FALSE(noHumidity.check(makeSample(1000, 2000, SAMPLE_NO_HUMIDITY)));
+}
+
+void test_humidity_appearing_is_a_change() {
+    ReportFilter filter;
+    filter.configure(50, 100, 0);
+    filter.check(makeSample(0, 2000, SAMPLE_NO_HUMIDITY));
+    TEST_ASSERT_TRUE(filter.check(makeSample(1000, 2000, 5000)));
+    TEST_ASSERT_TRUE(filter.check(makeSample(2000, 2000, SAMPLE_NO_HUMIDITY)));
+}
+
+void test_heartbeat_reports_unchanged_sample() {
+    ReportFilter filter;
+    filter.configure(50, 100, 60000);
+    filter.check(makeSample(0, 2000, 5000));
+
+    TEST_ASSERT_FALSE(filter.check(makeSample(59999, 2000, 5000)));
+    TEST_ASSERT_TRUE(filter.check(makeSample(60000, 2000, 5000)));
+    TEST_ASSERT_FALSE(filter.check(makeSample(60001, 2000, 5000)));
+}
+
+void test_heartbeat_over_millis_wraparound() {
+    ReportFilter filter;
+    filter.configure(50, 100, 60000);
+    filter.check(makeSample(UINT32_MAX - 1000, 2000, 5000));
+
+    TEST_ASSERT_FALSE(filter.check(makeSample(1000, 2000, 5000)));
+    TEST_ASSERT_TRUE(filter.check(makeSample(60000, 2000, 5000)));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_reports_first_sample);
+    RUN_TEST(test_deadbands_of_both_channels);
+    RUN_TEST(test_compares_with_last_reported_sample);
+    RUN_TEST(test_zero_deadband_reports_every_sample_of_channel);
+    RUN_TEST(test_humidity_appearing_is_a_change);
+    RUN_TEST(test_heartbeat_reports_unchanged_sample);
+    RUN_TEST(test_heartbeat_over_millis_wraparound);
+    return UNITY_END();
+}
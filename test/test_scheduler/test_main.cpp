@@ -0,0 +1,129 @@
+#include <unity.h>
+
+#include "Scheduler.h"
+
+static uint32_t runsA;
+static uint32_t runsB;
+static uint32_t order[4];
+static uint8_t orderCount;
+
+static void taskA() {
+    runsA++;
+    if (orderCount < 4) {
+        order[orderCount++] = 'A';
+    }
+}
+
+static void taskB() {
+    runsB++;
+    if (orderCount < 4) {
+        order[orderCount++] = 'B';
+    }
+}
+
+void setUp() {
+    runsA = 0;
+    runsB = 0;
+    orderCount = 0;
+}
+
+void tearDown() {}
+
+void test_runs_every_period() {
+    Scheduler scheduler;
+    TEST_ASSERT_EQUAL(0, scheduler.addTask(taskA, 100, 0));
+
+    for (uint32_t now = 0; now < 1000; now += 10) {
+        scheduler.run(now);
+    }
+    TEST_ASSERT_EQUAL_UINT32(10, runsA);
+}
+
+void test_offset_delays_first_run() {
+    Scheduler scheduler;
+    scheduler.addTask(taskA, 100, 0, 50);
+
+    scheduler.run(49);
+    TEST_ASSERT_EQUAL_UINT32(0, runsA);
+    scheduler.run(50);
+    TEST_ASSERT_EQUAL_UINT32(1, runsA);
+    TEST_ASSERT_EQUAL_UINT32(100, scheduler.timeUntilNext(50));
+}
+
+void test_keeps_running_over_millis_wraparound() {
+    Scheduler scheduler;
+    uint32_t start = UINT32_MAX - 450;
+    scheduler.addTask(taskA, 100, start);
+
+    for (uint32_t i = 0; i < 1000; i += 10) {
+        scheduler.run(start + i);
+    }
+    TEST_ASSERT_EQUAL_UINT32(10, runsA);
+}
+
+void test_time_until_next_over_wraparound() {
+    Scheduler scheduler;
+    uint32_t now = UINT32_MAX - 10;
+    scheduler.addTask(taskA, 100, now, 30);
+
+    TEST_ASSERT_EQUAL_UINT32(30, scheduler.timeUntilNext(now));
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.timeUntilNext(now + 30));
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.timeUntilNext(now + 1000));
+}
+
+void test_does_not_catch_up_missed_runs() {
+    Scheduler scheduler;
+    scheduler.addTask(taskA, 100, 0);
+
+    scheduler.run(0);
+    // A long blocking call elsewhere, the task runs once and keeps its period from now
+    scheduler.run(1050);
+    TEST_ASSERT_EQUAL_UINT32(2, runsA);
+    scheduler.run(1100);
+    TEST_ASSERT_EQUAL_UINT32(2, runsA);
+    scheduler.run(1150);
+    TEST_ASSERT_EQUAL_UINT32(3, runsA);
+}
+
+void test_keeps_cadence_when_late() {
+    Scheduler scheduler;
+    scheduler.addTask(taskA, 100, 0);
+
+    scheduler.run(0);
+    scheduler.run(130);
+    // The next run is due at 200, not at 230
+    TEST_ASSERT_EQUAL_UINT32(70, scheduler.timeUntilNext(130));
+}
+
+void test_most_overdue_runs_first() {
+    Scheduler scheduler;
+    scheduler.addTask(taskA, 100, 0, 20);
+    scheduler.addTask(taskB, 100, 0, 10);
+
+    scheduler.run(50);
+    TEST_ASSERT_EQUAL_UINT8(2, orderCount);
+    TEST_ASSERT_EQUAL('B', order[0]);
+    TEST_ASSERT_EQUAL('A', order[1]);
+}
+
+void test_rejects_too_many_tasks() {
+    Scheduler scheduler;
+    for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+        TEST_ASSERT_EQUAL(i, scheduler.addTask(taskA, 100, 0));
+    }
+    TEST_ASSERT_EQUAL(-1, scheduler.addTask(taskB, 100, 0));
+    TEST_ASSERT_EQUAL(-1, Scheduler().addTask(nullptr, 100, 0));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_runs_every_period);
+    RUN_TEST(test_offset_delays_first_run);
+    RUN_TEST(test_keeps_running_over_millis_wraparound);
+    RUN_TEST(test_time_until_next_over_wraparound);
+    RUN_TEST(test_does_not_catch_up_missed_runs);
+    RUN_TEST(test_keeps_cadence_when_late);
+    RUN_TEST(test_most_overdue_runs_first);
+    RUN_TEST(test_rejects_too_many_tasks);
+    return UNITY_END();
+}
@@ -0,0 +1,208 @@
+#include <unity.h>
+
+#include "FakeSensor.h"
+#include "SensorRegistry.h"
+
+/**
+ * Runs the registry like the sensor task, every 50 ms up to the given time.
+ */
+static void runUntil(SensorRegistry &sensors, uint32_t &now, uint32_t end) {
+    for (; now < end; now += 50) {
+        sensors.update(now);
+    }
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_fake_sensor_returns_set_values() {
+    FakeSensor sensor("fake", 2150, 4500);
+    Sample sample = {};
+
+    TEST_ASSERT_TRUE(sensor.begin());
+    TEST_ASSERT_TRUE(sensor.hasHumidity());
+    TEST_ASSERT_TRUE(sensor.read(sample));
+    TEST_ASSERT_EQUAL_INT16(2150, sample.temperature);
+    TEST_ASSERT_EQUAL_UINT16(4500, sample.humidity);
+
+    sensor.set(-300, SAMPLE_NO_HUMIDITY);
+    TEST_ASSERT_FALSE(sensor.hasHumidity());
+    TEST_ASSERT_TRUE(sensor.read(sample));
+    TEST_ASSERT_EQUAL_INT16(-300, sample.temperature);
+    TEST_ASSERT_EQUAL_UINT16(SAMPLE_NO_HUMIDITY, sample.humidity);
+    TEST_ASSERT_EQUAL_STRING("fake", sensor.getName());
+}
+
+void test_fake_sensor_ramp_goes_back_and_forth() {
+    FakeSensor sensor("fake", 2000);
+    sensor.setRamp(50, 100);
+    int16_t expected[] = {2000, 2050, 2100, 2050, 2000, 2050};
+
+    for (uint8_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        Sample sample = {};
+        sensor.read(sample);
+        TEST_ASSERT_EQUAL_INT16(expected[i], sample.temperature);
+    }
+}
+
+void test_fake_sensor_failing() {
+    FakeSensor sensor("fake", 2000);
+    Sample sample = {};
+
+    sensor.setFailing(true);
+    TEST_ASSERT_FALSE(sensor.read(sample));
+    sensor.setFailing(false);
+    TEST_ASSERT_TRUE(sensor.read(sample));
+    TEST_ASSERT_EQUAL_UINT32(2, sensor.getReads());
+}
+
+void test_registry_reads_every_period() {
+    FakeSensor sensor("fake", 2000, 5000);
+    SensorRegistry sensors;
+    TEST_ASSERT_EQUAL(0, sensors.add(&sensor, "", 1000, 0));
+    sensors.begin();
+
+    uint32_t now = 0;
+    runUntil(sensors, now, 10000);
+    TEST_ASSERT_EQUAL_UINT32(10, sensor.getReads());
+
+    Sample sample;
+    TEST_ASSERT_TRUE(sensors.take(0, sample));
+    TEST_ASSERT_EQUAL_INT16(2000, sample.temperature);
+    TEST_ASSERT_EQUAL_UINT16(5000, sample.humidity);
+    TEST_ASSERT_EQUAL_UINT8(0, sample.sensor);
+    TEST_ASSERT_EQUAL_UINT32(9000, sample.timestamp);
+    // Every reading is taken once
+    TEST_ASSERT_FALSE(sensors.take(0, sample));
+}
+
+void test_registry_staggers_sensors() {
+    FakeSensor first("first", 2000);
+    FakeSensor second("second", 1000);
+    SensorRegistry sensors;
+    sensors.add(&first, "", 10000, 0);
+    TEST_ASSERT_EQUAL(1, sensors.add(&second, "second", 10000, 0));
+
+    Sample sample;
+    uint32_t now = 0;
+    runUntil(sensors, now, 100);
+    TEST_ASSERT_TRUE(sensors.take(0, sample));
+    TEST_ASSERT_FALSE(sensors.take(1, sample));
+
+    runUntil(sensors, now, SENSOR_STAGGER + 50);
+    TEST_ASSERT_TRUE(sensors.take(1, sample));
+    TEST_ASSERT_EQUAL_UINT8(1, sample.sensor);
+    TEST_ASSERT_EQUAL_UINT32(SENSOR_STAGGER, sample.timestamp);
+    TEST_ASSERT_EQUAL_STRING("second", sensors.getSuffix(1));
+}
+
+void test_registry_waits_for_conversion() {
+    FakeSensor sensor("slow", 2000);
+    sensor.setConversionTime(750);
+    SensorRegistry sensors;
+    sensors.add(&sensor, "", 10000, 0);
+
+    Sample sample;
+    TEST_ASSERT_TRUE(sensors.update(0));
+    TEST_ASSERT_EQUAL_UINT32(0, sensor.getReads());
+    TEST_ASSERT_TRUE(sensors.isBusy(100));
+    TEST_ASSERT_FALSE(sensors.update(700));
+    TEST_ASSERT_FALSE(sensors.take(0, sample));
+
+    TEST_ASSERT_TRUE(sensors.update(750));
+    TEST_ASSERT_EQUAL_UINT32(1, sensor.getReads());
+    TEST_ASSERT_TRUE(sensors.take(0, sample));
+    TEST_ASSERT_FALSE(sensors.isBusy(800));
+}
+
+void test_registry_counts_failures() {
+    FakeSensor sensor("fake", 2000);
+    sensor.setFailing(true);
+    SensorRegistry sensors;
+    sensors.add(&sensor, "", 1000, 0);
+
+    uint32_t now = 0;
+    runUntil(sensors, now, 3000);
+    Sample sample;
+    TEST_ASSERT_FALSE(sensors.take(0, sample));
+    TEST_ASSERT_EQUAL_UINT32(3, sensors.getFailures(0));
+}
+
+void test_registry_oversamples_within_period() {
+    FakeSensor sensor("fake", 2000);
+    sensor.setRamp(10, 1000);
+    SensorRegistry sensors;
+    sensors.add(&sensor, "", 4000, 0);
+
+    FilterSettings temperature;
+    temperature.oversample = 4;
+    sensors.setFilters(temperature, FilterSettings());
+
+    uint32_t now = 0;
+    runUntil(sensors, now, 4000);
+    TEST_ASSERT_EQUAL_UINT32(4, sensor.getReads());
+
+    // The average of 2000, 2010, 2020 and 2030
+    Sample sample;
+    TEST_ASSERT_TRUE(sensors.take(0, sample));
+    TEST_ASSERT_INT_WITHIN(1, 2015, sample.temperature);
+}
+
+void test_registry_trigger_all() {
+    FakeSensor first("first", 2000);
+    FakeSensor second("second", 1000);
+    SensorRegistry sensors;
+    sensors.add(&first, "", 60000, 0);
+    sensors.add(&second, "", 60000, 0);
+
+    uint32_t now = 0;
+    runUntil(sensors, now, 1000);
+    TEST_ASSERT_FALSE(sensors.isBusy(now));
+
+    sensors.triggerAll(now);
+    while (sensors.isBusy(now)) {
+        sensors.update(now);
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, first.getReads());
+    TEST_ASSERT_EQUAL_UINT32(2, second.getReads());
+}
+
+void test_registry_set_period_moves_next_reading_up() {
+    FakeSensor sensor("fake", 2000);
+    SensorRegistry sensors;
+    sensors.add(&sensor, "", 60000, 0);
+
+    uint32_t now = 0;
+    runUntil(sensors, now, 1000);
+    sensors.setPeriod(0, 2000, now);
+    runUntil(sensors, now, 3100);
+    TEST_ASSERT_EQUAL_UINT32(2, sensor.getReads());
+}
+
+void test_registry_is_full() {
+    FakeSensor sensor("fake", 2000);
+    SensorRegistry sensors;
+    for (int i = 0; i < SENSOR_MAX_COUNT; i++) {
+        TEST_ASSERT_EQUAL(i, sensors.add(&sensor, "", 1000, 0));
+    }
+    TEST_ASSERT_EQUAL(-1, sensors.add(&sensor, "", 1000, 0));
+    TEST_ASSERT_EQUAL_UINT8(SENSOR_MAX_COUNT, sensors.size());
+    TEST_ASSERT_NULL(sensors.getSensor(SENSOR_MAX_COUNT));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fake_sensor_returns_set_values);
+    RUN_TEST(test_fake_sensor_ramp_goes_back_and_forth);
+    RUN_TEST(test_fake_sensor_failing);
+    RUN_TEST(test_registry_reads_every_period);
+    RUN_TEST(test_registry_staggers_sensors);
+    RUN_TEST(test_registry_waits_for_conversion);
+    RUN_TEST(test_registry_counts_failures);
+    RUN_TEST(test_registry_oversamples_within_period);
+    RUN_TEST(test_registry_trigger_all);
+    RUN_TEST(test_registry_set_period_moves_next_reading_up);
+    RUN_TEST(test_registry_is_full);
+    return UNITY_END();
+}
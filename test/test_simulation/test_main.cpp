@@ -0,0 +1,549 @@
+#include <unity.h>
+
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Clock.h"
+#include "FakeSensor.h"
+#include "Journal.h"
+#include "MqttPublisher.h"
+#include "RamStorage.h"
+#include "ReportFilter.h"
+#include "Scheduler.h"
+#include "ScriptedWiFiScanner.h"
+#include "SensorRegistry.h"
+#include "WiFiSelector.h"
+
+/**
+ * Runs the node on the host for hours of simulated time, with the hardware replaced by the mocks:
+ * fake sensors, a scripted access point, the in-process broker and the journal in RAM.
+ * The tasks do what the tasks of main.cpp do, on the real Scheduler, SensorRegistry, ReportFilter,
+ * MqttPublisher, SampleBuffer, Journal and Backoff. A script takes the access point and the broker away,
+ * drops packets and cuts the power. The run checks the publish cadence, the time to reconnect
+ * and that every reported sample reaches the broker.
+ */
+
+// The step of the simulated time in milliseconds
+#define SIM_STEP 50
+// The epoch time the run starts at
+#define SIM_EPOCH 1700000000UL
+// millis() of the first boot, the counter wraps around half an hour into the run
+#define SIM_FIRST_BOOT_MILLIS (UINT32_MAX - 1800000UL)
+// The time between two samples of a sensor in milliseconds
+#define SIM_SAMPLE_PERIOD 10000
+// The time the access point takes to let the node join, and the broker to accept a connection and to send a PUBACK
+#define SIM_JOIN_TIME 2500
+#define SIM_CONNECT_TIME 300
+#define SIM_ACK_TIME 40
+#define SIM_SSID "sim"
+#define SIM_BACKLOG_TOPIC "sim/backlog"
+
+// The same as in main.cpp
+#define WIFI_PERIOD 500
+#define MQTT_PERIOD 100
+#define SENSOR_PERIOD 50
+#define PUBLISH_PERIOD 250
+#define FULL_CONNECT_TIMEOUT 10000
+#define WIFI_RETRY_DELAY 12000
+#define WIFI_RETRY_MAX_DELAY 300000
+#define MQTT_RETRY_DELAY 15000
+#define MQTT_RETRY_MAX_DELAY 300000
+#define MQTT_CONNECT_TIMEOUT 10000
+
+/**
+ * One part of the script, the network does not change during it.
+ */
+typedef struct phase_struct {
+    const char *name;
+    uint32_t duration;   // In milliseconds
+    bool accessPoint;    // The access point is up
+    bool broker;         // The broker is up
+    uint8_t lossPercent; // Share of the packets lost on the way to the broker
+    bool powerLoss;      // The node loses power at the start of the phase
+} Phase;
+
+static const Phase script[] = {
+    {"stable", 3600000, true, true, 0, false},      {"wifi outage", 300000, false, true, 0, false}, {"stable", 1800000, true, true, 0, false},
+    {"broker outage", 180000, true, false, 0, false}, {"stable", 1800000, true, true, 0, false},     {"lossy link", 1800000, true, true, 10, false},
+    {"stable", 1800000, true, true, 0, false},      {"wifi outage", 120000, false, true, 0, false}, {"power loss", 120000, false, true, 0, true},
+    {"stable", 3600000, true, true, 0, false},
+};
+#define SIM_PHASES (sizeof(script) / sizeof(script[0]))
+
+static const char *topics[] = {"sim/room", "sim/outside"};
+
+/**
+ * Everything outside the node, it survives a power loss of the node.
+ */
+struct World {
+    uint64_t time = 0; // Milliseconds since the start of the run
+    uint8_t phase = 0;
+    RamStorage flash;
+    uint32_t random = 12345;
+
+    size_t received = 0;                              // Messages of the client handed to the broker so far
+    std::vector<std::pair<uint64_t, uint16_t>> acks; // Due time and packet id of the PUBACKs on the way
+    uint32_t lostPackets = 0;
+
+    std::set<std::string> produced;  // Sensor and epoch time of every reported sample
+    std::set<std::string> delivered; // The same for every sample the broker received
+    uint32_t duplicates = 0;
+    uint32_t malformed = 0;          // Samples without epoch time
+    uint32_t replayed = 0;           // Samples taken from the journal on boot
+    uint32_t journalFailures = 0;
+    uint32_t backlogDropped = 0;
+
+    uint64_t lastLive[2] = {};       // Time the last live sample of a sensor arrived
+    int lastLivePhase[2] = {-1, -1}; // Phase it arrived in
+    uint32_t minGap = UINT32_MAX;
+    uint32_t maxGap = 0;
+
+    bool recovering = false;  // An outage ended and the node did not reach the broker yet
+    uint64_t outageEnd = 0;
+    uint32_t retryBound = 0;  // The longest time the reconnect may take after the outage
+    std::vector<std::pair<const char *, uint32_t>> reconnects; // Outage and the time to reach the broker again after it
+    uint32_t reconnectBounds[SIM_PHASES] = {};
+};
+
+/**
+ * The firmware, created again on every boot.
+ */
+struct Node {
+    Scheduler scheduler;
+    FakeSensor room{"room", 2150, 4500};
+    FakeSensor outside{"outside", 850};
+    SensorRegistry sensors;
+    ReportFilter filters[SENSOR_MAX_COUNT];
+    Clock clock;
+    PayloadEncoder encoder{PAYLOAD_JSON_NUMBER};
+    AsyncMqttClient client;
+    MqttPublisher publisher{client, encoder};
+    SampleBuffer backlog;
+    Journal journal;
+    ScriptedWiFiScanner scanner;
+    WiFiSelector selector;
+    Backoff wifiBackoff{WIFI_RETRY_DELAY, WIFI_RETRY_MAX_DELAY};
+    Backoff mqttBackoff{MQTT_RETRY_DELAY, MQTT_RETRY_MAX_DELAY};
+    bool wifiConnected = false;
+    Deadline wifiJoin; // Armed while the node joins the access point
+    uint32_t wifiJoinStart = 0;
+    Deadline mqttConnect; // Armed while the broker did not answer the connect
+    uint32_t mqttConnectStart = 0;
+
+    Node(JournalStorage &storage) : journal(storage) {}
+};
+
+static World world;
+static Node *node = nullptr;
+
+/**
+ * @return The sensor and the epoch time of a sample, the way the broker sees it
+ */
+static std::string sampleKey(uint8_t sensor, const std::string &time) {
+    return std::to_string(sensor) + "@" + time;
+}
+
+static uint32_t nextRandom() {
+    world.random = world.random * 1103515245 + 12345;
+    return world.random >> 16;
+}
+
+// The tasks of the node, like in main.cpp
+
+static uint32_t journalSample(Sample sample) {
+    if (sample.epoch == 0) {
+        node->clock.toEpoch(sample.timestamp, sample.epoch, sample.epochMillis);
+    }
+    return node->journal.append(sample);
+}
+
+static void requeueInflight() {
+    if (node->publisher.isIdle()) {
+        return;
+    }
+
+    Sample unacked[MQTT_INFLIGHT_WINDOW];
+    uint8_t count = node->publisher.abort(unacked, MQTT_INFLIGHT_WINDOW);
+    for (uint8_t i = 0; i < count; i++) {
+        unacked[i].journal = journalSample(unacked[i]);
+        node->backlog.push(unacked[i]);
+    }
+}
+
+static void sendSample(Sample &sample) {
+    if (node->client.connected() && node->publisher.publish(topics[sample.sensor], sample, millis())) {
+        return;
+    }
+
+    sample.journal = journalSample(sample);
+    node->backlog.push(sample);
+}
+
+static void sampleSensors() {
+    node->sensors.update(millis());
+}
+
+static void sendReadings() {
+    for (uint8_t id = 0; id < node->sensors.size(); id++) {
+        Sample sample;
+        if (!node->sensors.take(id, sample) || !node->filters[id].check(sample)) {
+            continue;
+        }
+
+        uint32_t seconds;
+        uint16_t ms;
+        char time[24];
+        node->clock.toEpoch(sample.timestamp, seconds, ms);
+        snprintf(time, sizeof(time), "%lu.%03u", (unsigned long)seconds, ms);
+        world.produced.insert(sampleKey(id, time));
+
+        sendSample(sample);
+    }
+}
+
+static void connectMQTT() {
+    uint32_t now = millis();
+
+    if (node->mqttConnect.isArmed()) {
+        if (node->mqttConnect.expired(now)) {
+            node->mqttConnect.clear();
+            node->client.disconnect(true);
+        }
+        return;
+    }
+
+    if (!node->mqttBackoff.ready(now)) {
+        return;
+    }
+
+    // Counts as failure until the broker accepts it
+    node->mqttBackoff.failed(now);
+    node->mqttConnectStart = now;
+    node->mqttConnect.set(now, MQTT_CONNECT_TIMEOUT);
+    node->client.connect();
+}
+
+static void updateMQTT() {
+    if (!node->client.connected()) {
+        requeueInflight();
+        if (node->wifiConnected) {
+            connectMQTT();
+        }
+        return;
+    }
+
+    uint16_t removed = node->publisher.update(node->backlog, millis());
+    if (removed > 0) {
+        node->journal.markSent(node->publisher.getJournaled());
+    }
+
+    if (!node->backlog.isEmpty() && !node->publisher.isBatchInFlight()) {
+        node->publisher.publishBatch(SIM_BACKLOG_TOPIC, node->backlog, millis());
+    }
+}
+
+static void updateWiFi() {
+    uint32_t now = millis();
+
+    if (node->wifiConnected) {
+        return;
+    }
+
+    // The failure of a join which timed out was counted when it started
+    if (node->wifiJoin.isArmed()) {
+        if (node->wifiJoin.expired(now)) {
+            node->wifiJoin.clear();
+        }
+        return;
+    }
+
+    if (!node->wifiBackoff.ready(now)) {
+        return;
+    }
+
+    node->wifiBackoff.failed(now);
+    WiFiCandidate best;
+    if (!node->scanner.start() || !node->selector.select(node->scanner, best)) {
+        return;
+    }
+    node->wifiJoinStart = now;
+    node->wifiJoin.set(now, FULL_CONNECT_TIMEOUT);
+}
+
+// The events of the network stack
+
+static void mqttOnConnect() {
+    node->client.connecting = false;
+    node->client.online = true;
+    node->mqttConnect.clear();
+    node->mqttBackoff.reset();
+
+    if (world.recovering) {
+        world.recovering = false;
+        uint32_t took = world.time - world.outageEnd;
+        world.reconnects.push_back({script[world.phase - 1].name, took});
+        world.reconnectBounds[world.reconnects.size() - 1] = world.retryBound;
+    }
+}
+
+static void wifiOnConnect() {
+    node->wifiJoin.clear();
+    node->wifiConnected = true;
+    node->wifiBackoff.reset();
+}
+
+static void wifiOnDisconnect() {
+    node->wifiConnected = false;
+    if (node->client.connected()) {
+        node->client.disconnect(true);
+    }
+}
+
+/**
+ * Starts the node, with the journal of the last run. The clock is synced from the start,
+ * as if SNTP or the RTC answered before the first sample.
+ */
+static void boot(uint32_t now) {
+    delete node;
+    node = new Node(world.flash);
+    mockSetMillis(now);
+
+    Node &n = *node;
+    n.client.online = false;
+    n.publisher.begin();
+    n.clock.sync(SIM_EPOCH + world.time / 1000, world.time % 1000, now);
+    n.encoder.setClock(&n.clock);
+    n.wifiBackoff.seed(nextRandom());
+    n.mqttBackoff.seed(nextRandom());
+    n.selector.addProfile(0, SIM_SSID, 0);
+
+    n.room.setRamp(5, 200);
+    n.sensors.add(&n.room, "", SIM_SAMPLE_PERIOD, now);
+    n.sensors.add(&n.outside, "outside", SIM_SAMPLE_PERIOD, now);
+    n.sensors.begin();
+
+    if (!n.journal.begin()) {
+        world.journalFailures++;
+    }
+    world.replayed += n.journal.replay(n.backlog, now);
+    world.received = 0;
+    world.acks.clear();
+
+    n.scheduler.addTask(updateWiFi, WIFI_PERIOD, now);
+    n.scheduler.addTask(updateMQTT, MQTT_PERIOD, now);
+    n.scheduler.addTask(sampleSensors, SENSOR_PERIOD, now);
+    n.scheduler.addTask(sendReadings, PUBLISH_PERIOD, now);
+}
+
+/**
+ * Records the samples of a message the broker received, by sensor and epoch time.
+ */
+static void deliver(const AsyncMqttClient::Message &message) {
+    int topicSensor = -1;
+    for (uint8_t i = 0; i < 2; i++) {
+        if (message.topic == topics[i]) {
+            topicSensor = i;
+        }
+    }
+    if (topicSensor < 0 && message.topic != SIM_BACKLOG_TOPIC) {
+        return;
+    }
+
+    const std::string &payload = message.payload;
+    size_t start = 0;
+    while ((start = payload.find('{', start)) != std::string::npos) {
+        size_t end = payload.find('}', start);
+        std::string object = payload.substr(start, end - start);
+        start = end;
+
+        uint8_t sensor = topicSensor >= 0 ? topicSensor : 0;
+        size_t field = object.find("\"sensor\":");
+        if (field != std::string::npos) {
+            sensor = atoi(object.c_str() + field + 9);
+        }
+        field = object.find("\"time\":");
+        if (field == std::string::npos) {
+            world.malformed++;
+            continue;
+        }
+        std::string time = object.substr(field + 7, object.find(',', field) - field - 7);
+
+        if (!world.delivered.insert(sampleKey(sensor, time)).second) {
+            world.duplicates++;
+            continue;
+        }
+
+        // The cadence of the live samples is only measured while the network is fine
+        const Phase &phase = script[world.phase];
+        if (topicSensor < 0 || message.dup || !phase.accessPoint || !phase.broker || phase.lossPercent > 0) {
+            continue;
+        }
+        if (world.lastLivePhase[sensor] == world.phase) {
+            uint32_t gap = world.time - world.lastLive[sensor];
+            world.minGap = min(world.minGap, gap);
+            world.maxGap = max(world.maxGap, gap);
+        }
+        world.lastLive[sensor] = world.time;
+        world.lastLivePhase[sensor] = world.phase;
+    }
+}
+
+/**
+ * Moves the network one step: joins, connects, carries the packets to the broker and the PUBACKs back.
+ */
+static void updateNetwork() {
+    Node &n = *node;
+    const Phase &phase = script[world.phase];
+    uint32_t now = millis();
+
+    n.scanner.networks.clear();
+    if (phase.accessPoint) {
+        n.scanner.add(SIM_SSID, 1, 6, -60);
+    }
+
+    if (n.wifiConnected && !phase.accessPoint) {
+        wifiOnDisconnect();
+    }
+    if (n.wifiJoin.isArmed() && phase.accessPoint && now - n.wifiJoinStart >= SIM_JOIN_TIME) {
+        wifiOnConnect();
+    }
+
+    if (n.client.connected() && !phase.broker) {
+        n.client.disconnect(true);
+    }
+    if (n.client.connecting && n.wifiConnected && phase.broker && now - n.mqttConnectStart >= SIM_CONNECT_TIME) {
+        mqttOnConnect();
+    }
+
+    for (; world.received < n.client.messages.size(); world.received++) {
+        const AsyncMqttClient::Message &message = n.client.messages[world.received];
+        if (message.qos == 0) {
+            deliver(message);
+        } else if (nextRandom() % 100 < phase.lossPercent) {
+            // Lost on the way, the PUBACK never comes
+            for (size_t i = n.client.pending.size(); i-- > 0;) {
+                if (n.client.pending[i] == message.packetId) {
+                    n.client.pending.erase(n.client.pending.begin() + i);
+                    break;
+                }
+            }
+            world.lostPackets++;
+        } else {
+            deliver(message);
+            world.acks.push_back({world.time + SIM_ACK_TIME, message.packetId});
+        }
+    }
+
+    while (!world.acks.empty() && world.acks.front().first <= world.time) {
+        n.client.ack(world.acks.front().second);
+        world.acks.erase(world.acks.begin());
+    }
+}
+
+/**
+ * Runs the whole script once, the tests check the outcome.
+ */
+static void runScript() {
+    boot(SIM_FIRST_BOOT_MILLIS);
+
+    for (world.phase = 0; world.phase < SIM_PHASES; world.phase++) {
+        const Phase &phase = script[world.phase];
+        const Phase *previous = world.phase > 0 ? &script[world.phase - 1] : nullptr;
+
+        if (phase.powerLoss) {
+            world.backlogDropped += node->backlog.getDropped();
+            boot(0);
+        }
+
+        // The first phase with the access point and the broker up ends the outage
+        if (previous != nullptr && (!previous->accessPoint || !previous->broker) && phase.accessPoint && phase.broker) {
+            world.recovering = true;
+            world.outageEnd = world.time;
+            // Both retries can be pending, the WiFi one first. The jitter makes each up to a fifth longer.
+            world.retryBound = (node->wifiBackoff.getCurrentDelay() + node->mqttBackoff.getCurrentDelay()) * 6 / 5 + FULL_CONNECT_TIMEOUT +
+                               MQTT_CONNECT_TIMEOUT + WIFI_PERIOD + MQTT_PERIOD;
+        }
+
+        for (uint32_t elapsed = 0; elapsed < phase.duration; elapsed += SIM_STEP) {
+            updateNetwork();
+            node->scheduler.run(millis());
+            delay(SIM_STEP);
+            world.time += SIM_STEP;
+        }
+    }
+    world.phase = SIM_PHASES - 1;
+    world.backlogDropped += node->backlog.getDropped();
+
+    printf("Simulated %lu minutes: %u samples reported, %u delivered, %u duplicates, %u packets lost, %u replayed from the journal\n",
+           (unsigned long)(world.time / 60000), (unsigned)world.produced.size(), (unsigned)world.delivered.size(), (unsigned)world.duplicates,
+           (unsigned)world.lostPackets, (unsigned)world.replayed);
+    printf("Live samples arrived every %u to %u ms\n", (unsigned)world.minGap, (unsigned)world.maxGap);
+    for (size_t i = 0; i < world.reconnects.size(); i++) {
+        printf("Reached the broker %u ms after the %s, at most %u ms allowed\n", (unsigned)world.reconnects[i].second, world.reconnects[i].first,
+               (unsigned)world.reconnectBounds[i]);
+    }
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_every_sample_reaches_the_broker() {
+    TEST_ASSERT_GREATER_THAN(2000, world.produced.size());
+    TEST_ASSERT_EQUAL_UINT32(0, world.backlogDropped);
+    TEST_ASSERT_EQUAL_UINT32(0, world.malformed);
+
+    uint32_t missing = 0;
+    for (const std::string &key : world.produced) {
+        if (world.delivered.count(key) == 0) {
+            missing++;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, missing);
+    TEST_ASSERT_EQUAL_UINT32(world.produced.size(), world.delivered.size());
+}
+
+void test_nothing_left_behind() {
+    TEST_ASSERT_TRUE(node->backlog.isEmpty());
+    TEST_ASSERT_EQUAL_UINT32(0, node->journal.getPending());
+    TEST_ASSERT_TRUE(node->client.connected());
+}
+
+void test_lost_packets_are_sent_again() {
+    // The deliveries are checked by test_every_sample_reaches_the_broker
+    TEST_ASSERT_GREATER_THAN(0, world.lostPackets);
+}
+
+void test_power_loss_replays_the_journal() {
+    TEST_ASSERT_EQUAL_UINT32(0, world.journalFailures);
+    TEST_ASSERT_GREATER_THAN(0, world.replayed);
+}
+
+void test_publish_cadence() {
+    // A sample is read within a sensor task period of being due and sent with the next publish task run
+    TEST_ASSERT_GREATER_OR_EQUAL(SIM_SAMPLE_PERIOD - PUBLISH_PERIOD - SENSOR_PERIOD, world.minGap);
+    TEST_ASSERT_LESS_OR_EQUAL(SIM_SAMPLE_PERIOD + PUBLISH_PERIOD + SENSOR_PERIOD, world.maxGap);
+}
+
+void test_reconnect_latency() {
+    // The WiFi outages, the broker outage and the power loss
+    TEST_ASSERT_EQUAL(3, world.reconnects.size());
+    for (size_t i = 0; i < world.reconnects.size(); i++) {
+        TEST_ASSERT_LESS_OR_EQUAL(world.reconnectBounds[i], world.reconnects[i].second);
+    }
+}
+
+int main() {
+    runScript();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_every_sample_reaches_the_broker);
+    RUN_TEST(test_nothing_left_behind);
+    RUN_TEST(test_lost_packets_are_sent_again);
+    RUN_TEST(test_power_loss_replays_the_journal);
+    RUN_TEST(test_publish_cadence);
+    RUN_TEST(test_reconnect_latency);
+    return UNITY_END();
+}
@@ -0,0 +1,143 @@
+#include <unity.h>
+
+#include "Timer.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_deadline_expires_after_timeout() {
+    Deadline deadline;
+    TEST_ASSERT_FALSE(deadline.isArmed());
+    TEST_ASSERT_FALSE(deadline.expired(1000));
+
+    deadline.set(1000, 500);
+    TEST_ASSERT_TRUE(deadline.isArmed());
+    TEST_ASSERT_FALSE(deadline.expired(1499));
+    TEST_ASSERT_TRUE(deadline.expired(1500));
+
+    deadline.clear();
+    TEST_ASSERT_FALSE(deadline.expired(2000));
+}
+
+void test_deadline_over_millis_wraparound() {
+    Deadline deadline;
+    uint32_t now = UINT32_MAX - 100;
+    deadline.set(now, 500);
+
+    TEST_ASSERT_FALSE(deadline.expired(now + 50));
+    TEST_ASSERT_FALSE(deadline.expired(now + 499));
+    TEST_ASSERT_TRUE(deadline.expired(now + 500));
+    TEST_ASSERT_TRUE(Deadline::reached(10, UINT32_MAX - 10));
+    TEST_ASSERT_FALSE(Deadline::reached(UINT32_MAX - 10, 10));
+}
+
+void test_backoff_ready_before_first_failure() {
+    Backoff backoff(1000, 8000);
+    TEST_ASSERT_TRUE(backoff.ready(0));
+    TEST_ASSERT_EQUAL_UINT32(0, backoff.getCurrentDelay());
+}
+
+void test_backoff_doubles_up_to_maximum() {
+    Backoff backoff(1000, 8000, 0);
+    uint32_t expected[] = {1000, 2000, 4000, 8000, 8000, 8000};
+
+    uint32_t now = 0;
+    for (uint8_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        backoff.failed(now);
+        TEST_ASSERT_EQUAL_UINT32(expected[i], backoff.getCurrentDelay());
+        TEST_ASSERT_FALSE(backoff.ready(now + expected[i] - 1));
+        TEST_ASSERT_TRUE(backoff.ready(now + expected[i]));
+        now += expected[i];
+    }
+}
+
+void test_backoff_does_not_overflow() {
+    Backoff backoff(60000, 3600000, 0);
+    for (int i = 0; i < 300; i++) {
+        backoff.failed(0);
+    }
+    TEST_ASSERT_EQUAL_UINT32(3600000, backoff.getCurrentDelay());
+}
+
+void test_backoff_reset() {
+    Backoff backoff(1000, 8000, 0);
+    backoff.failed(0);
+    backoff.failed(0);
+    backoff.reset();
+
+    TEST_ASSERT_TRUE(backoff.ready(0));
+    backoff.failed(0);
+    TEST_ASSERT_EQUAL_UINT32(1000, backoff.getCurrentDelay());
+}
+
+/**
+ * Finds the delay of the last failure by waiting for ready().
+ */
+static uint32_t measureDelay(Backoff &backoff, uint32_t now) {
+    uint32_t waited = 0;
+    while (!backoff.ready(now + waited)) {
+        waited++;
+    }
+    return waited;
+}
+
+void test_backoff_jitter_stays_in_bounds() {
+    uint32_t lowest = UINT32_MAX;
+    uint32_t highest = 0;
+
+    for (uint32_t seed = 1; seed <= 200; seed++) {
+        Backoff backoff(10000, 80000, 20);
+        backoff.seed(seed * 2654435761UL);
+        backoff.failed(0);
+
+        uint32_t delay = measureDelay(backoff, 0);
+        TEST_ASSERT_GREATER_OR_EQUAL(8000, delay);
+        TEST_ASSERT_LESS_OR_EQUAL(12000, delay);
+        lowest = delay < lowest ? delay : lowest;
+        highest = delay > highest ? delay : highest;
+    }
+
+    // The delays are spread over the range, not all the same
+    TEST_ASSERT_LESS_THAN(9000, lowest);
+    TEST_ASSERT_GREATER_THAN(11000, highest);
+}
+
+void test_backoff_jitter_at_maximum() {
+    Backoff backoff(10000, 80000, 20);
+    backoff.seed(42);
+
+    for (int i = 0; i < 50; i++) {
+        backoff.failed(UINT32_MAX - 1000);
+        uint32_t delay = measureDelay(backoff, UINT32_MAX - 1000);
+        TEST_ASSERT_LESS_OR_EQUAL(96000, delay);
+        if (i >= 3) {
+            TEST_ASSERT_GREATER_OR_EQUAL(64000, delay);
+        }
+    }
+}
+
+void test_backoff_seeds_spread_devices() {
+    Backoff first(10000, 80000);
+    Backoff second(10000, 80000);
+    first.seed(0x1234);
+    second.seed(0x5678);
+
+    first.failed(0);
+    second.failed(0);
+    TEST_ASSERT_NOT_EQUAL(measureDelay(first, 0), measureDelay(second, 0));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_deadline_expires_after_timeout);
+    RUN_TEST(test_deadline_over_millis_wraparound);
+    RUN_TEST(test_backoff_ready_before_first_failure);
+    RUN_TEST(test_backoff_doubles_up_to_maximum);
+    RUN_TEST(test_backoff_does_not_overflow);
+    RUN_TEST(test_backoff_reset);
+    RUN_TEST(test_backoff_jitter_stays_in_bounds);
+    RUN_TEST(test_backoff_jitter_at_maximum);
+    RUN_TEST(test_backoff_seeds_spread_devices);
+    return UNITY_END();
+}
@@ -0,0 +1,158 @@
+#include <unity.h>
+
+#include "ScriptedWiFiScanner.h"
+#include "WiFiSelector.h"
+
+static ScriptedWiFiScanner *scanner;
+static WiFiSelector *selector;
+
+void setUp() {
+    scanner = new ScriptedWiFiScanner();
+    selector = new WiFiSelector();
+    selector->addProfile(0, "home", 0);
+    selector->addProfile(1, "garage", 0);
+}
+
+void tearDown() {
+    delete scanner;
+    delete selector;
+}
+
+void test_picks_strongest_access_point() {
+    scanner->add("home", 1, 1, -80);
+    scanner->add("home", 2, 6, -55);
+    scanner->add("garage", 3, 11, -70);
+    scanner->start();
+
+    WiFiCandidate best;
+    TEST_ASSERT_TRUE(selector->select(*scanner, best));
+    TEST_ASSERT_EQUAL_UINT8(0, best.profile);
+    TEST_ASSERT_EQUAL_UINT8(2, best.bssid[5]);
+    TEST_ASSERT_EQUAL_UINT8(6, best.channel);
+    TEST_ASSERT_EQUAL_INT(-55, best.rssi);
+}
+
+void test_priority_outweighs_small_rssi_difference() {
+    selector->addProfile(1, "garage", 10);
+    scanner->add("home", 1, 1, -60);
+    scanner->add("garage", 2, 6, -65);
+    scanner->start();
+
+    WiFiCandidate best;
+    TEST_ASSERT_TRUE(selector->select(*scanner, best));
+    TEST_ASSERT_EQUAL_UINT8(1, best.profile);
+
+    // But not a much worse signal
+    scanner->networks[0].rssi = -40;
+    TEST_ASSERT_TRUE(selector->select(*scanner, best));
+    TEST_ASSERT_EQUAL_UINT8(0, best.profile);
+}
+
+void test_skips_unknown_and_weak_networks() {
+    scanner->add("neighbour", 1, 1, -30);
+    scanner->add("home", 2, 6, WIFI_MIN_RSSI - 1);
+    scanner->start();
+
+    WiFiCandidate best;
+    TEST_ASSERT_FALSE(selector->select(*scanner, best));
+
+    scanner->add("garage", 3, 11, WIFI_MIN_RSSI);
+    TEST_ASSERT_TRUE(selector->select(*scanner, best));
+    TEST_ASSERT_EQUAL_UINT8(1, best.profile);
+}
+
+void test_no_result_while_scanning() {
+    scanner->add("home", 1, 1, -50);
+    scanner->immediate = false;
+    scanner->start();
+
+    WiFiCandidate best;
+    TEST_ASSERT_FALSE(selector->select(*scanner, best));
+    scanner->finish();
+    TEST_ASSERT_TRUE(selector->select(*scanner, best));
+}
+
+void test_profiles_without_ssid_are_skipped() {
+    selector->clearProfiles();
+    TEST_ASSERT_TRUE(selector->addProfile(0, "home", 0));
+    TEST_ASSERT_TRUE(selector->addProfile(1, "", 0));
+    TEST_ASSERT_TRUE(selector->addProfile(2, "attic", 0));
+    TEST_ASSERT_FALSE(selector->addProfile(WIFI_SELECTOR_MAX_PROFILES, "cellar", 0));
+    TEST_ASSERT_EQUAL_UINT8(3, selector->getProfileCount());
+
+    scanner->add("attic", 1, 1, -50);
+    scanner->start();
+    WiFiCandidate best;
+    TEST_ASSERT_TRUE(selector->select(*scanner, best));
+    TEST_ASSERT_EQUAL_UINT8(2, best.profile);
+}
+
+void test_roam_needs_weak_signal_for_hold_time() {
+    selector->setRoamThreshold(-75);
+
+    TEST_ASSERT_FALSE(selector->checkRoam(-60, 0));
+    TEST_ASSERT_FALSE(selector->checkRoam(-80, 1000));
+    TEST_ASSERT_FALSE(selector->checkRoam(-80, 1000 + WIFI_ROAM_HOLD - 1));
+    TEST_ASSERT_TRUE(selector->checkRoam(-80, 1000 + WIFI_ROAM_HOLD));
+}
+
+void test_roam_hold_restarts_on_good_signal() {
+    selector->setRoamThreshold(-75);
+
+    selector->checkRoam(-80, 0);
+    selector->checkRoam(-70, WIFI_ROAM_HOLD / 2);
+    TEST_ASSERT_FALSE(selector->checkRoam(-80, WIFI_ROAM_HOLD));
+    TEST_ASSERT_TRUE(selector->checkRoam(-80, 2 * WIFI_ROAM_HOLD));
+}
+
+void test_roam_scans_are_rate_limited() {
+    selector->setRoamThreshold(-75);
+    selector->checkRoam(-80, 0);
+    TEST_ASSERT_TRUE(selector->checkRoam(-80, WIFI_ROAM_HOLD));
+
+    TEST_ASSERT_FALSE(selector->checkRoam(-80, WIFI_ROAM_HOLD + WIFI_ROAM_INTERVAL - 1));
+    TEST_ASSERT_TRUE(selector->checkRoam(-80, WIFI_ROAM_HOLD + WIFI_ROAM_INTERVAL));
+}
+
+void test_roam_disabled_and_after_connect() {
+    TEST_ASSERT_FALSE(selector->checkRoam(-90, 0));
+    TEST_ASSERT_FALSE(selector->checkRoam(-90, 10 * WIFI_ROAM_HOLD));
+
+    // A new connection is not left again before the roam interval
+    selector->setRoamThreshold(-75);
+    selector->resetRoam(0);
+    selector->checkRoam(-80, 0);
+    TEST_ASSERT_FALSE(selector->checkRoam(-80, WIFI_ROAM_HOLD));
+    TEST_ASSERT_TRUE(selector->checkRoam(-80, WIFI_ROAM_INTERVAL));
+}
+
+void test_should_roam_needs_hysteresis() {
+    uint8_t current[6] = {0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 1};
+    WiFiCandidate candidate = {};
+    memset(candidate.bssid, 0xAA, sizeof(candidate.bssid));
+    candidate.bssid[5] = 2;
+
+    candidate.rssi = -80 + WIFI_ROAM_HYSTERESIS - 1;
+    TEST_ASSERT_FALSE(selector->shouldRoam(candidate, current, -80));
+    candidate.rssi = -80 + WIFI_ROAM_HYSTERESIS;
+    TEST_ASSERT_TRUE(selector->shouldRoam(candidate, current, -80));
+
+    // The same access point is never a roam target
+    candidate.bssid[5] = 1;
+    TEST_ASSERT_FALSE(selector->shouldRoam(candidate, current, -80));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_picks_strongest_access_point);
+    RUN_TEST(test_priority_outweighs_small_rssi_difference);
+    RUN_TEST(test_skips_unknown_and_weak_networks);
+    RUN_TEST(test_no_result_while_scanning);
+    RUN_TEST(test_profiles_without_ssid_are_skipped);
+    RUN_TEST(test_roam_needs_weak_signal_for_hold_time);
+    RUN_TEST(test_roam_hold_restarts_on_good_signal);
+    RUN_TEST(test_roam_scans_are_rate_limited);
+    RUN_TEST(test_roam_disabled_and_after_connect);
+    RUN_TEST(test_should_roam_needs_hysteresis);
+    return UNITY_END();
+}